@@ -5,13 +5,13 @@ LIBMEDIAOVERRIDESQT = $${PWD}/libmediaoverridesqt
 equals(QT_MAJOR_VERSION, 4) {
     LIBRESOURCEINC = $${LIBRESOURCEQT}/include/qt4
     RESOURCEQTLIB = -L$${LIBRESOURCEQT}/build -lresourceqt
-    DBUSQEVENTLOOPLIB = -L$${LIBDBUSQEVENTLOOP}/build -ldbus-qeventloop
+    DBUSQEVENTLOOPLIB = -L$${LIBDBUSQEVENTLOOP}/build -ldbus-qeventloop -lrt
     TESTSTARGETDIR = libresourceqt-tests
 }
 equals(QT_MAJOR_VERSION, 5) {
     LIBRESOURCEINC = $${LIBRESOURCEQT}/include/qt4
     RESOURCEQTLIB = -L$${LIBRESOURCEQT}/build -lresourceqt5
-    DBUSQEVENTLOOPLIB = -L$${LIBDBUSQEVENTLOOP}/build -ldbus-qeventloop-qt5
+    DBUSQEVENTLOOPLIB = -L$${LIBDBUSQEVENTLOOP}/build -ldbus-qeventloop-qt5 -lrt
     TESTSTARGETDIR = libresourceqt-qt5-tests
 }
 
@@ -19,3 +19,13 @@ POLICY = $${LIBRESOURCEINC}/policy
 
 VERSION = 1.0.0
 
+
+# The static tracepoints of libresourceqt/src/resource-trace.h are built
+# into the library whenever sys/sdt.h is available. qmake
+# CONFIG+=resourceqt_no_trace leaves them out.
+resourceqt_no_trace: DEFINES += RESOURCEQT_NO_TRACE
+else:exists($$[QT_SYSROOT]/usr/include/sys/sdt.h): DEFINES += RESOURCEQT_TRACE
+
+# qmake CONFIG+=resourceqt_no_logs compiles the debug logging of
+# libresourceqt out entirely.
+resourceqt_no_logs: DEFINES += RESOURCEQT_NO_LOGS
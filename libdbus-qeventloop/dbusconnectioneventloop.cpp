@@ -21,24 +21,176 @@ USA.
 
 #include <QCoreApplication>
 #include <QSocketNotifier>
-#include <QTimer>
+#include <QThread>
 #include <QTimerEvent>
 
 #include "dbusconnectioneventloop.h"
 
+#include <time.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+
 Q_GLOBAL_STATIC(DBUSConnectionEventLoop, classInstance);
 
+// Default dispatch budget: enough for a burst of policy notifications,
+// short enough to keep a UI thread responsive.
+static const int DEFAULT_BUDGET_MESSAGES = 64;
+static const int DEFAULT_BUDGET_MICROSECONDS = 4000;
+
+static inline qint64 monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (qint64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+struct DBUSConnectionEventLoop::EpollWatch
+{
+    EpollWatch(int socket, ConnectionInfo *connectionInfo) :
+        fd(socket), info(connectionInfo), read(0), write(0), parked(false) {}
+
+    int         fd;
+    ConnectionInfo* info;
+    DBusWatch*  read;
+    DBusWatch*  write;
+    // Taken out of the epoll set after a hangup or error that no enabled
+    // watch could take, since epoll reports those whatever the event mask.
+    bool        parked;
+};
+
+struct DBUSConnectionEventLoop::ConnectionInfo
+{
+    ConnectionInfo(DBusConnection *conn, DBUSConnectionEventLoop *eventLoop) :
+        connection(conn), loop(eventLoop), removed(false), turnMessages(0), turnNs(0) {}
+
+    DBusConnection*             connection;
+    DBUSConnectionEventLoop*    loop;
+    bool                        removed;
+    ConnectionStatistics        statistics;
+
+    // Counted during a dispatch turn, added to the statistics after it
+    quint64                     turnMessages;
+    qint64                      turnNs;
+};
+
+struct DBUSConnectionEventLoop::TimeoutEntry
+{
+    TimeoutEntry(DBusTimeout *t) : timeout(t), queue(0), deadline(0), prev(0), next(0) {}
+
+    DBusTimeout*    timeout;
+    TimeoutQueue*   queue;
+    qint64          deadline;
+    TimeoutEntry*   prev;
+    TimeoutEntry*   next;
+};
+
+struct DBUSConnectionEventLoop::TimeoutQueue
+{
+    TimeoutQueue() : first(0), last(0) {}
+
+    TimeoutEntry*   first;
+    TimeoutEntry*   last;
+};
+
+// With the I/O thread, connections are added and removed in that thread,
+// so that the epoll notifier and the timeout timer are created there.
 bool DBUSConnectionEventLoop::addConnection(DBusConnection* conn)
 {
-    return classInstance()->internalAddConnection(conn);
+    DBUSConnectionEventLoop *loop = classInstance();
+
+    if (!loop->ioThread || QThread::currentThread() == loop->ioThread)
+        return loop->internalAddConnection(conn);
+
+    bool added = false;
+    QMetaObject::invokeMethod(loop, "internalAddConnection", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, added), Q_ARG(DBusConnection*, conn));
+    return added;
 }
 
 void DBUSConnectionEventLoop::removeConnection(DBusConnection* conn)
 {
-    classInstance()->internalRemoveConnection(conn);
+    DBUSConnectionEventLoop *loop = classInstance();
+
+    if (!loop->ioThread || QThread::currentThread() == loop->ioThread)
+        loop->internalRemoveConnection(conn);
+    else
+        QMetaObject::invokeMethod(loop, "internalRemoveConnection", Qt::BlockingQueuedConnection,
+                                  Q_ARG(DBusConnection*, conn));
+}
+
+bool DBUSConnectionEventLoop::setBackend(Backend backend)
+{
+    return classInstance()->internalSetBackend(backend);
+}
+
+DBUSConnectionEventLoop::Backend DBUSConnectionEventLoop::backend()
+{
+    return classInstance()->activeBackend;
+}
+
+void DBUSConnectionEventLoop::setDispatchBudget(int maxMessages, int maxMicroseconds)
+{
+    DBUSConnectionEventLoop *loop = classInstance();
+    loop->budgetMessages = maxMessages;
+    loop->budgetMicroseconds = maxMicroseconds;
 }
 
-DBUSConnectionEventLoop::DBUSConnectionEventLoop() : QObject()
+DBUSConnectionEventLoop::DispatchStatistics DBUSConnectionEventLoop::dispatchStatistics()
+{
+    DBUSConnectionEventLoop *loop = classInstance();
+    QMutexLocker locker(&loop->stateMutex);
+    DispatchStatistics statistics = loop->statistics;
+    statistics.wakeups = (quint32)loop->wakeupCount.fetchAndAddRelaxed(0);
+    return statistics;
+}
+
+DBUSConnectionEventLoop::ConnectionStatistics DBUSConnectionEventLoop::connectionStatistics(DBusConnection* conn)
+{
+    DBUSConnectionEventLoop *loop = classInstance();
+    QMutexLocker locker(&loop->stateMutex);
+    ConnectionInfo *info = loop->connectionInfos.value(conn);
+    return info ? info->statistics : ConnectionStatistics();
+}
+
+void DBUSConnectionEventLoop::resetDispatchStatistics()
+{
+    DBUSConnectionEventLoop *loop = classInstance();
+    QMutexLocker locker(&loop->stateMutex);
+    loop->statistics = DispatchStatistics();
+    loop->wakeupCount.fetchAndStoreRelaxed(0);
+    for (ConnectionInfos::const_iterator it = loop->connectionInfos.constBegin();
+         it != loop->connectionInfos.constEnd(); ++it)
+        it.value()->statistics = ConnectionStatistics();
+}
+
+void DBUSConnectionEventLoop::wakeup()
+{
+    DBUSConnectionEventLoop *loop = classInstance();
+    loop->wakeupCount.fetchAndAddRelaxed(1);
+    loop->scheduleDispatch();
+}
+
+bool DBUSConnectionEventLoop::setIoThreadEnabled(bool enabled)
+{
+    return classInstance()->internalSetIoThreadEnabled(enabled);
+}
+
+bool DBUSConnectionEventLoop::isIoThreadEnabled()
+{
+    return classInstance()->ioThread != 0;
+}
+
+DBUSConnectionEventLoop::DBUSConnectionEventLoop() : QObject(),
+    ioThread(0), timeoutTimerDeadline(0), handlingTimeouts(false),
+    nextConnection(0), dispatchDepth(0), activeBackend(SocketNotifierBackend), epollFd(-1), epollNotifier(0),
+    handlingEpollEvents(false), budgetMessages(DEFAULT_BUDGET_MESSAGES),
+    budgetMicroseconds(DEFAULT_BUDGET_MICROSECONDS), dispatchPending(0),
+    wakeupCount(0)
 {
     MYDEBUG();
 }
@@ -46,7 +198,32 @@ DBUSConnectionEventLoop::DBUSConnectionEventLoop() : QObject()
 DBUSConnectionEventLoop::~DBUSConnectionEventLoop()
 {
     MYDEBUG();
+
+    if (ioThread) {
+        ioThread->quit();
+        ioThread->wait();
+        delete ioThread;
+    }
+
     cleanup();
+
+    qDeleteAll(connectionInfos);
+    qDeleteAll(epollWatches);
+    qDeleteAll(retiredEpollWatches);
+
+    for (Timeouts::const_iterator it = timeouts.constBegin(); it != timeouts.constEnd(); ++it) {
+        TimeoutEntry *entry = it.value()->first;
+        while (entry) {
+            TimeoutEntry *next = entry->next;
+            delete entry;
+            entry = next;
+        }
+        delete it.value();
+    }
+#ifdef Q_OS_LINUX
+    if (epollFd >= 0)
+        close(epollFd);
+#endif
 }
 
 void DBUSConnectionEventLoop::cleanup()
@@ -74,6 +251,7 @@ void DBUSConnectionEventLoop::readSocket(int fd)
         const Watcher &watcher = it.value();
 
         if (watcher.read && watcher.read->isEnabled()) {
+            countBytesRead(watcher.info, fd);
             dbus_watch_handle(watcher.watch, DBUS_WATCH_READABLE);
             break;
         }
@@ -84,6 +262,22 @@ void DBUSConnectionEventLoop::readSocket(int fd)
     dispatch();
 }
 
+// Attribute the data waiting on a readable socket to its connection.
+void DBUSConnectionEventLoop::countBytesRead(ConnectionInfo *info, int fd)
+{
+#ifdef Q_OS_LINUX
+    int available = 0;
+
+    if (ioctl(fd, FIONREAD, &available) == 0 && available > 0) {
+        QMutexLocker locker(&stateMutex);
+        info->statistics.bytesRead += available;
+    }
+#else
+    Q_UNUSED(info);
+    Q_UNUSED(fd);
+#endif
+}
+
 // Handle a socket being ready to write.
 void DBUSConnectionEventLoop::writeSocket(int fd)
 {
@@ -103,32 +297,357 @@ void DBUSConnectionEventLoop::writeSocket(int fd)
     }
 }
 
+// Handle the sockets of the epoll set that became ready.
+void DBUSConnectionEventLoop::handleEpollEvents()
+{
+    MYDEBUG();
+
+#ifdef Q_OS_LINUX
+    struct epoll_event events[16];
+    bool haveRead = false;
+
+    int count = epoll_wait(epollFd, events, 16, 0);
+
+    stateMutex.lock();
+    handlingEpollEvents = true;
+    stateMutex.unlock();
+
+    for (int i = 0; i < count; i++) {
+        EpollWatch *epollWatch = reinterpret_cast<EpollWatch *>(events[i].data.ptr);
+        unsigned int ready = events[i].events;
+        unsigned int problems = 0;
+
+        if (ready & EPOLLERR)
+            problems |= DBUS_WATCH_ERROR;
+        if (ready & EPOLLHUP)
+            problems |= DBUS_WATCH_HANGUP;
+
+        stateMutex.lock();
+        DBusWatch *read = epollWatch->read;
+        DBusWatch *write = epollWatch->write;
+        ConnectionInfo *info = epollWatch->info;
+        stateMutex.unlock();
+        unsigned int readFlags = 0, writeFlags = 0;
+
+        if (read && dbus_watch_get_enabled(read) && (ready & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+            readFlags = DBUS_WATCH_READABLE | problems;
+        if (write && dbus_watch_get_enabled(write) && (ready & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            writeFlags = DBUS_WATCH_WRITABLE | problems;
+
+        if (readFlags & DBUS_WATCH_READABLE)
+            countBytesRead(info, epollWatch->fd);
+
+        if (read && read == write) {
+            if (readFlags | writeFlags)
+                dbus_watch_handle(read, readFlags | writeFlags);
+        }
+        else {
+            if (readFlags)
+                dbus_watch_handle(read, readFlags);
+            // The read may have removed the write watch.
+            stateMutex.lock();
+            bool writeStillWatched = epollWatch->write == write;
+            stateMutex.unlock();
+            if (writeFlags && writeStillWatched)
+                dbus_watch_handle(write, writeFlags);
+        }
+
+        if (readFlags)
+            haveRead = true;
+
+        // Epoll keeps reporting a hangup or error until the socket leaves
+        // the set. If no watch took it, nothing will remove the socket, so
+        // park it until a watch is enabled again.
+        if (problems && !(readFlags | writeFlags)) {
+            stateMutex.lock();
+            if (epollWatches.value(epollWatch->fd) == epollWatch && !epollWatch->parked) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, epollWatch->fd, NULL);
+                epollWatch->parked = true;
+            }
+            stateMutex.unlock();
+        }
+    }
+
+    stateMutex.lock();
+    handlingEpollEvents = false;
+    QList<EpollWatch*> retired = retiredEpollWatches;
+    retiredEpollWatches.clear();
+    stateMutex.unlock();
+
+    qDeleteAll(retired);
+
+    if (haveRead)
+        dispatch();
+#endif
+}
+
+// Dispatch queued messages, one per connection in turn, until none are left
+// or the budget is used up. Whatever is left is dispatched in a later turn.
 void DBUSConnectionEventLoop::dispatch()
 {
     MYDEBUG();
 
-    for (Connections::const_iterator it = connections.constBegin(); it != connections.constEnd(); ++it)
-        while (dbus_connection_dispatch(*it) == DBUS_DISPATCH_DATA_REMAINS)
-            ;
+    int count = connections.size();
+    if (count == 0)
+        return;
+
+    // Handlers may add or remove connections, so work on a copy. Start
+    // after the connection served last, so that a turn cut short by the
+    // budget does not always leave the same connections waiting.
+    QList<ConnectionInfo*> turn;
+    for (int i = 0; i < count; i++)
+        turn.append(connectionInfos.value(connections.at((nextConnection + i) % count)));
+
+    QList<ConnectionInfo*> pending = turn;
+    ConnectionInfo *lastServed = NULL;
+    qint64 started = monotonicNs();
+    qint64 deadline = budgetMicroseconds > 0 ? started + (qint64)budgetMicroseconds * 1000 : 0;
+    int dispatched = 0;
+    bool exhausted = false;
+
+    dispatchDepth++;
+    while (!pending.isEmpty() && !exhausted) {
+        for (int i = 0; i < pending.size() && !exhausted; ) {
+            ConnectionInfo *info = pending.at(i);
+
+            if (info->removed ||
+                dbus_connection_get_dispatch_status(info->connection) != DBUS_DISPATCH_DATA_REMAINS) {
+                pending.removeAt(i);
+                continue;
+            }
+
+            qint64 before = monotonicNs();
+            dbus_connection_dispatch(info->connection);
+            qint64 after = monotonicNs();
+
+            info->turnMessages++;
+            info->turnNs += after - before;
+            lastServed = info;
+            dispatched++;
+            ++i;
+
+            if ((budgetMessages > 0 && dispatched >= budgetMessages) ||
+                (deadline && after >= deadline))
+                exhausted = true;
+        }
+    }
+    dispatchDepth--;
+
+    bool rescheduled = false;
+    if (exhausted) {
+        for (int i = 0; i < pending.size() && !rescheduled; i++) {
+            rescheduled = !pending.at(i)->removed &&
+                dbus_connection_get_dispatch_status(pending.at(i)->connection) == DBUS_DISPATCH_DATA_REMAINS;
+        }
+    }
+
+    if (lastServed && !lastServed->removed)
+        nextConnection = connections.indexOf(lastServed->connection) + 1;
+
+    qint64 elapsed = monotonicNs() - started;
+    stateMutex.lock();
+    for (int i = 0; i < turn.size(); i++) {
+        ConnectionInfo *info = turn.at(i);
+        info->statistics.messages += info->turnMessages;
+        info->statistics.dispatchNs += info->turnNs;
+        info->turnMessages = 0;
+        info->turnNs = 0;
+    }
+    QList<ConnectionInfo*> retired;
+    if (dispatchDepth == 0) {
+        retired = retiredConnections;
+        retiredConnections.clear();
+    }
+    if (dispatched == 0) {
+        stateMutex.unlock();
+        qDeleteAll(retired);
+        return;
+    }
+    statistics.turns++;
+    statistics.messages += dispatched;
+    statistics.lastTurnNs = elapsed;
+    statistics.totalTurnNs += elapsed;
+    if (elapsed > statistics.maxTurnNs)
+        statistics.maxTurnNs = elapsed;
+    if (rescheduled)
+        statistics.rescheduledTurns++;
+    stateMutex.unlock();
+
+    qDeleteAll(retired);
+
+    if (rescheduled) {
+        MYDEBUGC("Dispatch budget used up after %d messages, continuing later", dispatched);
+        scheduleDispatch();
+    }
+}
+
+// Post a dispatch to the event loop unless one is already on its way. Only
+// the flag is touched here, so this is cheap from any thread.
+void DBUSConnectionEventLoop::scheduleDispatch()
+{
+    if (dispatchPending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "dispatchScheduled", Qt::QueuedConnection);
+}
+
+void DBUSConnectionEventLoop::dispatchScheduled()
+{
+    MYDEBUG();
+
+    // Clear the flag first: a wakeup arriving during the dispatch below
+    // has to schedule a new run, or its messages would wait for the next one.
+    dispatchPending.fetchAndStoreOrdered(0);
+    stateMutex.lock();
+    statistics.scheduledRuns++;
+    stateMutex.unlock();
+    dispatch();
 }
 
-// Handle timer events.
+// Handle the timeouts whose deadline has passed. They stay armed for
+// another interval, as dbus timeouts repeat until they are removed.
 void DBUSConnectionEventLoop::timerEvent(QTimerEvent *e)
 {
     MYDEBUG();
     MYDEBUGC("TimerID: %d", e->timerId());
 
-    DBusTimeout *timeout = timeouts.value(e->timerId());
+    if (e->timerId() != timeoutTimer.timerId()) {
+        QObject::timerEvent(e);
+        return;
+    }
+
+    timeoutTimer.stop();
+
+    // Qt may fire a little early, so round up to the millisecond.
+    qint64 now = monotonicNs();
+    qint64 expiry = now + 1000000;
+    QList<TimeoutEntry*> expired;
+
+    stateMutex.lock();
+    timeoutTimerDeadline = 0;
+    handlingTimeouts = true;
+    for (Timeouts::const_iterator it = timeouts.constBegin(); it != timeouts.constEnd(); ++it) {
+        TimeoutQueue *queue = it.value();
+        while (queue->first && queue->first->deadline <= expiry) {
+            expired.append(queue->first);
+            disarmTimeout(queue->first);
+        }
+    }
+
+    for (int i = 0; i < expired.size(); i++)
+        armTimeout(expired.at(i), now);
+    stateMutex.unlock();
+
+    // A timeout disabled by an earlier handler is out of its queue.
+    for (int i = 0; i < expired.size(); i++) {
+        stateMutex.lock();
+        DBusTimeout *timeout = expired.at(i)->queue ? expired.at(i)->timeout : 0;
+        stateMutex.unlock();
+        if (timeout)
+            dbus_timeout_handle(timeout);
+    }
+
+    stateMutex.lock();
+    handlingTimeouts = false;
+    QList<TimeoutEntry*> retired = retiredTimeouts;
+    retiredTimeouts.clear();
+    stateMutex.unlock();
+
+    qDeleteAll(retired);
+
+    startTimeoutTimer(monotonicNs());
+}
+
+// Queue a timeout behind the others with the same interval. Returns true
+// if the timer has to be started for it. Called with stateMutex held.
+bool DBUSConnectionEventLoop::armTimeout(TimeoutEntry *entry, qint64 now)
+{
+    int interval = dbus_timeout_get_interval(entry->timeout);
+
+    TimeoutQueue *&queue = timeouts[interval];
+    if (!queue)
+        queue = new TimeoutQueue();
+
+    entry->queue = queue;
+    entry->deadline = now + (qint64)interval * 1000000;
+    entry->prev = queue->last;
+    entry->next = 0;
+    if (queue->last)
+        queue->last->next = entry;
+    else
+        queue->first = entry;
+    queue->last = entry;
+
+    if (handlingTimeouts || (timeoutTimerDeadline && timeoutTimerDeadline <= entry->deadline))
+        return false;
+
+    timeoutTimerDeadline = entry->deadline;
+    return true;
+}
 
-    if (timeout)
-        dbus_timeout_handle(timeout);
+// Take a timeout out of its queue, if it is in one. The timer is left
+// running; if it fires for nothing it is simply restarted for the next
+// deadline. Called with stateMutex held.
+void DBUSConnectionEventLoop::disarmTimeout(TimeoutEntry *entry)
+{
+    TimeoutQueue *queue = entry->queue;
+
+    if (!queue)
+        return;
+
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        queue->first = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        queue->last = entry->prev;
+
+    entry->queue = 0;
+    entry->prev = entry->next = 0;
+}
+
+// The timer can only be started from the thread of the loop.
+void DBUSConnectionEventLoop::requestTimeoutTimer()
+{
+    if (QThread::currentThread() == thread())
+        startTimeoutTimer(monotonicNs());
+    else
+        QMetaObject::invokeMethod(this, "restartTimeoutTimer", Qt::QueuedConnection);
+}
+
+void DBUSConnectionEventLoop::restartTimeoutTimer()
+{
+    startTimeoutTimer(monotonicNs());
+}
+
+// Run the timer until the earliest deadline of all the queues.
+void DBUSConnectionEventLoop::startTimeoutTimer(qint64 now)
+{
+    qint64 earliest = 0;
+
+    stateMutex.lock();
+    for (Timeouts::const_iterator it = timeouts.constBegin(); it != timeouts.constEnd(); ++it) {
+        TimeoutEntry *first = it.value()->first;
+        if (first && (!earliest || first->deadline < earliest))
+            earliest = first->deadline;
+    }
+    timeoutTimerDeadline = earliest;
+    stateMutex.unlock();
+
+    if (!earliest) {
+        timeoutTimer.stop();
+        return;
+    }
+
+    qint64 delay = (earliest - now + 999999) / 1000000;
+    timeoutTimer.start(delay > 0 ? (int)delay : 0, this);
 }
 
 dbus_bool_t DBUSConnectionEventLoop::addWatch(DBusWatch *watch, void *data)
 {
     MYDEBUG();
 
-    DBUSConnectionEventLoop *loop = reinterpret_cast<DBUSConnectionEventLoop *>(data);
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
 
     int fd = dbus_watch_get_unix_fd(watch);
     unsigned int flags = dbus_watch_get_flags(watch);
@@ -136,6 +655,7 @@ dbus_bool_t DBUSConnectionEventLoop::addWatch(DBusWatch *watch, void *data)
 
     DBUSConnectionEventLoop::Watcher watcher;
     watcher.watch = watch;
+    watcher.info = reinterpret_cast<ConnectionInfo *>(data);
 
     if (flags & DBUS_WATCH_READABLE) {
         watcher.read = new QSocketNotifier(fd, QSocketNotifier::Read, loop);
@@ -158,7 +678,7 @@ void DBUSConnectionEventLoop::removeWatch(DBusWatch *watch, void *data)
 {
     MYDEBUG();
 
-    DBUSConnectionEventLoop *loop = reinterpret_cast<DBUSConnectionEventLoop *>(data);
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
 
     int fd = dbus_watch_get_unix_fd(watch);
 
@@ -188,7 +708,7 @@ void DBUSConnectionEventLoop::toggleWatch(DBusWatch *watch, void *data)
 {
     MYDEBUG();
 
-    DBUSConnectionEventLoop *loop = reinterpret_cast<DBUSConnectionEventLoop*>(data);
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
 
     int fd = dbus_watch_get_unix_fd(watch);
     unsigned int flags = dbus_watch_get_flags(watch);
@@ -213,6 +733,123 @@ void DBUSConnectionEventLoop::toggleWatch(DBusWatch *watch, void *data)
     }
 }
 
+void DBUSConnectionEventLoop::updateEpollWatch(EpollWatch *epollWatch)
+{
+#ifdef Q_OS_LINUX
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+
+    if (epollWatch->read && dbus_watch_get_enabled(epollWatch->read))
+        event.events |= EPOLLIN;
+    if (epollWatch->write && dbus_watch_get_enabled(epollWatch->write))
+        event.events |= EPOLLOUT;
+    event.data.ptr = epollWatch;
+
+    if (!epollWatch->parked) {
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, epollWatch->fd, &event);
+    }
+    else if (event.events != 0) {
+        // The hangup or error is reported again once the socket is back.
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, epollWatch->fd, &event) == 0)
+            epollWatch->parked = false;
+    }
+#else
+    Q_UNUSED(epollWatch);
+#endif
+}
+
+dbus_bool_t DBUSConnectionEventLoop::addEpollWatch(DBusWatch *watch, void *data)
+{
+    MYDEBUG();
+
+#ifdef Q_OS_LINUX
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
+    QMutexLocker locker(&loop->stateMutex);
+
+    int fd = dbus_watch_get_unix_fd(watch);
+    unsigned int flags = dbus_watch_get_flags(watch);
+
+    EpollWatch *epollWatch = loop->epollWatches.value(fd);
+    if (epollWatch == NULL) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+
+        epollWatch = new EpollWatch(fd, reinterpret_cast<ConnectionInfo *>(data));
+        event.data.ptr = epollWatch;
+        if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            MYDEBUGC("Adding fd %d to the epoll set failed", fd);
+            delete epollWatch;
+            return false;
+        }
+        loop->epollWatches.insert(fd, epollWatch);
+    }
+
+    if (flags & DBUS_WATCH_READABLE)
+        epollWatch->read = watch;
+    if (flags & DBUS_WATCH_WRITABLE)
+        epollWatch->write = watch;
+
+    loop->updateEpollWatch(epollWatch);
+
+    return true;
+#else
+    Q_UNUSED(watch);
+    Q_UNUSED(data);
+    return false;
+#endif
+}
+
+void DBUSConnectionEventLoop::removeEpollWatch(DBusWatch *watch, void *data)
+{
+    MYDEBUG();
+
+#ifdef Q_OS_LINUX
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
+    QMutexLocker locker(&loop->stateMutex);
+
+    int fd = dbus_watch_get_unix_fd(watch);
+
+    EpollWatch *epollWatch = loop->epollWatches.value(fd);
+    if (epollWatch == NULL)
+        return;
+
+    if (epollWatch->read == watch)
+        epollWatch->read = 0;
+    if (epollWatch->write == watch)
+        epollWatch->write = 0;
+
+    if (epollWatch->read || epollWatch->write) {
+        loop->updateEpollWatch(epollWatch);
+        return;
+    }
+
+    // The socket may already be closed, in which case the kernel has
+    // dropped it from the set and this fails harmlessly.
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, fd, NULL);
+    loop->epollWatches.remove(fd);
+
+    if (loop->handlingEpollEvents)
+        loop->retiredEpollWatches.append(epollWatch);
+    else
+        delete epollWatch;
+#else
+    Q_UNUSED(watch);
+    Q_UNUSED(data);
+#endif
+}
+
+void DBUSConnectionEventLoop::toggleEpollWatch(DBusWatch *watch, void *data)
+{
+    MYDEBUG();
+
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
+    QMutexLocker locker(&loop->stateMutex);
+
+    EpollWatch *epollWatch = loop->epollWatches.value(dbus_watch_get_unix_fd(watch));
+    if (epollWatch)
+        loop->updateEpollWatch(epollWatch);
+}
+
 dbus_bool_t DBUSConnectionEventLoop::addTimeout(DBusTimeout *timeout, void *data)
 {
     MYDEBUG();
@@ -225,17 +862,20 @@ dbus_bool_t DBUSConnectionEventLoop::addTimeout(DBusTimeout *timeout, void *data
     if (!QCoreApplication::instance())
         return true;
 
-    DBUSConnectionEventLoop *loop = reinterpret_cast<DBUSConnectionEventLoop *>(data);
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
 
-    int timerInterval = dbus_timeout_get_interval(timeout);
-    int id = loop->startTimer(timerInterval);
+    MYDEBUGC("Adding timeout %p with interval %d!", timeout, dbus_timeout_get_interval(timeout));
 
-    MYDEBUGC("Adding timeout %d with interval %d!", id, timerInterval);
+    // The timeout remembers its entry, so removing it needs no lookup.
+    TimeoutEntry *entry = new TimeoutEntry(timeout);
+    dbus_timeout_set_data(timeout, entry, NULL);
 
-    if (!id)
-        return false;
+    loop->stateMutex.lock();
+    bool startTimer = loop->armTimeout(entry, monotonicNs());
+    loop->stateMutex.unlock();
 
-    loop->timeouts[id] = timeout;
+    if (startTimer)
+        loop->requestTimeoutTimer();
 
     return true;
 }
@@ -244,35 +884,57 @@ void DBUSConnectionEventLoop::removeTimeout(DBusTimeout *timeout, void *data)
 {
     MYDEBUG();
 
-    DBUSConnectionEventLoop *loop = reinterpret_cast<DBUSConnectionEventLoop *>(data);
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
+    TimeoutEntry *entry = reinterpret_cast<TimeoutEntry *>(dbus_timeout_get_data(timeout));
 
-    DBUSConnectionEventLoop::Timeouts::iterator it = loop->timeouts.begin();
+    if (!entry)
+        return;
 
-    while (it != loop->timeouts.end()) {
-        if (it.value() == timeout) {
-            loop->killTimer(it.key());
-            it = loop->timeouts.erase(it);
-        }
-        else
-            ++it;
+    dbus_timeout_set_data(timeout, NULL, NULL);
+
+    QMutexLocker locker(&loop->stateMutex);
+    loop->disarmTimeout(entry);
+
+    // An expired timeout still waiting to be handled must not be touched.
+    if (loop->handlingTimeouts) {
+        entry->timeout = 0;
+        loop->retiredTimeouts.append(entry);
     }
+    else
+        delete entry;
 }
 
+// A disabled timeout keeps its entry, so toggling it only moves the entry
+// in and out of its queue. Only a timeout that has none yet gets one.
 void DBUSConnectionEventLoop::toggleTimeout(DBusTimeout *timeout, void *data)
 {
     MYDEBUG();
 
-    DBUSConnectionEventLoop::removeTimeout(timeout, data);
-    DBUSConnectionEventLoop::addTimeout(timeout, data);
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
+    TimeoutEntry *entry = reinterpret_cast<TimeoutEntry *>(dbus_timeout_get_data(timeout));
+
+    if (!entry) {
+        DBUSConnectionEventLoop::addTimeout(timeout, data);
+        return;
+    }
+
+    loop->stateMutex.lock();
+    loop->disarmTimeout(entry);
+    bool startTimer = dbus_timeout_get_enabled(timeout) && loop->armTimeout(entry, monotonicNs());
+    loop->stateMutex.unlock();
+
+    if (startTimer)
+        loop->requestTimeoutTimer();
 }
 
 void DBUSConnectionEventLoop::wakeupMain(void *data)
 {
     MYDEBUG();
 
-    DBUSConnectionEventLoop *loop = reinterpret_cast<DBUSConnectionEventLoop *>(data);
+    DBUSConnectionEventLoop *loop = reinterpret_cast<ConnectionInfo *>(data)->loop;
 
-    QTimer::singleShot(0, loop, SLOT(dispatch()));
+    loop->wakeupCount.fetchAndAddRelaxed(1);
+    loop->scheduleDispatch();
 }
 
 // The initialization point
@@ -289,24 +951,49 @@ bool DBUSConnectionEventLoop::internalAddConnection(DBusConnection* conn)
     MYDEBUGC("Adding connection %p", conn);
 
     // Check if connection is in list
-    Connections::iterator it;
-    for (it = connections.begin(); it != connections.end(); ++it) {
-        if( *it == conn ) {
-            MYDEBUGC("Connection already in list, skipping");
-            // Skip adding duplicate connection
-            return true;
+    if (connectionInfos.contains(conn)) {
+        MYDEBUGC("Connection already in list, skipping");
+        // Skip adding duplicate connection
+        return true;
+    }
+#ifdef Q_OS_LINUX
+    if (activeBackend == EpollBackend && epollFd < 0) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            MYDEBUGC("Creating the epoll set failed, using socket notifiers");
+            activeBackend = SocketNotifierBackend;
+        }
+        else {
+            epollNotifier = new QSocketNotifier(epollFd, QSocketNotifier::Read, this);
+            connect(epollNotifier, SIGNAL(activated(int)), SLOT(handleEpollEvents()));
         }
     }
+#endif
+
     // Add new connection
+    ConnectionInfo *info = new ConnectionInfo(conn, this);
+    stateMutex.lock();
     connections.append(conn);
+    connectionInfos.insert(conn, info);
+    stateMutex.unlock();
+
+    dbus_bool_t watchesSet;
+    if (activeBackend == EpollBackend) {
+        watchesSet = dbus_connection_set_watch_functions(conn,
+                                                         DBUSConnectionEventLoop::addEpollWatch,
+                                                         DBUSConnectionEventLoop::removeEpollWatch,
+                                                         DBUSConnectionEventLoop::toggleEpollWatch,
+                                                         info, 0);
+    }
+    else {
+        watchesSet = dbus_connection_set_watch_functions(conn,
+                                                         DBUSConnectionEventLoop::addWatch,
+                                                         DBUSConnectionEventLoop::removeWatch,
+                                                         DBUSConnectionEventLoop::toggleWatch,
+                                                         info, 0);
+    }
 
-    if (
-        !dbus_connection_set_watch_functions(conn,
-                                             DBUSConnectionEventLoop::addWatch,
-                                             DBUSConnectionEventLoop::removeWatch,
-                                             DBUSConnectionEventLoop::toggleWatch,
-                                             this, 0)
-    ) {
+    if (!watchesSet) {
         rc = false;
     }
     else if (
@@ -314,7 +1001,7 @@ bool DBUSConnectionEventLoop::internalAddConnection(DBusConnection* conn)
                                                DBUSConnectionEventLoop::addTimeout,
                                                DBUSConnectionEventLoop::removeTimeout,
                                                DBUSConnectionEventLoop::toggleTimeout,
-                                               this, 0)
+                                               info, 0)
     ) {
         rc = false;
     }
@@ -322,7 +1009,7 @@ bool DBUSConnectionEventLoop::internalAddConnection(DBusConnection* conn)
         rc = true;
     }
 
-    dbus_connection_set_wakeup_main_function(conn, DBUSConnectionEventLoop::wakeupMain, this, 0);
+    dbus_connection_set_wakeup_main_function(conn, DBUSConnectionEventLoop::wakeupMain, info, 0);
 
     return rc;
 }
@@ -331,15 +1018,93 @@ void DBUSConnectionEventLoop::internalRemoveConnection(DBusConnection* conn)
 {
     MYDEBUG();
 
-    Connections::iterator it;
-    for (it = connections.begin(); it != connections.end(); ++it) {
-        if( *it == conn ) {
-            dbus_connection_set_watch_functions(*it, NULL, NULL, NULL, NULL, NULL);
-            dbus_connection_set_timeout_functions(*it, NULL, NULL, NULL, NULL, NULL);
-            dbus_connection_set_wakeup_main_function(*it, NULL, NULL, NULL);
+    ConnectionInfo *info = connectionInfos.value(conn);
+    if (info == NULL)
+        return;
 
-            connections.erase(it);
-            return;
-        }
+    dbus_connection_set_watch_functions(conn, NULL, NULL, NULL, NULL, NULL);
+    dbus_connection_set_timeout_functions(conn, NULL, NULL, NULL, NULL, NULL);
+    dbus_connection_set_wakeup_main_function(conn, NULL, NULL, NULL);
+
+    QMutexLocker locker(&stateMutex);
+    connections.removeOne(conn);
+    connectionInfos.remove(conn);
+
+    // A dispatch turn in progress may still look at the info.
+    info->removed = true;
+    if (dispatchDepth > 0)
+        retiredConnections.append(info);
+    else
+        delete info;
+}
+
+bool DBUSConnectionEventLoop::internalSetBackend(Backend backend)
+{
+    MYDEBUG();
+
+    if (backend == activeBackend)
+        return true;
+
+    // Watches already handed out stay with the backend they were added to.
+    if (!connections.isEmpty() || ioThread)
+        return false;
+
+#ifndef Q_OS_LINUX
+    if (backend == EpollBackend)
+        return false;
+#endif
+
+    activeBackend = backend;
+    return true;
+}
+
+bool DBUSConnectionEventLoop::internalSetIoThreadEnabled(bool enabled)
+{
+    MYDEBUG();
+
+    if (enabled == (ioThread != 0))
+        return true;
+
+    if (!connections.isEmpty() || QThread::currentThread() != thread())
+        return false;
+
+    if (enabled && (!QCoreApplication::instance() || !internalSetBackend(EpollBackend)))
+        return false;
+
+    // The epoll notifier belongs to the thread that created it. There are
+    // no connections, so it is simply created again when one is added.
+    delete epollNotifier;
+    epollNotifier = 0;
+#ifdef Q_OS_LINUX
+    if (epollFd >= 0) {
+        close(epollFd);
+        epollFd = -1;
+    }
+#endif
+
+    if (enabled) {
+        // libdbus will now be used from more than one thread.
+        dbus_threads_init_default();
+
+        ioThread = new QThread();
+        ioThread->start();
+        moveToThread(ioThread);
     }
+    else {
+        QMetaObject::invokeMethod(this, "leaveIoThread", Qt::BlockingQueuedConnection,
+                                  Q_ARG(QThread*, QThread::currentThread()));
+        ioThread->quit();
+        ioThread->wait();
+        delete ioThread;
+        ioThread = 0;
+    }
+
+    return true;
+}
+
+// Only the thread an object lives in may push it to another thread.
+void DBUSConnectionEventLoop::leaveIoThread(QThread *target)
+{
+    timeoutTimer.stop();
+    moveToThread(target);
 }
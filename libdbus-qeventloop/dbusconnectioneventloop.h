@@ -26,6 +26,10 @@ USA.
 #include <QList>
 #include <QMultiHash>
 #include <QHash>
+#include <QAtomicInt>
+#include <QMap>
+#include <QBasicTimer>
+#include <QMutex>
 
 #include <dbus/dbus.h>
 
@@ -58,6 +62,7 @@ private:
 #endif
 
 class QSocketNotifier;
+class QThread;
 class QTimerEvent;
 
 /**
@@ -72,6 +77,45 @@ private:
     Q_DISABLE_COPY(DBUSConnectionEventLoop)
 
 public:
+    /**
+     * The ways of waiting for activity on the dbus sockets.
+     */
+    enum Backend {
+        SocketNotifierBackend,  ///< A QSocketNotifier per watch and direction (default)
+        EpollBackend            ///< All sockets in one epoll set behind one QSocketNotifier (Linux only)
+    };
+
+    /**
+     * Latency statistics of the dispatch turns, see dispatchStatistics().
+     * A turn is one run of the dispatcher, which handles queued messages
+     * until none are left or the budget is used up. Times are in nanoseconds.
+     */
+    struct DispatchStatistics {
+        DispatchStatistics() : wakeups(0), scheduledRuns(0), turns(0),
+            rescheduledTurns(0), messages(0), lastTurnNs(0), maxTurnNs(0),
+            totalTurnNs(0) {}
+
+        quint64 wakeups;            ///< Calls to wakeup(), including those from libdbus
+        quint64 scheduledRuns;      ///< Dispatcher runs that the wakeups were coalesced into
+        quint64 turns;              ///< Turns that dispatched at least one message
+        quint64 rescheduledTurns;   ///< Turns that ran out of budget with messages left
+        quint64 messages;           ///< Messages dispatched in all turns
+        qint64  lastTurnNs;         ///< Duration of the latest turn
+        qint64  maxTurnNs;          ///< Duration of the longest turn
+        qint64  totalTurnNs;        ///< Duration of all turns, for the average
+    };
+
+    /**
+     * Traffic of one connection, see connectionStatistics().
+     */
+    struct ConnectionStatistics {
+        ConnectionStatistics() : messages(0), bytesRead(0), dispatchNs(0) {}
+
+        quint64 messages;           ///< Messages dispatched
+        quint64 bytesRead;          ///< Bytes waiting on the socket when it became readable
+        qint64  dispatchNs;         ///< Time spent dispatching its messages
+    };
+
     DBUSConnectionEventLoop();
     virtual ~DBUSConnectionEventLoop();
 
@@ -82,9 +126,72 @@ public:
     static bool addConnection(DBusConnection* conn);
     static void removeConnection(DBusConnection* conn);
 
+    /**
+     * Select the backend used for the connections added after this call.
+     * The backend can only be changed while there are no connections.
+     * \return true if the backend is now in use.
+     */
+    static bool setBackend(Backend backend);
+    static Backend backend();
+
+    /**
+     * Limit how much one dispatch turn may do before it yields to the
+     * rest of the Qt event loop and continues in a later turn. A burst of
+     * messages then cannot freeze the thread running the loop.
+     * \param maxMessages Messages per turn, 0 for no limit.
+     * \param maxMicroseconds Time per turn, 0 for no limit.
+     */
+    static void setDispatchBudget(int maxMessages, int maxMicroseconds);
+
+    /**
+     * \return the statistics of the dispatch turns so far.
+     */
+    static DispatchStatistics dispatchStatistics();
+
+    /**
+     * \return the statistics of one connection, all zero for a connection
+     * that has not been added.
+     */
+    static ConnectionStatistics connectionStatistics(DBusConnection* conn);
+
+    /**
+     * Reset the dispatch statistics and those of every connection.
+     */
+    static void resetDispatchStatistics();
+
+    /**
+     * Schedule a dispatch of all connections from the event loop, as
+     * libdbus does when it has queued messages. May be called from any
+     * thread. Wakeups that arrive before the dispatch runs share that run.
+     */
+    static void wakeup();
+
+    /**
+     * Run the socket I/O, timeouts and dispatch of all connections in a
+     * private thread with its own event loop, so that D-Bus traffic does
+     * not wait for the thread that uses the connections, nor delay it.
+     * Handlers of messages and pending calls are then called in that
+     * thread; Qt signals emitted from them reach their receivers through
+     * queued connections. The thread uses the epoll backend.
+     * Can only be changed while no connections are added, and only from
+     * the thread that owns the loop, normally the main thread.
+     * \return false if the mode could not be changed.
+     */
+    static bool setIoThreadEnabled(bool enabled);
+    static bool isIoThreadEnabled();
+
 private:
-    bool internalAddConnection(DBusConnection* conn);
-    void internalRemoveConnection(DBusConnection* conn);
+    Q_INVOKABLE bool internalAddConnection(DBusConnection* conn);
+    Q_INVOKABLE void internalRemoveConnection(DBusConnection* conn);
+    bool internalSetBackend(Backend backend);
+    bool internalSetIoThreadEnabled(bool enabled);
+    Q_INVOKABLE void leaveIoThread(QThread *target);
+
+    /**
+     * A connection, its statistics and the loop. This is the data of the
+     * watch, timeout and wakeup functions of the connection.
+     */
+    struct ConnectionInfo;
 
     /**
      * Helper class for dbus watcher
@@ -92,16 +199,32 @@ private:
     class Watcher
     {
     public:
-        Watcher() : watch(0), read(0), write(0) {}
+        Watcher() : watch(0), info(0), read(0), write(0) {}
 
         DBusWatch* 			watch;
+        ConnectionInfo*		info;
         QSocketNotifier*	read;
         QSocketNotifier*	write;
     };
 
+    /**
+     * The read and write watches of one socket in the epoll set
+     */
+    struct EpollWatch;
+
+    /**
+     * An armed DBusTimeout, and the queue of the armed timeouts that share
+     * its interval. A queue is in deadline order, since every timeout is
+     * appended with the current time plus the same interval.
+     */
+    struct TimeoutEntry;
+    struct TimeoutQueue;
+
     typedef QMultiHash<int, Watcher> 	Watchers;
-    typedef QHash<int, DBusTimeout*> 	Timeouts;
+    typedef QMap<int, TimeoutQueue*> 	Timeouts;
     typedef QList<DBusConnection*>		Connections;
+    typedef QHash<DBusConnection*, ConnectionInfo*>	ConnectionInfos;
+    typedef QHash<int, EpollWatch*>		EpollWatches;
 
     /**
      * DBusWatcher objects
@@ -109,19 +232,74 @@ private:
     Watchers 	watchers;
 
     /**
-     * DBusTimeout objects
+     * The private I/O thread, if enabled. When it is, libdbus may call the
+     * watch and timeout functions from any thread, so the epoll and
+     * timeout state below is guarded by stateMutex. It is never held while
+     * calling into libdbus, which has locks of its own.
+     */
+    QThread*        ioThread;
+    mutable QMutex  stateMutex;
+
+    /**
+     * DBusTimeout objects, queued by interval. One Qt timer is kept running
+     * for the earliest deadline of all the queues. Timeouts removed while
+     * expired ones are being handled are only freed afterwards.
      */
     Timeouts 	timeouts;
+    QBasicTimer timeoutTimer;
+    qint64      timeoutTimerDeadline;
+    QList<TimeoutEntry*>    retiredTimeouts;
+    bool        handlingTimeouts;
+
+    bool armTimeout(TimeoutEntry *entry, qint64 now);
+    void disarmTimeout(TimeoutEntry *entry);
+    void requestTimeoutTimer();
+    void startTimeoutTimer(qint64 now);
 
     /**
-     * DBusConnection objects
+     * DBusConnection objects, in the order they were added, and their info.
+     * Dispatch starts each turn after the connection served last. Infos of
+     * connections removed by a handler are freed when the turn is over.
      */
     Connections	connections;
+    ConnectionInfos connectionInfos;
+    int         nextConnection;
+    int         dispatchDepth;
+    QList<ConnectionInfo*>  retiredConnections;
+
+    void countBytesRead(ConnectionInfo *info, int fd);
+
+    /**
+     * Epoll backend state. Watches removed while events are being handled
+     * are only freed afterwards, since pending events may still point to them.
+     */
+    Backend         activeBackend;
+    int             epollFd;
+    QSocketNotifier*    epollNotifier;
+    EpollWatches    epollWatches;
+    QList<EpollWatch*>  retiredEpollWatches;
+    bool            handlingEpollEvents;
+
+    void updateEpollWatch(EpollWatch *epollWatch);
+
+    /**
+     * Dispatch budget and statistics
+     */
+    int                 budgetMessages;
+    int                 budgetMicroseconds;
+    QAtomicInt          dispatchPending;
+    QAtomicInt          wakeupCount;
+    DispatchStatistics  statistics;
+
+    void scheduleDispatch();
 
 private Q_SLOTS:
     void readSocket(int fd);
     void writeSocket(int fd);
+    void handleEpollEvents();
     void dispatch();
+    void dispatchScheduled();
+    void restartTimeoutTimer();
 
 protected:
     void timerEvent(QTimerEvent *e);
@@ -130,6 +308,9 @@ protected:
     static dbus_bool_t addWatch(DBusWatch *watch, void *data);
     static void removeWatch(DBusWatch *watch, void *data);
     static void toggleWatch(DBusWatch *watch, void *data);
+    static dbus_bool_t addEpollWatch(DBusWatch *watch, void *data);
+    static void removeEpollWatch(DBusWatch *watch, void *data);
+    static void toggleEpollWatch(DBusWatch *watch, void *data);
     static dbus_bool_t addTimeout(DBusTimeout *timeout, void *data);
     static void removeTimeout(DBusTimeout *timeout, void *data);
     static void toggleTimeout(DBusTimeout *timeout, void *data);
@@ -35,6 +35,7 @@ HEADERS    += dbusconnectioneventloop.h
 QT          = core
 CONFIG     += qt link_pkgconfig dll
 PKGCONFIG  += dbus-1
+LIBS       += -lrt
 DEFINES    += QT_NO_DEBUG_OUTPUT QT_NO_WARNING_OUTPUT QT_NO_DEBUG_STREAM
 
 # Install directives
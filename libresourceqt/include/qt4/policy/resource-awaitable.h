@@ -0,0 +1,170 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+/**
+* \file resource-awaitable.h
+* \brief C++20 coroutine support for ResourcePolicy::ResourceRequestFuture
+*
+* \copyright Copyright (C) 2011 Nokia Corporation.
+* \par License
+* @license LGPL
+* This file is part of libresourceqt
+* \par
+* Copyright (C) 2011 Nokia Corporation.
+* \par
+* This library is free software; you can redistribute
+* it and/or modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation
+* version 2.1 of the License.
+* \par
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* \par
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+* USA.
+*/
+
+#ifndef RESOURCE_AWAITABLE_H
+#define RESOURCE_AWAITABLE_H
+
+// The library itself is C++98. This header only adds inline code for
+// applications built with C++20 coroutines, and is empty otherwise.
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <policy/resource-request-future.h>
+
+namespace ResourcePolicy
+{
+
+/**
+* The error a co_await on a \ref ResourceRequestFuture throws when the
+* request did not succeed: it was denied, timed out, failed, or was
+* cancelled, for example because the manager took the resources away.
+*/
+class ResourceRequestError: public std::exception
+{
+public:
+	explicit ResourceRequestError(ResourceRequestFuture::Result result) : res(result) {}
+
+	/**
+	* Returns how the request ended.
+	*/
+	ResourceRequestFuture::Result result() const noexcept { return res; }
+
+	const char *what() const noexcept override
+	{
+		switch (res) {
+		case ResourceRequestFuture::Denied:   return "resource request denied";
+		case ResourceRequestFuture::TimedOut: return "resource request timed out";
+		case ResourceRequestFuture::Failed:   return "resource request failed";
+		default:                              return "resource request cancelled";
+		}
+	}
+
+private:
+	ResourceRequestFuture::Result res;
+};
+
+/**
+* Awaits a \ref ResourceRequestFuture in a coroutine:
+* \code
+* ResourcePolicy::ResourceTypeMask optional = co_await mySet->acquireAsync();
+* startPipeline(optional.contains(ResourcePolicy::VideoPlaybackType));
+* \endcode
+* The result is the set of optional resources granted, see
+* \ref ResourceRequestFuture::grantedOptionalResources(), and a request that
+* does not succeed throws \ref ResourceRequestError.
+*
+* The coroutine is resumed directly by the reply handling of the set, in
+* the same turn of the event loop that delivered the answer, and before the
+* set sends its next queued request. Requests it makes from there are
+* queued behind the answered one. A request that is already answered when
+* it is awaited does not suspend the coroutine at all. Await only on the
+* thread the set belongs to.
+*
+* The coroutine may delete the set once it is resumed. A coroutine still
+* waiting when the set is deleted is resumed from the event loop afterwards,
+* and its request throws as cancelled.
+*/
+class ResourceRequestAwaiter
+{
+public:
+	explicit ResourceRequestAwaiter(const ResourceRequestFuture &future)
+		: future(future), registered(false) {}
+	ResourceRequestAwaiter(const ResourceRequestAwaiter &) = delete;
+	ResourceRequestAwaiter &operator=(const ResourceRequestAwaiter &) = delete;
+
+	// A coroutine destroyed while it waits must not be resumed any more.
+	~ResourceRequestAwaiter()
+	{
+		if (registered)
+			future.removeOnFinished(&resume, this);
+	}
+
+	bool await_ready() const noexcept
+	{
+		return future.isFinished();
+	}
+
+	bool await_suspend(std::coroutine_handle<> coroutine)
+	{
+		handle = coroutine;
+		registered = true;
+		bool suspended = future.onFinished(&resume, this);
+		if (!suspended)
+			registered = false;
+		return suspended;
+	}
+
+	ResourceTypeMask await_resume() const
+	{
+		if (!future.succeeded())
+			throw ResourceRequestError(future.result());
+		return future.grantedOptionalResources();
+	}
+
+private:
+	static void resume(void *context)
+	{
+		ResourceRequestAwaiter *awaiter = static_cast<ResourceRequestAwaiter *>(context);
+		awaiter->registered = false;
+		awaiter->handle.resume();
+	}
+
+	ResourceRequestFuture future;
+	std::coroutine_handle<> handle;
+	bool registered;
+};
+
+inline ResourceRequestAwaiter operator co_await(const ResourceRequestFuture &future)
+{
+	return ResourceRequestAwaiter(future);
+}
+}
+
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+/**
+* \file resource-latency-histogram.h
+* \brief Declaration of ResourcePolicy::LatencyHistogram
+*
+* \copyright Copyright (C) 2011 Nokia Corporation.
+* \par License
+* @license LGPL
+* This file is part of libresourceqt
+* \par
+* Copyright (C) 2011 Nokia Corporation.
+* \par
+* This library is free software; you can redistribute
+* it and/or modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation
+* version 2.1 of the License.
+* \par
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* \par
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+* USA.
+*/
+
+#ifndef RESOURCE_LATENCY_HISTOGRAM_H
+#define RESOURCE_LATENCY_HISTOGRAM_H
+
+#include <QtGlobal>
+#include <QMetaType>
+
+namespace ResourcePolicy
+{
+
+/**
+* The kinds of requests a \ref ResourceSet sends to the policy manager.
+*/
+enum ResourceRequest {
+	AcquireRequest = 0, ///< \ref ResourceSet::acquire()
+	ReleaseRequest,     ///< \ref ResourceSet::release()
+	UpdateRequest,      ///< \ref ResourceSet::update()
+	NumberOfRequests
+};
+
+/**
+* The points at which the round trip of a request is timed. Both are
+* measured from the moment the request was handed to the connection.
+*/
+enum LatencyStage {
+	/// The manager acknowledged the request with a status message.
+	StatusReplyStage = 0,
+	/// The manager answered the request: resources were granted, denied or
+	/// released, the update was confirmed, or the request failed.
+	FinalReplyStage,
+	NumberOfLatencyStages
+};
+
+/**
+* A LatencyHistogram counts nanosecond latencies in log-linear buckets:
+* every power of two is split into eight equal sub-buckets, so any
+* recorded value is known to within 12.5%. Values of 2^40 ns (about 18
+* minutes) and more are counted in the last bucket.
+*
+* Recording is a few instructions and never allocates, so histograms can be
+* kept on always, also in production. \ref percentile() reports the upper
+* bound of the bucket the percentile falls in.
+* \code
+* ResourcePolicy::LatencyHistogram h =
+*     resourceSet->latencyHistogram(ResourcePolicy::AcquireRequest,
+*                                   ResourcePolicy::FinalReplyStage);
+* qDebug("acquire p50 %lld ns p99 %lld ns", h.percentile(50), h.percentile(99));
+* \endcode
+*/
+class LatencyHistogram
+{
+public:
+	enum {
+		SubBucketBits = 3,
+		SubBucketCount = 1 << SubBucketBits,
+		MaxValueBits = 40,
+		BucketCount = (MaxValueBits - SubBucketBits + 1) * SubBucketCount
+	};
+
+	/**
+	* Creates an empty histogram.
+	*/
+	LatencyHistogram();
+
+	/**
+	* Counts one latency. Negative values are counted as 0.
+	* \param nanoseconds The latency to count.
+	*/
+	void record(qint64 nanoseconds);
+
+	/**
+	* Adds the counts of another histogram to this one.
+	*/
+	void add(const LatencyHistogram &other);
+
+	/**
+	* Empties the histogram.
+	*/
+	void reset();
+
+	/**
+	* Returns the number of latencies counted.
+	*/
+	quint64 count() const;
+
+	/**
+	* Returns the smallest latency counted, or 0 if the histogram is empty.
+	*/
+	qint64 minimum() const;
+
+	/**
+	* Returns the largest latency counted, or 0 if the histogram is empty.
+	*/
+	qint64 maximum() const;
+
+	/**
+	* Returns the mean of the latencies counted, or 0 if the histogram is empty.
+	*/
+	qint64 mean() const;
+
+	/**
+	* Returns the latency below or at which the given percentage of the
+	* counted latencies lie, e.g. 99.9 for p999.
+	* \param percent A value from 0 to 100.
+	* \return The upper bound of the bucket, at most \ref maximum(), or 0 if
+	* the histogram is empty.
+	*/
+	qint64 percentile(double percent) const;
+
+	/**
+	* Returns the bucket a latency is counted in.
+	*/
+	static int bucketOf(qint64 nanoseconds);
+
+	/**
+	* Returns the largest latency counted in the given bucket.
+	*/
+	static qint64 bucketUpperBound(int bucket);
+
+private:
+	quint32 counts[BucketCount];
+	quint64 total;
+	qint64 sum;
+	qint64 min;
+	qint64 max;
+};
+}
+
+Q_DECLARE_METATYPE(ResourcePolicy::ResourceRequest)
+
+#endif
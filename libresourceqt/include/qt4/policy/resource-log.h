@@ -0,0 +1,117 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+/**
+* \file resource-log.h
+* \brief Declaration of ResourcePolicy::ResourceLog
+*
+* \copyright Copyright (C) 2011 Nokia Corporation.
+* \par License
+* @license LGPL
+* This file is part of libresourceqt
+* \par
+* Copyright (C) 2011 Nokia Corporation.
+* \par
+* This library is free software; you can redistribute
+* it and/or modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation
+* version 2.1 of the License.
+* \par
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* \par
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+* USA.
+*/
+
+#ifndef RESOURCE_LOG_H
+#define RESOURCE_LOG_H
+
+#include <QStringList>
+
+namespace ResourcePolicy
+{
+
+/**
+* ResourceLog selects where the debug logging of libresourceqt goes.
+*
+* By default nothing is logged. Setting the environment variable DEBUG before
+* the first \ref ResourceSet is created turns on \ref Console logging, or
+* \ref Ring logging if its value is "ring".
+*
+* In \ref Ring mode a log message costs no more than copying its format
+* string pointer and arguments into a ring buffer owned by the calling
+* thread. Neither locks nor formatting are involved, so the timing of the
+* request state machine is hardly disturbed. The most recent messages of
+* every thread are formatted only when \ref records() is called, e.g. after
+* a failure.
+*
+* When the library is built with CONFIG+=resourceqt_no_logs, the log
+* messages are compiled out and this class has no effect.
+* \code
+* ResourcePolicy::ResourceLog::setMode(ResourcePolicy::ResourceLog::Ring);
+* ...
+* foreach (const QString &line, ResourcePolicy::ResourceLog::records())
+*     fprintf(stderr, "%s\n", qPrintable(line));
+* \endcode
+*/
+class ResourceLog
+{
+public:
+	enum Mode {
+		Off = 0, ///< Log messages are dropped.
+		Console, ///< Log messages are written with qDebug() as they happen.
+		Ring     ///< Log messages are kept in per-thread ring buffers.
+	};
+
+	/**
+	* Number of the most recent messages kept per thread in \ref Ring mode.
+	*/
+	enum { RingSize = 256 };
+
+	/**
+	* Selects where log messages go.
+	*/
+	static void setMode(Mode mode);
+
+	/**
+	* Returns where log messages go.
+	*/
+	static Mode mode();
+
+	/**
+	* Formats the messages kept in the ring buffers of all threads.
+	* \return One line per message, oldest first, each prefixed with the
+	* monotonic time in seconds and the id of the logging thread.
+	*/
+	static QStringList records();
+
+	/**
+	* Empties the ring buffers of all threads.
+	*/
+	static void clear();
+};
+}
+
+#endif
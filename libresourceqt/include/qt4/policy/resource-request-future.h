@@ -0,0 +1,214 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+/**
+* \file resource-request-future.h
+* \brief Declaration of ResourcePolicy::ResourceRequestFuture
+*
+* \copyright Copyright (C) 2011 Nokia Corporation.
+* \par License
+* @license LGPL
+* This file is part of libresourceqt
+* \par
+* Copyright (C) 2011 Nokia Corporation.
+* \par
+* This library is free software; you can redistribute
+* it and/or modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation
+* version 2.1 of the License.
+* \par
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* \par
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+* USA.
+*/
+
+#ifndef RESOURCE_REQUEST_FUTURE_H
+#define RESOURCE_REQUEST_FUTURE_H
+
+#include <QObject>
+#include <QList>
+#include <QMetaType>
+#include <QExplicitlySharedDataPointer>
+#include <policy/resource.h>
+#include <policy/resource-latency-histogram.h>
+
+namespace ResourcePolicy
+{
+
+class ResourceSet;
+
+/**
+* A ResourceRequestFuture is the outcome of one acquire, release or update
+* request of a \ref ResourceSet, as returned by \ref ResourceSet::acquireAsync(),
+* \ref ResourceSet::releaseAsync() and \ref ResourceSet::updateAsync(). It is
+* finished when the policy manager answers that very request, so the caller
+* need not tell the answers to several requests apart from the signals of
+* the set.
+*
+* A future is a small handle; copies refer to the same request. Instead of
+* waiting for it, register a continuation with \ref then(), or combine the
+* futures of several sets with \ref whenAll().
+* \code
+* ResourcePolicy::ResourceRequestFuture all = ResourcePolicy::ResourceRequestFuture::whenAll(
+*         QList<ResourcePolicy::ResourceRequestFuture>() << playerSet->acquireAsync()
+*                                                        << recorderSet->acquireAsync());
+* all.then(this, SLOT(switchDone(ResourcePolicy::ResourceRequestFuture)));
+* \endcode
+*/
+class ResourceRequestFuture
+{
+public:
+	/**
+	* How a request ended.
+	*/
+	enum Result {
+		Pending = 0, ///< Not answered yet.
+		Succeeded,   ///< Granted, released or updated.
+		Denied,      ///< The manager denied the acquire.
+		TimedOut,    ///< The deadline of the request passed, see \ref ResourceSet::acquire(int).
+		Failed,      ///< The request could not be sent, or the manager answered with an error.
+		Canceled     ///< The request was dropped before it was answered, see below.
+	};
+
+	/**
+	* Constructs a null future, which is finished and \ref Canceled.
+	*/
+	ResourceRequestFuture();
+	ResourceRequestFuture(const ResourceRequestFuture &other);
+	~ResourceRequestFuture();
+	ResourceRequestFuture &operator=(const ResourceRequestFuture &other);
+
+	/**
+	* Two futures are equal when they refer to the same request. Requests
+	* that a set merges into one queued request share its future.
+	*/
+	bool operator==(const ResourceRequestFuture &other) const;
+	bool operator!=(const ResourceRequestFuture &other) const;
+
+	/**
+	* Returns false for a null future.
+	*/
+	bool isValid() const;
+
+	/**
+	* Returns true once \ref result() is no longer \ref Pending.
+	*/
+	bool isFinished() const;
+
+	/**
+	* Returns how the request ended. A request is \ref Canceled when the
+	* manager takes the resources of the set away while it waits, when a
+	* later request makes it moot, or when the set is deleted.
+	*/
+	Result result() const;
+
+	/**
+	* Returns true if the request \ref Succeeded.
+	*/
+	bool succeeded() const;
+
+	/**
+	* Returns the kind of request, or \ref NumberOfRequests for a future made
+	* by \ref whenAll().
+	*/
+	ResourceRequest request() const;
+
+	/**
+	* Returns the number the request was sent to the policy manager with, or
+	* 0 while it waits in the queue of the set.
+	*/
+	quint32 requestNumber() const;
+
+	/**
+	* Returns the optional resources granted by a successful acquire or
+	* update, as in \ref ResourceSet::resourcesGrantedMask(). Empty for other
+	* requests and until the future is finished.
+	*/
+	ResourceTypeMask grantedOptionalResources() const;
+
+	/**
+	* Calls a slot of receiver once the future is finished. The call is
+	* queued to the event loop of the receiver, also when the future is
+	* already finished, so the slot never runs from inside a call to the
+	* set. The slot may take the future as a
+	* ResourcePolicy::ResourceRequestFuture argument.
+	* \param receiver The object to call the slot of. Nothing is called if
+	* it is deleted first.
+	* \param member The slot, as given by the SLOT() macro.
+	*/
+	void then(QObject *receiver, const char *member) const;
+
+	/**
+	* Returns a future that is finished when all of futures are. It
+	* \ref Succeeded if they all did, otherwise its result is that of the
+	* first of futures that did not succeed. The future of an empty list
+	* is finished right away.
+	*/
+	static ResourceRequestFuture whenAll(const QList<ResourceRequestFuture> &futures);
+
+	/**
+	* A function called by \ref onFinished().
+	*/
+	typedef void (*Callback)(void *context);
+
+	/**
+	* Calls callback(context) directly when the future is finished, on the
+	* thread that finishes it and in the middle of the reply handling of the
+	* set. This is the hook for adapters such as resource-awaitable.h; most
+	* code wants \ref then() instead.
+	* \return false, and registers nothing, if the future is already finished.
+	*/
+	bool onFinished(Callback callback, void *context) const;
+
+	/**
+	* Unregisters a callback registered with \ref onFinished() that has not
+	* been called yet.
+	*/
+	void removeOnFinished(Callback callback, void *context) const;
+
+private:
+	class Data;
+
+	explicit ResourceRequestFuture(ResourceRequest request);
+	explicit ResourceRequestFuture(Data *data);
+
+	void setRequestNumber(quint32 requestNumber);
+	// With queueCallbacks, the callbacks of onFinished() are called from the
+	// event loop instead, for a set that finishes its futures while it is
+	// being destroyed.
+	void finish(Result result, const ResourceTypeMask &granted = ResourceTypeMask(),
+	            bool queueCallbacks = false);
+	static void partFinished(Data *all, int index, Result result, bool queueCallbacks);
+
+	QExplicitlySharedDataPointer<Data> d;
+
+	friend class ResourceSet;
+};
+}
+
+Q_DECLARE_METATYPE(ResourcePolicy::ResourceRequestFuture)
+
+#endif
@@ -0,0 +1,165 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+/**
+* \file resource-set-batch.h
+* \brief Declaration of ResourcePolicy::ResourceSetBatch
+*
+* \copyright Copyright (C) 2011 Nokia Corporation.
+* \par License
+* @license LGPL
+* This file is part of libresourceqt
+* \par
+* Copyright (C) 2011 Nokia Corporation.
+* \par
+* This library is free software; you can redistribute
+* it and/or modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation
+* version 2.1 of the License.
+* \par
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+* \par
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+* USA.
+*/
+
+#ifndef RESOURCE_SET_BATCH_H
+#define RESOURCE_SET_BATCH_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <policy/resource-set.h>
+#include <policy/resource-request-future.h>
+
+namespace ResourcePolicy
+{
+
+/**
+* A ResourceSetBatch issues the same request to many \ref ResourceSet objects
+* at once, for example when a session manager switches applications. The
+* requests of all sets are queued and sent back-to-back on the shared
+* connection to the policy manager, instead of one send per set each
+* contending for the connection.
+*
+* Each set still emits its own resourcesGranted(), resourcesDenied(),
+* resourcesReleased() and updateOK() signals. In addition, the batch emits
+* \ref finished() once the request of every set is done with, see
+* \ref ResourceRequestFuture: answered, timed out, failed, or cancelled, and
+* also when the set merged it into another request or did not have to send
+* it at all.
+*
+* The batch does not own the sets. A set that is destroyed is removed from
+* the batch automatically.
+* \code
+* ResourcePolicy::ResourceSetBatch batch;
+* batch.addResourceSet(playerSet);
+* batch.addResourceSet(recorderSet);
+* QObject::connect(&batch, SIGNAL(finished()), this, SLOT(switchDone()));
+* batch.acquire();
+* \endcode
+*/
+class ResourceSetBatch: public QObject
+{
+	Q_OBJECT
+	Q_DISABLE_COPY(ResourceSetBatch)
+
+public:
+	/**
+	* The constructor.
+	* \param parent The optional parent of this class.
+	*/
+	ResourceSetBatch(QObject *parent = NULL);
+
+	/**
+	* The destructor.
+	*/
+	~ResourceSetBatch();
+
+	/**
+	* Adds a set to the batch. Adding the same set twice has no effect.
+	* \param resourceSet The set to add. The batch does not take ownership.
+	*/
+	void addResourceSet(ResourceSet *resourceSet);
+
+	/**
+	* Removes a set from the batch.
+	* \param resourceSet The set to remove.
+	*/
+	void removeResourceSet(ResourceSet *resourceSet);
+
+	/**
+	* Returns the sets in the batch, in the order they were added.
+	*/
+	QList<ResourceSet *> resourceSets() const;
+
+	/**
+	* Calls \ref ResourceSet::acquire() on every set in the batch.
+	* \return false if any of the requests could not be sent.
+	*/
+	bool acquire();
+
+	/**
+	* Calls \ref ResourceSet::release() on every set in the batch.
+	* \return false if any of the requests could not be sent.
+	*/
+	bool release();
+
+	/**
+	* Calls \ref ResourceSet::update() on every set in the batch.
+	* \return false if any of the requests could not be sent.
+	*/
+	bool update();
+
+	/**
+	* Checks whether some set has not yet answered the last request.
+	* \return true until \ref finished() has been emitted.
+	*/
+	bool isPending() const;
+
+signals:
+	/**
+	* This signal is emitted from the event loop when the last acquire(),
+	* release() or update() request of every set in the batch is done with.
+	*/
+	void finished();
+
+private:
+	enum requestType { Acquire=0, Update, Release };
+
+	bool request(requestType theRequest);
+	void setAnswered(ResourceSet *resourceSet);
+
+	QList<ResourceSet *> sets;
+	// The request of each set that is not done with yet.
+	QHash<ResourceSet *, ResourceRequestFuture> awaitingReply;
+
+private slots:
+	void handleRequestFinished(ResourcePolicy::ResourceRequestFuture future);
+	void handleSetDestroyed(QObject *object);
+};
+}
+
+#endif
@@ -53,7 +53,10 @@ USA.
 #include <QObject>
 #include <QVector>
 #include <QList>
+#include <QMutex>
 #include <policy/resources.h>
+#include <policy/resource-latency-histogram.h>
+#include <policy/resource-request-future.h>
 #include <policy/audio-resource.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -155,6 +158,7 @@ class ResourceSet: public QObject
 {
 	Q_OBJECT
 	Q_DISABLE_COPY(ResourceSet)
+	friend class ResourceEngine;
 
 public:
 	/**
@@ -285,6 +289,67 @@ public:
 	*/
 	bool update();
 
+	/**
+        * Like \ref acquire(), but gives up if the policy manager has not answered within
+        * timeoutMs milliseconds of sending the request, and emits \ref requestTimedOut().
+        * A request that waits for the connection to the manager keeps its timeout, which
+        * runs from when it is sent once the set is connected.
+	* \param timeoutMs The deadline in milliseconds, or 0 for none.
+	*/
+	bool acquire(int timeoutMs);
+
+	/**
+        * Like \ref release(), with a deadline as for \ref acquire(int). If the set is not
+        * connected there is nothing to release, and an acquire waiting for the connection
+        * is dropped.
+	*/
+	bool release(int timeoutMs);
+
+	/**
+        * Like \ref update(), with a deadline as for \ref acquire(int).
+	*/
+	bool update(int timeoutMs);
+
+	/**
+        * Like \ref acquire(int), but returns a future that is finished with the answer of the
+        * policy manager to this very request. The signals of the set are emitted as usual.
+        * An acquire made before the set is connected is sent once it is.
+	* \param timeoutMs The deadline in milliseconds, or 0 for none.
+	*/
+	ResourceRequestFuture acquireAsync(int timeoutMs = 0);
+
+	/**
+        * Like \ref release(int), returning a future as \ref acquireAsync() does. If the set
+        * is not connected there is nothing to release, and the future has already succeeded.
+	*/
+	ResourceRequestFuture releaseAsync(int timeoutMs = 0);
+
+	/**
+        * Like \ref update(int), returning a future as \ref acquireAsync() does. An update made
+        * before the set is connected succeeds when the set registers, as the registration
+        * carries the resources.
+	*/
+	ResourceRequestFuture updateAsync(int timeoutMs = 0);
+
+	/**
+        * Acquires the resources from a thread other than the one the set belongs to, such as
+        * a worker thread with no event loop of its own. The request is posted to the thread
+        * of the set, which must be running its event loop, and the caller sleeps until the
+        * policy manager answers it. Several threads may call this at once.
+        *
+        * If there is no answer within timeoutMs of the call, the result is
+        * \ref ResourceRequestFuture::TimedOut, and resources granted after that are released
+        * again. Called on the thread of the set, which would then wait for itself, it fails.
+	* \param timeoutMs The longest wait in milliseconds, or 0 for none.
+	* \return How the request ended.
+	*/
+	ResourceRequestFuture::Result acquireBlocking(int timeoutMs = 0);
+
+	/**
+        * Releases the resources, blocking the calling thread as \ref acquireBlocking() does.
+	*/
+	ResourceRequestFuture::Result releaseBlocking(int timeoutMs = 0);
+
 	/**
 	* Sets the auto-release. When loosing the resources due to another
         * application with a higher priority preempting us, the default is that we automatically
@@ -320,6 +385,72 @@ public:
 	*/
 	bool alwaysGetReply();
 
+	/**
+        * Enables pipelined requests. By default a request made with \ref acquire(), \ref update()
+        * or \ref release() is held back until the policy manager has answered the previous one, so
+        * e.g. update() followed by acquire() costs two round trips. In pipelined mode every request
+        * is sent right away and the replies are matched to their requests as they arrive. The
+        * replies, and thus the signals, still come in the order the requests were made.
+        *
+        * This flag should be set once only before calling anything else
+        * (excluding setAlwaysReply() and setAutoRelease()), and cannot be unset.
+	*/
+	bool setPipelined();
+
+	/**
+        * Checks whether pipelined requests have been enabled with \ref setPipelined().
+	* \return true if requests are sent without waiting for earlier replies.
+	*/
+	bool isPipelined();
+
+	/**
+        * Enables request coalescing. Requests that are still waiting in the queue behind an
+        * unanswered request are folded into the shortest sequence with the same end result:
+        * consecutive updates become one, an acquire followed by a release (or a release followed
+        * by an acquire) cancels out, and a repeated acquire or release is dropped. A UI that flaps
+        * between play and pause thus only sends the final state. Requests that are dropped this
+        * way do not produce any signals. Has no effect on pipelined sets (see \ref setPipelined()),
+        * since they never hold requests back.
+        *
+        * This flag should be set once only before calling anything else
+        * (excluding setAlwaysReply() and setAutoRelease()), and cannot be unset.
+	*/
+	bool setRequestCoalescing();
+
+	/**
+        * Checks whether request coalescing has been enabled with \ref setRequestCoalescing().
+	* \return true if queued requests are coalesced.
+	*/
+	bool willCoalesceRequests();
+
+	/**
+        * Returns how many requests were never sent to the policy manager thanks to
+        * request coalescing.
+	*/
+	quint32 coalescedRequests() const;
+
+	/**
+        * Returns the round trip latencies of the requests this set has sent to the policy
+        * manager, from sending the request to the given stage of its answer. Requests that
+        * were coalesced away or never answered are not counted.
+	* \param request The kind of request.
+	* \param stage The stage of the answer.
+	* \return A copy of the histogram, safe to read while new answers arrive.
+	*/
+	LatencyHistogram latencyHistogram(ResourceRequest request, LatencyStage stage) const;
+
+	/**
+        * Empties all latency histograms of this set, e.g. after they have been reported.
+	*/
+	void resetLatencyHistograms();
+
+	/**
+        * Returns how many requests of this set have been sent to the policy manager and
+        * not answered yet. At most the last 64 requests are tracked; older ones that are
+        * still unanswered are taken to be lost.
+	*/
+	int outstandingRequests() const;
+
 	/**
         * ref\ hasResourcesGranted() returns true if this set has any granted resources.
 	*/
@@ -334,6 +465,14 @@ signals:
 	*/
 	void resourcesBecameAvailable(const QList<ResourcePolicy::ResourceType> &availableResources);
 
+	/**
+        * Same as \ref resourcesBecameAvailable(), but carries the resources as a
+        * \ref ResourceTypeMask, which unlike the list needs no allocation on direct connections.
+        * Queued connections still copy it onto the heap, as they do every argument.
+        * \param availableResources The available resources.
+	*/
+	void resourcesBecameAvailableMask(ResourcePolicy::ResourceTypeMask availableResources);
+
 	/**
         * This signal is emitted as a response to the acquire() request (also for the update() request
         * when already granted and updating a modified resource set). Thus, this signal informs  of currently
@@ -344,6 +483,14 @@ signals:
 	*/
 	void resourcesGranted(const QList<ResourcePolicy::ResourceType> &grantedOptionalResources);
 
+	/**
+        * Same as \ref resourcesGranted(), but carries the granted optional resources as a
+        * \ref ResourceTypeMask, which unlike the list needs no allocation on direct connections.
+        * Queued connections still copy it onto the heap, as they do every argument.
+        * \param grantedOptionalResources The granted optional resources.
+	*/
+	void resourcesGrantedMask(ResourcePolicy::ResourceTypeMask grantedOptionalResources);
+
 	/**
         * This signal is emitted as a response to the update() request if the application did not have
         * resources granted while updating. Note that a reply to an update() request may also be
@@ -398,9 +545,26 @@ signals:
         */
 	void managerIsUp();
 
+	/**
+        * This signal is emitted when the policy manager did not answer a request made with a
+        * deadline in time. The request is abandoned and the next queued request is sent. A late
+        * answer is ignored; resources a late answer grants to an acquire are released again,
+        * unless the set has acquired or released since.
+	* \param request The kind of request that timed out.
+	*/
+	void requestTimedOut(ResourcePolicy::ResourceRequest request);
+
+protected:
+	bool event(QEvent *event);
+#if QT_VERSION >= 0x050000
+	void connectNotify(const QMetaMethod &signal);
+#else
+	void connectNotify(const char *signal);
+#endif
 
 private:
         enum requestType { Acquire=0, Update, Release } ;
+        friend class ResourceSetPrivate;
 
 	quint32 identifier;
 	const QString resourceClass;
@@ -417,6 +581,8 @@ private:
 	bool pendingVideoProperties;
 	bool haveAudioProperties;
         bool inAcquireMode;
+        // Unused, the request queue is in ResourceSetPrivate. Kept for the
+        // layout of the class.
         QList<requestType> requestQ;
         QMutex reqMutex;
         bool ignoreQ;
@@ -424,18 +590,39 @@ private:
         bool initialize();
 	void registerAudioProperties();
 	void registerVideoProperties();
-	bool proceedIfImFirst( requestType theRequest );
-	void executeNextRequest();
+	void sendAudioProperties();
+	void sendVideoProperties();
+	bool proceedIfImFirst( requestType theRequest, int timeoutMs = 0 );
+	bool coalesceRequest( requestType theRequest, int timeoutMs, ResourceRequestFuture *future );
+	int findRequest(quint32 requestNo) const;
+	void executeNextRequest(quint32 answeredRequestNo);
+	void sendHeldRequests();
+	ResourceRequestFuture requestAsync(requestType theRequest, int timeoutMs);
+	ResourceRequestFuture::Result requestBlocking(ResourceRequest request, int timeoutMs);
+	static void blockingRequestAnswered(void *context);
+	ResourceRequestFuture *takeRequestFuture();
+	bool sendRequest( requestType theRequest, int timeoutMs );
+	bool finishRequest(quint32 requestNo, ResourceRequestFuture::Result result,
+	                   const ResourceTypeMask &granted = ResourceTypeMask());
+	bool cancelRequests();
+	// The libresource bitmasks of all and of the optional resources in the
+	// set, for the engine.
+	quint32 allResourcesMask() const;
+	quint32 optionalResourcesMask() const;
+	void recordLatency(ResourceRequest request, LatencyStage stage, qint64 nanoseconds);
 
 private slots:
 	void connectedHandler();
-	void handleGranted(quint32);
-	void handleDeny();
-	void handleReleased();
+	void handleGranted(quint32, quint32);
+	void handleDeny(quint32);
+	void handleReleased(quint32);
 	void handleReleasedByManager();
 	void handleResourcesLost(quint32);
 	void handleResourcesBecameAvailable(quint32);
-        void handleUpdateOK(bool resend);
+        void handleUpdateOK(bool resend, quint32 requestNo);
+	void handleRequestTimedOut(ResourcePolicy::ResourceRequest request, quint32 requestNo);
+	void handleRequestFailed(ResourcePolicy::ResourceRequest request, quint32 requestNo);
+	void handleError(quint32 code, const QByteArray &message);
 	void handleAudioPropertiesChanged(const QString &group, quint32 pid, const QString &name, const QString &value);
 	void handleVideoPropertiesChanged(quint32 pid);
 
@@ -76,6 +76,119 @@ enum ResourceType {
 	NumberOfTypes
 };
 
+/**
+* A set of \ref ResourceType values packed into a single 32-bit word, with
+* the bit (1 << type) set for each type in it. It is a plain value: copying
+* it never allocates. A queued signal still copies it onto the heap, as it
+* does every argument. Iterating over it visits the types in ascending
+* order:
+* \code
+* foreach (ResourcePolicy::ResourceType type, mask) { ... }
+* \endcode
+* or with \ref begin() and \ref end().
+*/
+class ResourceTypeMask
+{
+public:
+	/**
+	* Iterates over the types in a mask, lowest first.
+	*/
+	class const_iterator
+	{
+	public:
+		const_iterator() : remaining(0) {}
+		explicit const_iterator(quint32 bits) : remaining(bits) {}
+		ResourceType operator*() const {
+			int type = 0;
+			while ((remaining & (1u << type)) == 0)
+				type++;
+			return (ResourceType)type;
+		}
+		const_iterator &operator++() { remaining &= remaining - 1; return *this; }
+		const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+		bool operator==(const const_iterator &other) const { return remaining == other.remaining; }
+		bool operator!=(const const_iterator &other) const { return remaining != other.remaining; }
+	private:
+		quint32 remaining;
+	};
+	typedef const_iterator iterator;
+
+	/**
+	* Constructs an empty mask.
+	*/
+	ResourceTypeMask() : bits(0) {}
+
+	/**
+	* Constructs a mask from its raw bits, see \ref toUInt().
+	*/
+	explicit ResourceTypeMask(quint32 rawBits) : bits(rawBits) {}
+
+	/**
+	* Constructs a mask from a list of types.
+	*/
+	explicit ResourceTypeMask(const QList<ResourceType> &types) : bits(0) {
+		for (int i = 0; i < types.size(); i++)
+			insert(types.at(i));
+	}
+
+	/**
+	* \return true if the type is in the mask.
+	*/
+	bool contains(ResourceType type) const { return (bits & bit(type)) != 0; }
+
+	/**
+	* Adds a type to the mask.
+	*/
+	void insert(ResourceType type) { bits |= bit(type); }
+
+	/**
+	* Removes a type from the mask.
+	*/
+	void remove(ResourceType type) { bits &= ~bit(type); }
+
+	/**
+	* \return true if the mask contains no types.
+	*/
+	bool isEmpty() const { return bits == 0; }
+
+	/**
+	* \return the number of types in the mask.
+	*/
+	int count() const {
+		int types = 0;
+		for (quint32 rest = bits; rest != 0; rest &= rest - 1)
+			types++;
+		return types;
+	}
+
+	/**
+	* \return the raw bits of the mask, (1 << type) for each type in it.
+	*/
+	quint32 toUInt() const { return bits; }
+
+	/**
+	* \return the types in the mask as a list, in ascending order.
+	*/
+	QList<ResourceType> toList() const {
+		QList<ResourceType> types;
+		for (const_iterator it = begin(); it != end(); ++it)
+			types.append(*it);
+		return types;
+	}
+
+	const_iterator begin() const { return const_iterator(bits); }
+	const_iterator end() const { return const_iterator(); }
+	const_iterator constBegin() const { return begin(); }
+	const_iterator constEnd() const { return end(); }
+
+	bool operator==(const ResourceTypeMask &other) const { return bits == other.bits; }
+	bool operator!=(const ResourceTypeMask &other) const { return bits != other.bits; }
+
+private:
+	static quint32 bit(ResourceType type) { return 1u << type; }
+	quint32 bits;
+};
+
 class ResourceSet;
 /**
 * This class is the parent class for all resources. It represents a generic
@@ -149,5 +262,7 @@ private:
 };
 }
 
-#endif
+Q_DECLARE_TYPEINFO(ResourcePolicy::ResourceTypeMask, Q_PRIMITIVE_TYPE)
+Q_DECLARE_METATYPE(ResourcePolicy::ResourceTypeMask)
 
+#endif
@@ -30,19 +30,29 @@ INCLUDEPATH += $${LIBRESOURCEINC} $${LIBDBUSQEVENTLOOP} src
 # Input
 PUBLIC_HEADERS = $${POLICY}/resource.h \
                  $${POLICY}/resource-set.h \
+                 $${POLICY}/resource-set-batch.h \
+                 $${POLICY}/resource-latency-histogram.h \
+                 $${POLICY}/resource-log.h \
+                 $${POLICY}/resource-request-future.h \
+                 $${POLICY}/resource-awaitable.h \
                  $${POLICY}/resources.h \
                  $${POLICY}/audio-resource.h
 
-HEADERS += $${PUBLIC_HEADERS} src/resource-engine.h
+HEADERS += $${PUBLIC_HEADERS} src/resource-engine.h src/resource-trace.h \
+           src/resource-request-tracker.h
 
 SOURCES += src/resource.cpp \
            src/resource-set.cpp \
+           src/resource-set-batch.cpp \
+           src/resource-latency-histogram.cpp \
+           src/resource-log.cpp \
+           src/resource-request-future.cpp \
            src/resource-engine.cpp \
            src/resources.cpp \
            src/audio-resource.cpp
 
 QMAKE_CXXFLAGS += -Wall
-LIBS += $$(DBUSQEVENTLOOPLIB)
+LIBS += $$(DBUSQEVENTLOOPLIB) -lrt
 
 OBJECTS_DIR = build
 MOC_DIR = moc
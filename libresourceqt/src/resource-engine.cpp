@@ -20,19 +20,49 @@ USA.
 *************************************************************************/
 
 #include "resource-engine.h"
+#include <QHash>
+#include <QThread>
+#include <QThreadStorage>
+#include <QVarLengthArray>
 #include <dbus/dbus.h>
+#include <time.h>
 
 using namespace ResourcePolicy;
 
-static QMultiMap<resconn_t *, ResourceEngine *> engineMap;
+// Dispatch table from resource set id to its engine. Every libresource
+// message carries the set id, so routing one costs a single hash lookup.
+static QHash<quint32, ResourceEngine *> engineTable;
 
 resconn_t *ResourceEngine::libresourceConnection = NULL;
 quint32 ResourceEngine::libresourceUsers = 0;
 
-static QMutex mutex(QMutex::Recursive);
+// connectionMutex serialises everything the engines share: the libresource
+// connection (libresourceConnection, libresourceUsers and the resproto send
+// path), engineTable and the dispatch references of the engines. Request
+// bookkeeping of a single engine is guarded by its own engineMutex, so sets
+// living in different threads only meet here for the duration of a send.
+// Lock order is engineMutex -> connectionMutex; the libresource callbacks
+// never hold connectionMutex while taking an engineMutex.
+static QMutex connectionMutex(QMutex::Recursive);
+
+// Requests queued by beginBatch() on one thread. The class name of an update
+// is copied, since the caller's buffer is gone by the time the batch is sent.
+struct BatchedMessage
+{
+    ResourceEngine *engine;
+    resset_t *libresourceSet;
+    resmsg_t message;
+    QByteArray klass;
+};
 
-static inline quint32 allResourcesToBitmask(const ResourceSet *resourceSet);
-static inline quint32 optionalResourcesToBitmask(const ResourceSet *resourceSet);
+struct MessageBatch
+{
+    MessageBatch() : depth(0) {}
+    int depth;
+    QList<BatchedMessage> messages;
+};
+
+static QThreadStorage<MessageBatch *> messageBatches;
 
 static void connectionIsUp(resconn_t *connection);
 static void statusCallbackHandler(resset_t *rset, resmsg_t *msg);
@@ -43,10 +73,30 @@ static void handleReleaseMessage(resmsg_t *message, resset_t *rs, void *data);
 
 extern bool printLogs;
 
+static inline qint64 monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (qint64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// The ResourceRequest of an acquire, release or update message.
+static inline bool requestOf(resmsg_type_t type, ResourceRequest &request)
+{
+    switch (type) {
+    case RESMSG_ACQUIRE: request = AcquireRequest; return true;
+    case RESMSG_RELEASE: request = ReleaseRequest; return true;
+    case RESMSG_UPDATE:  request = UpdateRequest;  return true;
+    default:             return false;
+    }
+}
+
 ResourceEngine::ResourceEngine(ResourceSet *resourceSet)
         : QObject(), connected(false), resourceSet(resourceSet),
         libresourceSet(NULL), requestId(0), messageMap(), connectionMode(0),
-        identifier(resourceSet->id()), aboutToBeDeleted(false), isConnecting(false)
+        identifier(resourceSet->id()), aboutToBeDeleted(false), isConnecting(false),
+        lastPossessRequest(0), deadlineTimer(NULL), engineMutex(QMutex::Recursive),
+        references(0), retired(false)
 {
     //if (resourceSet->alwaysGetReply()) {
         connectionMode += RESMSG_MODE_ALWAYS_REPLY;
@@ -60,12 +110,12 @@ ResourceEngine::ResourceEngine(ResourceSet *resourceSet)
 ResourceEngine::~ResourceEngine()
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&connectionMutex);
     LOG_DEBUG("ResourceEngine::~ResourceEngine(%d) - starting destruction", identifier);
     libresourceUsers--;
-    if (libresourceSet != NULL) {
-        libresourceSet->userdata = NULL;
-        LOG_DEBUG("ResourceEngine::~ResourceEngine(%d) - unset userdata", identifier);
+    if (engineTable.value(identifier) == this) {
+        engineTable.remove(identifier);
+        LOG_DEBUG("ResourceEngine::~ResourceEngine(%d) - removed from dispatch table", identifier);
     }
     if (libresourceUsers==0) {
         // Let's just print a log message and still keep
@@ -81,7 +131,7 @@ ResourceEngine::~ResourceEngine()
 bool ResourceEngine::initialize()
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&connectionMutex);
     DBusError dbusError;
     DBusConnection *dbusConnection;
 
@@ -108,12 +158,11 @@ bool ResourceEngine::initialize()
         resproto_set_handler(ResourceEngine::libresourceConnection, RESMSG_GRANT, handleGrantMessage);
         resproto_set_handler(ResourceEngine::libresourceConnection, RESMSG_ADVICE, handleAdviceMessage);
         resproto_set_handler(ResourceEngine::libresourceConnection, RESMSG_RELEASE, handleReleaseMessage);
-        engineMap.insert(ResourceEngine::libresourceConnection, this);
     }
     else {
         ResourceEngine::libresourceUsers += 1;
-        engineMap.insert(ResourceEngine::libresourceConnection, this);
     }
+    engineTable.insert(identifier, this);
 
     LOG_DEBUG("ResourceEngine (%u, %p) is now initialized. %d users",
            identifier, ResourceEngine::libresourceConnection,
@@ -121,69 +170,136 @@ bool ResourceEngine::initialize()
     return true;
 }
 
-static void handleUnregisterMessage(resmsg_t *message, resset_t *libresourceSet, void *)
+ResourceEngine *ResourceEngine::reference(quint32 resourceSetId)
 {
-    LOG_DEBUG("**************** %s() - locking....", __FUNCTION__);
-    QMutexLocker locker(&mutex);
-    if (NULL == libresourceSet->userdata) {
-        LOG_DEBUG("IGNORING unregister, no context");
+    QMutexLocker locker(&connectionMutex);
+    ResourceEngine *engine = engineTable.value(resourceSetId);
+    if (engine != NULL)
+        engine->references++;
+    return engine;
+}
+
+void ResourceEngine::dereference()
+{
+    QMutexLocker locker(&connectionMutex);
+    if (--references > 0 || !retired)
         return;
+    locker.unlock();
+    deleteLater();
+}
+
+void ResourceEngine::retire()
+{
+    QMutexLocker locker(&connectionMutex);
+    if (engineTable.value(identifier) == this) {
+        engineTable.remove(identifier);
     }
-    ResourceEngine *engine = reinterpret_cast<ResourceEngine *>(libresourceSet->userdata);
-    LOG_DEBUG("recv: unregister: id=%d, engine->id() = %d", message->any.id, engine->id());
-    if(engine->id() != message->any.id) {
-        LOG_DEBUG("Received an unregister notification, but it is not for us. Ignoring (%d != %d)",
-               message->any.id, engine->id());
+    retired = true;
+    if (references > 0)
+        return;
+    locker.unlock();
+    deleteLater();
+}
+
+// The engine a libresource message is for, referenced for as long as the
+// message is dispatched to it, so that an unregistration handled at the
+// same time cannot delete it underneath.
+class EngineReference
+{
+public:
+    explicit EngineReference(quint32 resourceSetId)
+        : engine(ResourceEngine::reference(resourceSetId)) {}
+    ~EngineReference() { if (engine != NULL) engine->dereference(); }
+
+    ResourceEngine *data() const { return engine; }
+    ResourceEngine *operator->() const { return engine; }
+
+private:
+    Q_DISABLE_COPY(EngineReference)
+    ResourceEngine *engine;
+};
+
+static void handleUnregisterMessage(resmsg_t *message, resset_t *, void *)
+{
+    EngineReference engine(message->any.id);
+    if (NULL == engine.data()) {
+        LOG_DEBUG("IGNORING unregister, no engine for id=%d", message->any.id);
         return;
     }
+    LOG_DEBUG("recv: unregister: id=%d", message->any.id);
 
     engine->disconnected();
 }
 
 void ResourceEngine::disconnected()
 {
+    QMutexLocker locker(&engineMutex);
     LOG_DEBUG("ResourceEngine(%d) - disconnected", identifier);
     connected = false;
+    // Requests in flight are never answered now.
+    messageMap.clear();
+    // Called on the D-Bus I/O thread, which must not touch the timer. With
+    // no deadlines left the check stops it on the thread of the engine.
+    if (deadlineTimer != NULL)
+        QMetaObject::invokeMethod(this, "checkDeadlines", Qt::QueuedConnection);
     emit disconnectedFromManager();
 }
 
-static void handleGrantMessage(resmsg_t *message, resset_t *libresourceSet, void *)
+static void handleGrantMessage(resmsg_t *message, resset_t *, void *)
 {
-    LOG_DEBUG("**************** %s() - locking....", __FUNCTION__);
-    QMutexLocker locker(&mutex);
-    if (NULL == libresourceSet->userdata) {
-        LOG_DEBUG("IGNORING grant, no context: type=0x%04x, id=0x%04x, reqno=0x%04x, resc=0x%04x",
+    EngineReference engine(message->any.id);
+    if (NULL == engine.data()) {
+        LOG_DEBUG("IGNORING grant, no engine: type=0x%04x, id=0x%04x, reqno=0x%04x, resc=0x%04x",
                message->notify.type, message->notify.id, message->notify.reqno, message->notify.resrc);
         return;
     }
-    ResourceEngine *engine = reinterpret_cast<ResourceEngine *>(libresourceSet->userdata);
-    LOG_DEBUG("recv: grant: type=%d, id=%d, reqno=%d, resc=0x%04x engine->id() = %d",
+    LOG_DEBUG("recv: grant: type=%d, id=%d, reqno=%d, resc=0x%04x",
            message->notify.type, message->notify.id, message->notify.reqno,
-           message->notify.resrc, engine->id());
-    if(engine->id() != message->any.id) {
-        LOG_DEBUG("Received a grant message, but it is not for us. Ignoring (%d != %d)",
-               engine->id(), message->any.id);
-        return;
-    }
+           message->notify.resrc);
     engine->receivedGrant(&(message->notify));
 }
 
 void ResourceEngine::receivedGrant(resmsg_notify_t *notifyMessage)
 {
+    QMutexLocker locker(&engineMutex);
     LOG_DEBUG("ResourceEngine(%d) -- receivedGrant: type=0x%04x, id=0x%04x, reqno=0x%04x, resc=0x%04x",
            identifier, notifyMessage->type, notifyMessage->id, notifyMessage->reqno, notifyMessage->resrc);
+    RESOURCE_TRACE3(grant, identifier, notifyMessage->reqno, notifyMessage->resrc);
+
+    if (resourceSet == NULL) {
+        LOG_DEBUG("ResourceEngine(%d) -- dropping grant, the set is gone", identifier);
+        messageMap.remove(notifyMessage->reqno);
+        return;
+    }
+
+    if (messageMap.isAbandoned(notifyMessage->reqno)) {
+        resmsg_type_t originalMessageType = messageMap.take(notifyMessage->reqno);
+        LOG_DEBUG("ResourceEngine(%d) -- dropping the late grant of abandoned request %u",
+                  identifier, notifyMessage->reqno);
+        // Give back what an abandoned acquire got, unless the set has
+        // acquired or released again since.
+        if (originalMessageType == RESMSG_ACQUIRE && notifyMessage->resrc != 0 &&
+            notifyMessage->reqno == lastPossessRequest) {
+            releaseLateGrant();
+        }
+        return;
+    }
 
     if (notifyMessage->resrc == 0) {
 
         bool unkownRequest                = !messageMap.contains(notifyMessage->reqno);
-        resmsg_type_t originalMessageType =  messageMap.take(notifyMessage->reqno);
+        bool answeredByStatus             =  messageMap.isAnswered(notifyMessage->reqno);
+        resmsg_type_t originalMessageType =  messageMap.value(notifyMessage->reqno);
 
         LOG_DEBUG("ResourceEngine(%d) -- originalMessageType=%u", identifier, originalMessageType);
+        recordLatency(notifyMessage->reqno, originalMessageType, FinalReplyStage, true);
+        messageMap.remove(notifyMessage->reqno);
 
         if (unkownRequest ) {
             //we don't know this req number => it must be a server override
             LOG_DEBUG("ResourceEngine(%d) -- emiting signal resourcesLost()", identifier);
-            emit resourcesLost(allResourcesToBitmask(resourceSet));
+            RESOURCE_TRACE2(lost, identifier, resourceSet->allResourcesMask());
+            emit resourcesLost(resourceSet->allResourcesMask());
 
         }else if ( originalMessageType == RESMSG_UPDATE ) {
             //An app can loose all resources with update() or if it had no resources,
@@ -191,26 +307,32 @@ void ResourceEngine::receivedGrant(resmsg_notify_t *notifyMessage)
 
             if ( resourceSet->hasResourcesGranted() ) {
                 LOG_DEBUG("ResourceEngine(%d) -- emitting signal resourcesLost() for update", identifier);
-                emit resourcesLost(allResourcesToBitmask(resourceSet));
+                RESOURCE_TRACE2(lost, identifier, resourceSet->allResourcesMask());
+                emit resourcesLost(resourceSet->allResourcesMask());
             }else
             {
                 if ( resourceSet->alwaysGetReply() ) {
                     //If alwaysReply is on and we didn't have resources at update() then we come from here to updateOK()
                     LOG_DEBUG("ResourceEngine(%d) -- emitting signal updateOK() via receivedGrant.", identifier);
-                    emit updateOK(true);
+                    emit updateOK(true, notifyMessage->reqno);
                 }
                 else {
-                    emit updateOK(false);
+                    emit updateOK(false, notifyMessage->reqno);
                 }
             }
 
-        }else if (originalMessageType == RESMSG_ACQUIRE && resourceSet->alwaysGetReply() ) {
+        }else if (originalMessageType == RESMSG_ACQUIRE) {
+            //The set tells its users only if they asked for every reply, but
+            //it always has to take the acquire off its queue.
             LOG_DEBUG("ResourceEngine(%d) -- request DENIED!", identifier);
-            emit resourcesDenied();
+            emit resourcesDenied(notifyMessage->reqno);
+        }
+        else if (originalMessageType == RESMSG_RELEASE && answeredByStatus) {
+            LOG_DEBUG("ResourceEngine(%d) -- release already confirmed by its status", identifier);
         }
         else if (originalMessageType == RESMSG_RELEASE) {
             LOG_DEBUG("ResourceEngine(%d) -- confirmation to release", identifier);
-            emit resourcesReleased();
+            emit resourcesReleased(notifyMessage->reqno);
         }
         else {
             LOG_DEBUG("ResourceEngine(%d) -- Ignoring the receivedGrant because original message unknown.", identifier);
@@ -218,74 +340,75 @@ void ResourceEngine::receivedGrant(resmsg_notify_t *notifyMessage)
     }
     else {
 
+        recordLatency(notifyMessage->reqno, messageMap.value(notifyMessage->reqno),
+                      FinalReplyStage, true);
+        // Removed first, so that a set sending from its handler finds the
+        // entry free.
+        messageMap.remove(notifyMessage->reqno);
         LOG_DEBUG("ResourceEngine(%d) - emitting signal resourcesGranted(%02x).", identifier, notifyMessage->resrc);
-        emit resourcesGranted(notifyMessage->resrc);
+        emit resourcesGranted(notifyMessage->resrc, notifyMessage->reqno);
     }
-
-    messageMap.remove(notifyMessage->reqno);
 }
 
 
-static void handleReleaseMessage(resmsg_t *message, resset_t *rs, void *)
+static void handleReleaseMessage(resmsg_t *message, resset_t *, void *)
 {
-    LOG_DEBUG("**************** %s() - locking....", __FUNCTION__);
-    QMutexLocker locker(&mutex);
-    if (NULL == rs->userdata) {
-        LOG_DEBUG("IGNORING release, no context");
+    EngineReference engine(message->any.id);
+    if (NULL == engine.data()) {
+        LOG_DEBUG("IGNORING release, no engine for id=%d", message->any.id);
         return;
     }
-    ResourceEngine *engine = reinterpret_cast<ResourceEngine *>(rs->userdata);
-    LOG_DEBUG("recv: release: type=%d, id=%d, reqno=%d, resc=0x%04x engine->id() = %d",
+    LOG_DEBUG("recv: release: type=%d, id=%d, reqno=%d, resc=0x%04x",
            message->notify.type, message->notify.id, message->notify.reqno,
-           message->notify.resrc, engine->id());
-    if(engine->id() != message->any.id) {
-        LOG_DEBUG("Received an advice message, but it is not for us. Ignoring (%d != %d)",
-               engine->id(), message->any.id);
-        return;
-    }
+           message->notify.resrc);
 
     engine->receivedRelease(&(message->notify));
 }
 
 void ResourceEngine::receivedRelease(resmsg_notify_t *message)
 {
-    uint32_t allResources = allResourcesToBitmask(resourceSet);
+    QMutexLocker locker(&engineMutex);
+    if (resourceSet == NULL)
+        return;
+    uint32_t allResources = resourceSet->allResourcesMask();
     LOG_DEBUG("ResourceEngine(%d) - %s: have: %02x got %02x", identifier, __FUNCTION__, allResources, message->resrc);
+    RESOURCE_TRACE2(release, identifier, message->resrc);
     emit resourcesReleasedByManager();
 }
 
-static void handleAdviceMessage(resmsg_t *message, resset_t *libresourceSet, void *)
+static void handleAdviceMessage(resmsg_t *message, resset_t *, void *)
 {
-    LOG_DEBUG("**************** %s() - locking....", __FUNCTION__);
-    QMutexLocker locker(&mutex);
-    if (NULL == libresourceSet->userdata) {
-        LOG_DEBUG("IGNORING advice, no context");
+    EngineReference engine(message->any.id);
+    if (NULL == engine.data()) {
+        LOG_DEBUG("IGNORING advice, no engine for id=%d", message->any.id);
         return;
     }
-    ResourceEngine *engine = reinterpret_cast<ResourceEngine *>(libresourceSet->userdata);
-    LOG_DEBUG("recv: advice: type=%d, id=%d, reqno=%d, resc=0x%04x engine->id() = %d",
+    LOG_DEBUG("recv: advice: type=%d, id=%d, reqno=%d, resc=0x%04x",
            message->notify.type, message->notify.id, message->notify.reqno,
-           message->notify.resrc, engine->id());
-    if(engine->id() != message->any.id) {
-        LOG_DEBUG("Received an advice message, but it is not for us. Ignoring (%d != %d)",
-               engine->id(), message->any.id);
-        return;
-    }
+           message->notify.resrc);
 
     engine->receivedAdvice(&(message->notify));
 }
 
 void ResourceEngine::receivedAdvice(resmsg_notify_t *message)
 {
-    uint32_t allResources = allResourcesToBitmask(resourceSet);
+    QMutexLocker locker(&engineMutex);
+    if (resourceSet == NULL)
+        return;
+    uint32_t allResources = resourceSet->allResourcesMask();
     LOG_DEBUG("ResourceEngine(%d) - %s: have: %02x got %02x", identifier, __FUNCTION__, allResources, message->resrc);
+    RESOURCE_TRACE2(advice, identifier, message->resrc);
     emit resourcesBecameAvailable(message->resrc);
 }
 
 bool ResourceEngine::connectToManager()
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&engineMutex);
+    if (resourceSet == NULL) {
+        LOG_DEBUG("ResourceEngine(%d)::%s() - the set is gone", identifier, __FUNCTION__);
+        return false;
+    }
     if (isConnecting) {
         LOG_DEBUG("ResourceEngine::%s().... allready connecting, ignoring request", __FUNCTION__);
         return true;
@@ -294,14 +417,14 @@ bool ResourceEngine::connectToManager()
     resmsg_t resourceMessage;
     memset(&resourceMessage, 0, sizeof(resmsg_t));
     resourceMessage.record.type = RESMSG_REGISTER;
-    resourceMessage.record.id = resourceSet->id();
+    resourceMessage.record.id = identifier;
     resourceMessage.record.reqno = ++requestId;
 
-    messageMap.insert(requestId, RESMSG_REGISTER);
+    trackRequest(requestId, RESMSG_REGISTER);
 
     uint32_t allResources, optionalResources;
-    allResources = allResourcesToBitmask(resourceSet);
-    optionalResources = optionalResourcesToBitmask(resourceSet);
+    allResources = resourceSet->allResourcesMask();
+    optionalResources = resourceSet->optionalResourcesMask();
 
     resourceMessage.record.rset.all = allResources;
     resourceMessage.record.rset.opt = optionalResources;
@@ -316,12 +439,11 @@ bool ResourceEngine::connectToManager()
     LOG_DEBUG("ResourceEngine(%d) - ResourceEngine is now connecting(%d, %d, %d)",
            identifier, resourceMessage.record.id, resourceMessage.record.reqno,
            resourceMessage.record.rset.all);
+    QMutexLocker connectionLocker(&connectionMutex);
     libresourceSet = resconn_connect(ResourceEngine::libresourceConnection, &resourceMessage,
                                      statusCallbackHandler);
     if (libresourceSet == NULL)
         return false;
-    libresourceSet->userdata = this; //save our context
-    //locker.unlock();
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** unlocked! returning true", identifier, __FUNCTION__);
     return true;
 }
@@ -329,7 +451,7 @@ bool ResourceEngine::connectToManager()
 bool ResourceEngine::disconnectFromManager()
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&engineMutex);
     resmsg_t resourceMessage;
     memset(&resourceMessage, 0, sizeof(resmsg_t));
 
@@ -339,104 +461,56 @@ bool ResourceEngine::disconnectFromManager()
     aboutToBeDeleted = true;
 
     resourceMessage.record.type = RESMSG_UNREGISTER;
-    resourceMessage.record.id = resourceSet->id();
+    resourceMessage.record.id = identifier;
     resourceMessage.record.reqno = ++requestId;
 
 //    messageMap.insert(requestId, RESMSG_UNREGISTER);
 
+    resset_t *disconnectingSet = libresourceSet;
+    // The status reply may delete this engine, so do not hold its lock
+    // across the disconnect.
+    locker.unlock();
+
     bool ret = true;
-    if (libresourceSet != NULL) {
-        ret = resconn_disconnect(libresourceSet, &resourceMessage, statusCallbackHandler)?true:false;
+    if (disconnectingSet != NULL) {
+        QMutexLocker connectionLocker(&connectionMutex);
+        ret = resconn_disconnect(disconnectingSet, &resourceMessage, statusCallbackHandler)?true:false;
     }
     return ret;
 }
 
+void ResourceEngine::detachFromSet()
+{
+    QMutexLocker locker(&engineMutex);
+    resourceSet = NULL;
+}
+
 bool ResourceEngine::toBeDeleted()
 {
     return aboutToBeDeleted;
 }
 
-static inline quint32 allResourcesToBitmask(const ResourceSet *resourceSet)
+int ResourceEngine::outstandingRequests()
 {
-    QList<Resource *> resourceList = resourceSet->resources();
-    quint32 bitmask = 0;
-    for (int i = 0; i < resourceList.size(); i++) {
-        quint32 bits = resourceTypeToLibresourceType(resourceList[i]->type());
-        LOG_DEBUG("Converted Resource 0x%02x to 0x%02x", resourceList[i]->type(), bits);
-        bitmask += bits;
-    }
-    LOG_DEBUG("All resources as bitmask is 0x%04x", bitmask);
-    return bitmask;
+    QMutexLocker locker(&engineMutex);
+    return messageMap.outstanding();
 }
 
-quint32 ResourcePolicy::resourceTypeToLibresourceType(ResourceType type)
+bool ResourceEngine::hasRoomForRequest()
 {
-    switch (type) {
-    case AudioPlaybackType:
-        return RESMSG_AUDIO_PLAYBACK;
-    case VideoPlaybackType:
-        return RESMSG_VIDEO_PLAYBACK;
-    case AudioRecorderType:
-        return RESMSG_AUDIO_RECORDING;
-    case VideoRecorderType:
-        return RESMSG_VIDEO_RECORDING;
-    case VibraType:
-        return RESMSG_VIBRA;
-    case LedsType:
-        return RESMSG_LEDS;
-    case BacklightType:
-        return RESMSG_BACKLIGHT;
-    case SystemButtonType:
-        return RESMSG_SYSTEM_BUTTON;
-    case LockButtonType:
-        return RESMSG_LOCK_BUTTON;
-    case ScaleButtonType:
-        return RESMSG_SCALE_BUTTON;
-    case SnapButtonType:
-        return RESMSG_SNAP_BUTTON;
-    case LensCoverType:
-        return RESMSG_LENS_COVER;
-    case HeadsetButtonsType:
-        return RESMSG_HEADSET_BUTTONS;
-    default:
-        LOG_DEBUG("Unknown resource Type %d", quint32(type));
-        return 0xffff;
-    }
-}
-
-static inline quint32 optionalResourcesToBitmask(const ResourceSet *resourceSet)
-{
-    QList<Resource *> resourceList = resourceSet->resources();
-    quint32 bitmask = 0;
-    for (int i = 0; i < resourceList.size(); i++) {
-        if (resourceList[i]->isOptional()) {
-            bitmask += resourceTypeToLibresourceType(resourceList[i]->type());
-        }
-    }
-    return bitmask;
+    QMutexLocker locker(&engineMutex);
+    return messageMap.hasRoomFor(requestId + 1);
 }
 
 static void statusCallbackHandler(resset_t *libresourceSet, resmsg_t *message)
 {
-    LOG_DEBUG("**************** %s().... %d", __FUNCTION__, __LINE__);
-    //LOG_DEBUG("**************** %s() - locking....", __FUNCTION__);
-    QMutexLocker locker(&mutex);
-    if (NULL == libresourceSet->userdata) {
-        LOG_DEBUG("IGNORING status message, no context: type=0x%04x, id=0x%04x, reqno=0x%04x, errcod=%d",
+    EngineReference resourceEngine(libresourceSet->id);
+    if (NULL == resourceEngine.data()) {
+        LOG_DEBUG("IGNORING status message, no engine: type=0x%04x, id=0x%04x, reqno=0x%04x, errcod=%d",
                message->status.type, message->status.id, message->status.reqno, message->status.errcod);
         return;
     }
-    LOG_DEBUG("**************** %s().... %d", __FUNCTION__, __LINE__);
-    ResourceEngine *resourceEngine = reinterpret_cast<ResourceEngine *>(libresourceSet->userdata);
-    LOG_DEBUG("**************** %s().... %d", __FUNCTION__, __LINE__);
-    LOG_DEBUG("**************** %s().... %d", __FUNCTION__, __LINE__);
-    LOG_DEBUG("recv: status: id=%d, engine->id() = %d", message->any.id, resourceEngine->id());
-    LOG_DEBUG("**************** %s().... %d", __FUNCTION__, __LINE__);
-    if(resourceEngine->id() != libresourceSet->id) {
-        LOG_DEBUG("Received a status notification, but it is not for us. Ignoring (%d != %d)",
-               resourceEngine->id(), libresourceSet->id);
-        return;
-    }
+    LOG_DEBUG("recv: status: id=%d, set id=%d", message->any.id, libresourceSet->id);
     LOG_DEBUG("Received a status notification");
     if (message->type != RESMSG_STATUS) {
         LOG_DEBUG("Invalid message type.. (got %x, expected %x", message->type, RESMSG_STATUS);
@@ -448,8 +522,10 @@ static void statusCallbackHandler(resset_t *libresourceSet, resmsg_t *message)
     else {
         LOG_DEBUG("Received a status message with id %02x and #:%u", message->status.id, message->status.reqno);
         if(!resourceEngine->isConnectedToManager() && resourceEngine->toBeDeleted()) {
-            LOG_DEBUG("%s(%d) - delete resourceEngine %p", __FUNCTION__, __LINE__, resourceEngine);
-            delete resourceEngine;
+            LOG_DEBUG("%s(%d) - delete resourceEngine %p", __FUNCTION__, __LINE__, resourceEngine.data());
+            // Deleted when the last message dispatched to it, this one
+            // included, is done with it.
+            resourceEngine->retire();
         }
         else {
             resourceEngine->handleStatusMessage(message->status.reqno);
@@ -459,8 +535,15 @@ static void statusCallbackHandler(resset_t *libresourceSet, resmsg_t *message)
 
 void ResourceEngine::handleStatusMessage(quint32 requestNo)
 {
+    QMutexLocker locker(&engineMutex);
     resmsg_type_t originalMessageType = messageMap.value(requestNo);
     LOG_DEBUG("Received a status message: %u(0x%02x)", requestNo, originalMessageType);
+    RESOURCE_TRACE2(status, identifier, requestNo);
+    if (messageMap.isAbandoned(requestNo)) {
+        // A grant may still follow, the entry goes with that.
+        LOG_DEBUG("ResourceEngine(%d) - dropping the status of abandoned request %u", identifier, requestNo);
+        return;
+    }
     if (originalMessageType == RESMSG_REGISTER) {
         LOG_DEBUG("ResourceEngine(%d) - connected!", identifier);
         connected = true;
@@ -476,12 +559,17 @@ void ResourceEngine::handleStatusMessage(quint32 requestNo)
     }
     else if(originalMessageType == RESMSG_UPDATE) {
         LOG_DEBUG("ResourceEngine(%d) - Update status", identifier);
+        // The status is the answer to an update, unless the manager also
+        // sends a grant, which is then not counted again.
+        recordLatency(requestNo, originalMessageType, StatusReplyStage, false);
+        recordLatency(requestNo, originalMessageType, FinalReplyStage, true);
+        // A grant may still follow, the entry goes with that.
+        messageMap.answer(requestNo);
         //We only come here if status ok.
 
         //bool hadGrantsWhenSentUpdate = false;
 
-        //if ( wasInAcquireMode.contains(requestNo) )
-        //   hadGrantsWhenSentUpdate = wasInAcquireMode.take(requestNo);
+        //hadGrantsWhenSentUpdate = messageMap.hadGrants(requestNo);
 
         //if ( !hadGrantsWhenSentUpdate  &&  !resourceSet->alwaysGetReply() ) {
 
@@ -489,15 +577,26 @@ void ResourceEngine::handleStatusMessage(quint32 requestNo)
             //updateOK() (i.e. ACK that the set we are interested in is changed). Or if alwayReply
             // is off and our update does not change the granted set.
             LOG_DEBUG("ResourceEngine(%d) -- handleStatusMessage.", identifier);
-            emit updateOK(false);
+            emit updateOK(false, requestNo);
         //}
 
     }
     else if(originalMessageType == RESMSG_ACQUIRE) {
         LOG_DEBUG("ResourceEngine(%d) - Acquire status", identifier);
+        recordLatency(requestNo, originalMessageType, StatusReplyStage, false);
     }
     else if(originalMessageType == RESMSG_RELEASE) {
         LOG_DEBUG("ResourceEngine(%d) - Release status", identifier);
+        recordLatency(requestNo, originalMessageType, StatusReplyStage, false);
+        // Once the manager has handled a release the set holds nothing. A
+        // pipelined set, which may not get the empty grant before its next
+        // request, takes the status as the answer, and the grant is not
+        // reported again. Other sets are still answered by the grant.
+        if (resourceSet != NULL && resourceSet->isPipelined()) {
+            recordLatency(requestNo, originalMessageType, FinalReplyStage, true);
+            messageMap.answer(requestNo);
+            emit resourcesReleased(requestNo);
+        }
     }
     else {
         messageMap.remove(requestNo);
@@ -506,13 +605,34 @@ void ResourceEngine::handleStatusMessage(quint32 requestNo)
 
 void ResourceEngine::handleError(quint32 requestNo, qint32 code, const char *message)
 {
-    resmsg_type_t originalMessageType = messageMap.take(requestNo);
+    QMutexLocker locker(&engineMutex);
+    resmsg_type_t originalMessageType = messageMap.value(requestNo);
     LOG_DEBUG("ResourceEngine(%d) - Error on request %u(0x%02x): %d - %s",
            identifier, requestNo, originalMessageType, code, message);
+    RESOURCE_TRACE3(error, identifier, requestNo, code);
+    if (messageMap.isAbandoned(requestNo)) {
+        messageMap.remove(requestNo);
+        return;
+    }
+    recordLatency(requestNo, originalMessageType, StatusReplyStage, false);
+    recordLatency(requestNo, originalMessageType, FinalReplyStage, true);
     messageMap.remove(requestNo);
+    if (originalMessageType == RESMSG_REGISTER) {
+        // Not registered, so the set may try again, as it does once the
+        // manager is back.
+        isConnecting = false;
+    }
 
+    // libresource frees the message after this returns, while a queued
+    // signal is delivered later, so every error carries its own copy.
     LOG_DEBUG("emitting errorCallback");
-    emit errorCallback(code, message);
+    emit errorCallback(code, QByteArray(message));
+
+    // No other answer follows, so the set may go on with its queue.
+    ResourceRequest request;
+    if (requestOf(originalMessageType, request)) {
+        emit requestFailed(request, requestNo);
+    }
 }
 
 bool ResourceEngine::isConnectedToManager()
@@ -525,62 +645,64 @@ bool ResourceEngine::isConnectingToManager()
     return isConnecting;
 }
 
-bool ResourceEngine::acquireResources()
+bool ResourceEngine::acquireResources(int timeoutMs, quint32 *requestNo)
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&engineMutex);
     resmsg_t message;
     memset(&message, 0, sizeof(resmsg_t));
 
     message.possess.type = RESMSG_ACQUIRE;
-    message.possess.id    = resourceSet->id();
+    message.possess.id    = identifier;
     message.possess.reqno = ++requestId;
 
-    messageMap.insert(requestId, RESMSG_ACQUIRE);
-
-    LOG_DEBUG("ResourceEngine(%d) - acquire %u:%u", identifier, resourceSet->id(), requestId);
-    int success = resproto_send_message(libresourceSet, &message, statusCallbackHandler);
+    trackRequest(requestId, RESMSG_ACQUIRE, monotonicNs());
+    lastPossessRequest = requestId;
+    if (requestNo != NULL)
+        *requestNo = requestId;
+    if (timeoutMs > 0)
+        setDeadline(requestId, timeoutMs);
+    RESOURCE_TRACE3(send, identifier, requestId, AcquireRequest);
 
-    if(!success)
-        return false;
-    else
-        return true;
+    LOG_DEBUG("ResourceEngine(%d) - acquire %u:%u", identifier, identifier, requestId);
+    return sendMessage(&message);
 }
 
-bool ResourceEngine::releaseResources()
+bool ResourceEngine::releaseResources(int timeoutMs, quint32 *requestNo)
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&engineMutex);
     resmsg_t message;
     memset(&message, 0, sizeof(resmsg_t));
 
     message.possess.type = RESMSG_RELEASE;
-    message.possess.id    = resourceSet->id();
+    message.possess.id    = identifier;
     message.possess.reqno = ++requestId;
 
-    messageMap.insert(requestId, RESMSG_RELEASE);
-    LOG_DEBUG("ResourceEngine(%d) - release %u:%u", identifier, resourceSet->id(), requestId);
-    int success = resproto_send_message(libresourceSet, &message, statusCallbackHandler);
-
-    if(!success)
-        return false;
-    else
-        return true;
+    trackRequest(requestId, RESMSG_RELEASE, monotonicNs());
+    lastPossessRequest = requestId;
+    if (requestNo != NULL)
+        *requestNo = requestId;
+    if (timeoutMs > 0)
+        setDeadline(requestId, timeoutMs);
+    RESOURCE_TRACE3(send, identifier, requestId, ReleaseRequest);
+    LOG_DEBUG("ResourceEngine(%d) - release %u:%u", identifier, identifier, requestId);
+    return sendMessage(&message);
 }
 
-bool ResourceEngine::updateResources()
+bool ResourceEngine::updateResources(int timeoutMs, quint32 *requestNo)
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&engineMutex);
     resmsg_t message;
     memset(&message, 0, sizeof(resmsg_t));
     message.record.type = RESMSG_UPDATE;
-    message.record.id = resourceSet->id();
+    message.record.id = identifier;
     message.record.reqno = ++requestId;
 
     uint32_t allResources, optionalResources;
-    allResources = allResourcesToBitmask(resourceSet);
-    optionalResources = optionalResourcesToBitmask(resourceSet);
+    allResources = resourceSet->allResourcesMask();
+    optionalResources = resourceSet->optionalResourcesMask();
 
     message.record.rset.all = allResources;
     message.record.rset.opt = optionalResources;
@@ -590,26 +712,24 @@ bool ResourceEngine::updateResources()
     QByteArray ba = resourceSet->applicationClass().toLatin1();
     message.record.klass = ba.data();
 
-    messageMap.insert(requestId, RESMSG_UPDATE);
-
-    bool hasGranted = resourceSet->resources().size() ? true : false;
-
-    wasInAcquireMode.insert(requestId, hasGranted /*hasResourcesGranted()*/ );
+    bool hasGranted = resourceSet->allResourcesMask() ? true : false;
 
-    LOG_DEBUG("ResourceEngine(%d) - update %u:%u", identifier, resourceSet->id(), requestId);
-    int success = resproto_send_message(libresourceSet, &message, statusCallbackHandler);
+    trackRequest(requestId, RESMSG_UPDATE, monotonicNs(), hasGranted /*hasResourcesGranted()*/ );
+    if (requestNo != NULL)
+        *requestNo = requestId;
+    if (timeoutMs > 0)
+        setDeadline(requestId, timeoutMs);
+    RESOURCE_TRACE3(send, identifier, requestId, UpdateRequest);
 
-    if(!success)
-        return false;
-    else
-        return true;
+    LOG_DEBUG("ResourceEngine(%d) - update %u:%u", identifier, identifier, requestId);
+    return sendMessage(&message);
 }
 
 bool ResourceEngine::registerAudioProperties(const QString &audioGroup, quint32 pid,
                                               const QString &name, const QString &value)
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&engineMutex);
     resmsg_t message;
     memset(&message, 0, sizeof(resmsg_t));
     QByteArray groupBa, nameBa, valueBa;
@@ -636,27 +756,21 @@ bool ResourceEngine::registerAudioProperties(const QString &audioGroup, quint32
     }
 
     message.audio.type = RESMSG_AUDIO;
-    message.audio.id    = resourceSet->id();
+    message.audio.id    = identifier;
     message.audio.reqno = ++requestId;
 
     message.audio.type  = RESMSG_AUDIO;
 
-    messageMap.insert(requestId, RESMSG_AUDIO);
+    trackRequest(requestId, RESMSG_AUDIO);
 
-    LOG_DEBUG("ResourceEngine(%d) - audio %u:%u", identifier, resourceSet->id(), requestId);
-    int success = resproto_send_message(libresourceSet, &message, statusCallbackHandler);
-    LOG_DEBUG("ResourceEngine(%d) - resproto_send_message returned %d", identifier, success);
-
-    if(!success)
-        return false;
-    else
-        return true;
+    LOG_DEBUG("ResourceEngine(%d) - audio %u:%u", identifier, identifier, requestId);
+    return sendMessage(&message);
 }
 
 bool ResourceEngine::registerVideoProperties(quint32 pid)
 {
     LOG_DEBUG("ResourceEngine(%d)::%s() - **************** locking....", identifier, __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&engineMutex);
     resmsg_t message;
     memset(&message, 0, sizeof(resmsg_t));
 
@@ -667,14 +781,143 @@ bool ResourceEngine::registerVideoProperties(quint32 pid)
 
     message.video.pid   = pid;
     message.video.type  = RESMSG_VIDEO;
-    message.video.id    = resourceSet->id();
+    message.video.id    = identifier;
     message.video.reqno = ++requestId;
     message.video.type  = RESMSG_VIDEO;
 
-    messageMap.insert(requestId, RESMSG_VIDEO);
+    trackRequest(requestId, RESMSG_VIDEO);
+
+    LOG_DEBUG("ResourceEngine(%d) - video %u:%u", identifier, identifier, requestId);
+    return sendMessage(&message);
+}
+
+// Tracks a request that is sent. A request so old that its entry is taken
+// over will never be recognised if it is answered, so it is failed here.
+void ResourceEngine::trackRequest(quint32 requestNo, resmsg_type_t type, qint64 sentNs, bool hadGrants)
+{
+    quint32 evictedNo = 0;
+    resmsg_type_t evictedType = resmsg_type_t();
+    if (!messageMap.insert(requestNo, type, sentNs, hadGrants, &evictedNo, &evictedType))
+        return;
+
+    qWarning("ResourceEngine(%d) - request %u is still unanswered after %d newer ones, giving it up",
+             identifier, evictedNo, (int)RequestTracker::Capacity);
+    ResourceRequest request;
+    if (requestOf(evictedType, request)) {
+        emit requestFailed(request, evictedNo);
+    }
+}
+
+void ResourceEngine::recordLatency(quint32 requestNo, resmsg_type_t type,
+                                   LatencyStage stage, bool answered)
+{
+    qint64 sentNs = messageMap.sentNs(requestNo);
+    if (sentNs == 0 || resourceSet == NULL)
+        return;
+
+    ResourceRequest request;
+    if (!requestOf(type, request)) {
+        messageMap.clearSentNs(requestNo);
+        return;
+    }
+
+    resourceSet->recordLatency(request, stage, monotonicNs() - sentNs);
+    if (answered) {
+        messageMap.clearSentNs(requestNo);
+    }
+}
+
+// Requests may be made from any thread, but the timer may only be created
+// and started on the thread of the engine. From other threads
+// checkDeadlines() is queued to start it.
+void ResourceEngine::setDeadline(quint32 requestNo, int timeoutMs)
+{
+    qint64 now = monotonicNs();
+    messageMap.setDeadline(requestNo, now + (qint64)timeoutMs * 1000000);
+
+    if (QThread::currentThread() == thread())
+        startDeadlineTimer(now);
+    else
+        QMetaObject::invokeMethod(this, "checkDeadlines", Qt::QueuedConnection);
+}
+
+// Runs the timer until the next deadline, or stops it if there is none.
+// Called with engineMutex held, on the thread of the engine.
+void ResourceEngine::startDeadlineTimer(qint64 now)
+{
+    qint64 next = messageMap.nextDeadline();
+    if (next == 0) {
+        if (deadlineTimer != NULL)
+            deadlineTimer->stop();
+        return;
+    }
+
+    if (deadlineTimer == NULL) {
+        deadlineTimer = new QTimer(this);
+        deadlineTimer->setSingleShot(true);
+        QObject::connect(deadlineTimer, SIGNAL(timeout()), this, SLOT(checkDeadlines()));
+    }
+    deadlineTimer->start((int)((next - now + 999999) / 1000000));
+}
+
+void ResourceEngine::checkDeadlines()
+{
+    QMutexLocker locker(&engineMutex);
+    qint64 now = monotonicNs();
+    quint32 expired[RequestTracker::Capacity];
+    int count = messageMap.abandonExpired(now, expired);
+
+    startDeadlineTimer(now);
+
+    for (int i = 0; i < count; i++) {
+        ResourceRequest request;
+        if (!requestOf(messageMap.value(expired[i]), request))
+            continue;
+        LOG_DEBUG("ResourceEngine(%d) - request %u timed out", identifier, expired[i]);
+        RESOURCE_TRACE3(timeout, identifier, expired[i], request);
+        emit requestTimedOut(request, expired[i]);
+    }
+}
+
+// Releases what the manager granted to an acquire that had already timed
+// out. The release is abandoned right away, so its answer is not taken for
+// an answer to the set.
+void ResourceEngine::releaseLateGrant()
+{
+    resmsg_t message;
+    memset(&message, 0, sizeof(resmsg_t));
+
+    message.possess.type = RESMSG_RELEASE;
+    message.possess.id    = identifier;
+    message.possess.reqno = ++requestId;
+
+    trackRequest(requestId, RESMSG_RELEASE);
+    messageMap.abandon(requestId);
+    lastPossessRequest = requestId;
+    LOG_DEBUG("ResourceEngine(%d) - release late grant %u:%u", identifier, identifier, requestId);
+    sendMessage(&message);
+}
+
+bool ResourceEngine::sendMessage(resmsg_t *message)
+{
+    MessageBatch *batch = messageBatches.hasLocalData() ? messageBatches.localData() : NULL;
+    if (batch != NULL && batch->depth > 0 &&
+        (message->type == RESMSG_ACQUIRE || message->type == RESMSG_RELEASE ||
+         message->type == RESMSG_UPDATE)) {
+        BatchedMessage batched;
+        batched.engine = this;
+        batched.libresourceSet = libresourceSet;
+        batched.message = *message;
+        if (message->type == RESMSG_UPDATE && message->record.klass != NULL) {
+            batched.klass = QByteArray(message->record.klass);
+        }
+        batch->messages.append(batched);
+        LOG_DEBUG("ResourceEngine(%d) - queued request %u in batch", identifier, message->any.reqno);
+        return true;
+    }
 
-    LOG_DEBUG("ResourceEngine(%d) - video %u:%u", identifier, resourceSet->id(), requestId);
-    int success = resproto_send_message(libresourceSet, &message, statusCallbackHandler);
+    QMutexLocker connectionLocker(&connectionMutex);
+    int success = resproto_send_message(libresourceSet, message, statusCallbackHandler);
     LOG_DEBUG("ResourceEngine(%d) - resproto_send_message returned %d", identifier, success);
 
     if(!success)
@@ -683,22 +926,71 @@ bool ResourceEngine::registerVideoProperties(quint32 pid)
         return true;
 }
 
+void ResourceEngine::beginBatch()
+{
+    if (!messageBatches.hasLocalData()) {
+        messageBatches.setLocalData(new MessageBatch);
+    }
+    messageBatches.localData()->depth++;
+}
+
+bool ResourceEngine::endBatch()
+{
+    if (!messageBatches.hasLocalData() || messageBatches.localData()->depth == 0) {
+        return true;
+    }
+    MessageBatch *batch = messageBatches.localData();
+    if (--batch->depth > 0) {
+        return true;
+    }
+
+    QList<BatchedMessage> messages = batch->messages;
+    batch->messages.clear();
+
+    bool allSent = true;
+    QMutexLocker connectionLocker(&connectionMutex);
+    LOG_DEBUG("ResourceEngine - sending a batch of %d requests", messages.size());
+    for (int i = 0; i < messages.size(); ++i) {
+        BatchedMessage &batched = messages[i];
+        if (!batched.klass.isNull()) {
+            batched.message.record.klass = batched.klass.data();
+        }
+        if (!resproto_send_message(batched.libresourceSet, &batched.message, statusCallbackHandler)) {
+            LOG_DEBUG("ResourceEngine(%d) - sending batched request %u failed",
+                   batched.engine->identifier, batched.message.any.reqno);
+            allSent = false;
+        }
+    }
+    return allSent;
+}
+
 static void connectionIsUp(resconn_t *connection)
 {
     LOG_DEBUG("**************** %s() - locking....", __FUNCTION__);
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&connectionMutex);
 
     LOG_DEBUG("connection is up");
 
-    QList<ResourceEngine*> engines = engineMap.values(connection);
-    for (int i = 0; i < engines.size(); ++i) {
-        ResourceEngine *resourceEngine = engines.at(i);
-        resourceEngine->handleConnectionIsUp(connection);
+    // The engines react by reconnecting, which takes their own locks, so
+    // work on a snapshot of the set ids. It stays on the stack for any
+    // realistic number of sets.
+    QVarLengthArray<quint32, 64> ids;
+    for (QHash<quint32, ResourceEngine *>::const_iterator it = engineTable.constBegin();
+         it != engineTable.constEnd(); ++it) {
+        ids.append(it.key());
+    }
+    locker.unlock();
+
+    for (int i = 0; i < ids.size(); ++i) {
+        EngineReference engine(ids[i]);
+        if (engine.data() != NULL)
+            engine->handleConnectionIsUp(connection);
     }
 }
 
 void ResourceEngine::handleConnectionIsUp(resconn_t *connection)
 {
+    QMutexLocker locker(&engineMutex);
 
     if(ResourceEngine::libresourceConnection == connection) {
         LOG_DEBUG("ResourceEngine(%d) - connected to manager, connection=%p", identifier, connection);
@@ -24,20 +24,99 @@ USA.
 
 #include <QObject>
 #include <QMap>
+#include <QHash>
+#include <QMutex>
+#include <QByteArray>
 #include <QString>
+#include <QTimer>
 #include <dbus/dbus.h>
 #include <res-conn.h>
 #include <policy/resource-set.h>
 #include <dbusconnectioneventloop.h>
+#include "resource-trace.h"
+#include "resource-request-tracker.h"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
 
-#define LOG_DEBUG(...) do { if (printLogs) qDebug(__VA_ARGS__);  } while(0)
+extern bool printLogs;
+extern bool ringLogs;
+
+#ifdef RESOURCEQT_NO_LOGS
+// Compiled out. The call is still seen by the compiler, so variables used
+// only for logging do not turn into warnings.
+#define LOG_DEBUG(...) do { if (false) qDebug(__VA_ARGS__); } while(0)
+#else
+#define LOG_DEBUG(...) do { if (printLogs) { if (ringLogs) ResourcePolicy::logToRing(__VA_ARGS__); else qDebug(__VA_ARGS__); } } while(0)
+#endif
 
 namespace ResourcePolicy {
 
-quint32 resourceTypeToLibresourceType(ResourceType type);
+// Writes a log message into the ring buffer of the calling thread, see
+// ResourceLog. Implemented in resource-log.cpp.
+void logToRing(const char *format, ...);
+
+// libresource bit of each ResourceType, indexed by the type.
+static const quint32 libresourceTypes[NumberOfTypes] = {
+    RESMSG_AUDIO_PLAYBACK,      // AudioPlaybackType
+    RESMSG_VIDEO_PLAYBACK,      // VideoPlaybackType
+    RESMSG_AUDIO_RECORDING,     // AudioRecorderType
+    RESMSG_VIDEO_RECORDING,     // VideoRecorderType
+    RESMSG_VIBRA,               // VibraType
+    RESMSG_LEDS,                // LedsType
+    RESMSG_BACKLIGHT,           // BacklightType
+    RESMSG_SYSTEM_BUTTON,       // SystemButtonType
+    RESMSG_LOCK_BUTTON,         // LockButtonType
+    RESMSG_SCALE_BUTTON,        // ScaleButtonType
+    RESMSG_SNAP_BUTTON,         // SnapButtonType
+    RESMSG_LENS_COVER,          // LensCoverType
+    RESMSG_HEADSET_BUTTONS      // HeadsetButtonsType
+};
+
+// ResourceType of each libresource bit, indexed by the bit number, and
+// NumberOfTypes for bits that map to no type. Every entry is a constant
+// expression, so the table is built by the compiler, not at load time.
+#define LIBRESOURCE_BIT_TYPE(bit) \
+    (RESMSG_AUDIO_PLAYBACK  == 1u << (bit) ? AudioPlaybackType  : \
+     RESMSG_VIDEO_PLAYBACK  == 1u << (bit) ? VideoPlaybackType  : \
+     RESMSG_AUDIO_RECORDING == 1u << (bit) ? AudioRecorderType  : \
+     RESMSG_VIDEO_RECORDING == 1u << (bit) ? VideoRecorderType  : \
+     RESMSG_VIBRA           == 1u << (bit) ? VibraType          : \
+     RESMSG_LEDS            == 1u << (bit) ? LedsType           : \
+     RESMSG_BACKLIGHT       == 1u << (bit) ? BacklightType      : \
+     RESMSG_SYSTEM_BUTTON   == 1u << (bit) ? SystemButtonType   : \
+     RESMSG_LOCK_BUTTON     == 1u << (bit) ? LockButtonType     : \
+     RESMSG_SCALE_BUTTON    == 1u << (bit) ? ScaleButtonType    : \
+     RESMSG_SNAP_BUTTON     == 1u << (bit) ? SnapButtonType     : \
+     RESMSG_LENS_COVER      == 1u << (bit) ? LensCoverType      : \
+     RESMSG_HEADSET_BUTTONS == 1u << (bit) ? HeadsetButtonsType : \
+     NumberOfTypes)
+#define LIBRESOURCE_BIT_TYPES_8(bit) \
+    LIBRESOURCE_BIT_TYPE(bit),     LIBRESOURCE_BIT_TYPE(bit + 1), \
+    LIBRESOURCE_BIT_TYPE(bit + 2), LIBRESOURCE_BIT_TYPE(bit + 3), \
+    LIBRESOURCE_BIT_TYPE(bit + 4), LIBRESOURCE_BIT_TYPE(bit + 5), \
+    LIBRESOURCE_BIT_TYPE(bit + 6), LIBRESOURCE_BIT_TYPE(bit + 7)
+static const ResourceType libresourceBitTypes[32] = {
+    LIBRESOURCE_BIT_TYPES_8(0),  LIBRESOURCE_BIT_TYPES_8(8),
+    LIBRESOURCE_BIT_TYPES_8(16), LIBRESOURCE_BIT_TYPES_8(24)
+};
+#undef LIBRESOURCE_BIT_TYPES_8
+#undef LIBRESOURCE_BIT_TYPE
+
+inline quint32 resourceTypeToLibresourceType(ResourceType type)
+{
+    return (quint32)type < (quint32)NumberOfTypes ? libresourceTypes[type] : 0xffff;
+}
+
+// Removes the lowest set bit from a non-zero libresource bitmask and
+// returns its ResourceType. Loops over a mask thus visit only the resources
+// that are actually in it.
+inline ResourceType takeLowestResourceType(quint32 &bitmask)
+{
+    int bit = __builtin_ctz(bitmask);
+    bitmask &= bitmask - 1;
+    return libresourceBitTypes[bit];
+}
 
 class ResourceEngine: public QObject
 {
@@ -46,6 +125,9 @@ class ResourceEngine: public QObject
 #ifdef TEST_RESOURCE_ENGINE_H
     friend class ::TestResourceEngine;
 #endif
+#ifdef BENCHMARK_RESOURCE_ENGINE_H
+    friend class ::BenchmarkResourceEngine;
+#endif
 
 public:
     ResourceEngine(ResourceSet *resourceSet);
@@ -58,9 +140,12 @@ public:
     bool isConnectedToManager();
     bool isConnectingToManager();
 
-    bool acquireResources();
-    bool releaseResources();
-    bool updateResources();
+    // A request not answered within timeoutMs > 0 is abandoned and
+    // reported with requestTimedOut(). The number of the request is stored
+    // in requestNo, if given, before it is sent.
+    bool acquireResources(int timeoutMs = 0, quint32 *requestNo = NULL);
+    bool releaseResources(int timeoutMs = 0, quint32 *requestNo = NULL);
+    bool updateResources(int timeoutMs = 0, quint32 *requestNo = NULL);
 
     bool registerAudioProperties(const QString &audioGroup, quint32 pid,
                                   const QString &name, const QString &value);
@@ -79,34 +164,87 @@ public:
     void handleError(quint32 requestNo, qint32 code, const char *message);
 
     quint32 id();
+    // Called by the set when it is deleted. The engine lives on until the
+    // manager answers the unregistration, and drops what arrives meanwhile.
+    void detachFromSet();
     bool toBeDeleted();
+    int outstandingRequests();
+    // Whether the next request can be tracked without giving up one that
+    // still waits for its answer, see RequestTracker.
+    bool hasRoomForRequest();
+
+    // While a batch is open on the calling thread, acquire, release and
+    // update requests of every engine are queued instead of sent, and the
+    // outermost endBatch() sends them all under a single hold of the
+    // connection lock. endBatch() returns false if any send failed.
+    static void beginBatch();
+    static bool endBatch();
+
+    // The engine of a set, referenced so that it stays alive while a
+    // libresource message is dispatched to it; NULL if there is none. Every
+    // reference is dropped with dereference().
+    static ResourceEngine *reference(quint32 resourceSetId);
+    void dereference();
+    // Takes the engine out of the dispatch table once it has unregistered,
+    // and deletes it when the last reference to it is dropped. The delete
+    // is posted to the thread of the engine, whose timer and signals the
+    // D-Bus I/O thread must not tear down.
+    void retire();
 
 signals:
+    // The answers to requests carry the number of the request they answer,
+    // by which the set finds the request in its queue.
     void resourcesBecameAvailable(quint32 bitmaskOfAvailableResources);
-    void resourcesGranted(quint32 bitmaskOfGrantedResources);
-    void resourcesDenied();
-    void resourcesReleased();
+    void resourcesGranted(quint32 bitmaskOfGrantedResources, quint32 requestNo);
+    void resourcesDenied(quint32 requestNo);
+    void resourcesReleased(quint32 requestNo);
     void resourcesLost(quint32 bitmaskOfGrantedResources);
     void connectedToManager();
     void disconnectedFromManager();
-    void errorCallback(quint32 code, const char* );
+    void errorCallback(quint32 code, const QByteArray &message);
     void resourcesReleasedByManager();
-    void updateOK(bool);
+    void updateOK(bool, quint32 requestNo);
+    void requestTimedOut(ResourcePolicy::ResourceRequest request, quint32 requestNo);
+    void requestFailed(ResourcePolicy::ResourceRequest request, quint32 requestNo);
+
+private slots:
+    void checkDeadlines();
 
 private:
+    bool sendMessage(resmsg_t *message);
+    void setDeadline(quint32 requestNo, int timeoutMs);
+    void startDeadlineTimer(qint64 now);
+    void releaseLateGrant();
+    void trackRequest(quint32 requestNo, resmsg_type_t type, qint64 sentNs = 0, bool hadGrants = false);
+    void recordLatency(quint32 requestNo, resmsg_type_t type, LatencyStage stage, bool answered);
+
     bool connected;
+    // NULL once the set is deleted. Guarded by engineMutex.
     ResourceSet *resourceSet;
     DBusConnection *dbusConnection;
     resset_t *libresourceSet;
     quint32 requestId;
-    QMap<quint32, resmsg_type_t> messageMap;
-    QMap<quint32, bool> wasInAcquireMode;
+    // The requests in flight, with the send time of acquire, release and
+    // update requests for the latency histograms of the set.
+    RequestTracker messageMap;
     quint32 connectionMode;
     static quint32 libresourceUsers;
     static resconn_t *libresourceConnection;
     quint32 identifier;
     bool aboutToBeDeleted;
     bool isConnecting;
+    // The latest acquire or release, to tell whether a late grant is stale.
+    quint32 lastPossessRequest;
+    // Created with the first deadline, so requests without one cost nothing.
+    // Only touched on the thread of the engine.
+    QTimer *deadlineTimer;
+    // Guards the per-engine request state above. The shared libresource
+    // connection is guarded separately in resource-engine.cpp.
+    QMutex engineMutex;
+    // Dispatches in progress, and whether the engine waits for them to end
+    // to be deleted. Guarded by the connection lock.
+    int references;
+    bool retired;
 };
 
 }
@@ -0,0 +1,143 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include <policy/resource-latency-histogram.h>
+#include <string.h>
+
+using namespace ResourcePolicy;
+
+static const qint64 maxValue = (Q_INT64_C(1) << LatencyHistogram::MaxValueBits) - 1;
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+int LatencyHistogram::bucketOf(qint64 nanoseconds)
+{
+    if (nanoseconds < SubBucketCount)
+        return nanoseconds < 0 ? 0 : (int)nanoseconds;
+    if (nanoseconds > maxValue)
+        nanoseconds = maxValue;
+
+    // Values with their top bit at position e are split on the next
+    // SubBucketBits bits below it.
+    int e = 63 - __builtin_clzll((quint64)nanoseconds);
+    int shift = e - SubBucketBits;
+    return ((shift + 1) << SubBucketBits) + (int)((nanoseconds >> shift) - SubBucketCount);
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < SubBucketCount)
+        return bucket;
+
+    int shift = (bucket >> SubBucketBits) - 1;
+    qint64 subBucket = SubBucketCount + (bucket & (SubBucketCount - 1));
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(qint64 nanoseconds)
+{
+    if (nanoseconds < 0)
+        nanoseconds = 0;
+
+    counts[bucketOf(nanoseconds)]++;
+    if (total == 0 || nanoseconds < min)
+        min = nanoseconds;
+    if (nanoseconds > max)
+        max = nanoseconds;
+    total++;
+    sum += nanoseconds;
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other)
+{
+    if (other.total == 0)
+        return;
+
+    for (int i = 0; i < BucketCount; i++) {
+        counts[i] += other.counts[i];
+    }
+    if (total == 0 || other.min < min)
+        min = other.min;
+    if (other.max > max)
+        max = other.max;
+    total += other.total;
+    sum += other.sum;
+}
+
+void LatencyHistogram::reset()
+{
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    sum = 0;
+    min = 0;
+    max = 0;
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return total;
+}
+
+qint64 LatencyHistogram::minimum() const
+{
+    return min;
+}
+
+qint64 LatencyHistogram::maximum() const
+{
+    return max;
+}
+
+qint64 LatencyHistogram::mean() const
+{
+    return total == 0 ? 0 : sum / (qint64)total;
+}
+
+qint64 LatencyHistogram::percentile(double percent) const
+{
+    if (total == 0)
+        return 0;
+
+    if (percent < 0)
+        percent = 0;
+    if (percent > 100)
+        percent = 100;
+
+    // The rank of the wanted latency, counting from 1.
+    quint64 rank = (quint64)(percent / 100.0 * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > total)
+        rank = total;
+
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            qint64 bound = bucketUpperBound(i);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
@@ -0,0 +1,427 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include <policy/resource-log.h>
+#include "resource-engine.h"
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QThreadStorage>
+#include <QtAlgorithms>
+#include <string.h>
+#include <time.h>
+
+using namespace ResourcePolicy;
+
+extern bool printLogs;
+bool ringLogs = false;
+
+// Ring logging stores the format pointer and a binary copy of the arguments
+// of each message. The formats are literals of the library, so they stay
+// valid; strings are copied, since they are often temporaries.
+enum { LogArgumentsSize = 96 };
+
+// A record is guarded by a sequence lock: its sequence is odd while the
+// owning thread writes it, and a reader keeps its copy only if the sequence
+// was even and did not change while copying. A sequence of 0 means unused.
+struct LogRecord
+{
+    QAtomicInt sequence;
+    qint64 time;
+    quintptr thread;
+    const char *format;
+    int size;
+    char arguments[LogArgumentsSize];
+};
+
+struct LogRing
+{
+    LogRing() : next(0), inUse(true), link(NULL) {}
+
+    LogRecord records[ResourceLog::RingSize];
+    int next;
+    bool inUse;
+    LogRing *link;
+};
+
+// Guards the list of rings, which are never freed, and clearedNs. Threads
+// only take it to get their ring, never to log.
+static QMutex ringsMutex;
+static LogRing *rings = NULL;
+static qint64 clearedNs = 0;
+
+// Hands the ring of a thread back for reuse when the thread exits. Its
+// messages stay readable until another thread takes it over.
+struct LogRingOwner
+{
+    LogRingOwner(LogRing *ring) : ring(ring) {}
+    ~LogRingOwner()
+    {
+        QMutexLocker locker(&ringsMutex);
+        ring->inUse = false;
+    }
+
+    LogRing *ring;
+};
+
+static QThreadStorage<LogRingOwner *> ringOwners;
+
+static inline qint64 monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (qint64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static LogRing *currentRing()
+{
+    if (ringOwners.hasLocalData())
+        return ringOwners.localData()->ring;
+
+    LogRing *ring = NULL;
+    {
+        QMutexLocker locker(&ringsMutex);
+        for (LogRing *unused = rings; unused != NULL; unused = unused->link) {
+            if (!unused->inUse) {
+                ring = unused;
+                break;
+            }
+        }
+        if (ring == NULL) {
+            ring = new LogRing;
+            ring->link = rings;
+            rings = ring;
+        }
+        ring->inUse = true;
+    }
+    ringOwners.setLocalData(new LogRingOwner(ring));
+    return ring;
+}
+
+// One conversion of a printf format, from its '%' up to and including the
+// conversion character. '*' widths and precisions take an int argument
+// each; longs counts the 'l' length modifiers.
+struct Conversion
+{
+    const char *start;
+    const char *end;
+    int stars;
+    int longs;
+    // Only 'L' makes a floating point argument a long double; 'l' is
+    // ignored by the floating point conversions.
+    bool longDouble;
+    char type;
+};
+
+static bool nextConversion(const char *text, Conversion &conversion)
+{
+    const char *p = strchr(text, '%');
+    if (p == NULL)
+        return false;
+
+    conversion.start = p++;
+    conversion.stars = 0;
+    conversion.longs = 0;
+    conversion.longDouble = false;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL)
+        p++;
+    if (*p == '*') {
+        conversion.stars++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9')
+        p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            conversion.stars++;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+    while (*p != '\0' && strchr("hlLqjzt", *p) != NULL) {
+        if (*p == 'q' || *p == 'j')
+            conversion.longs = 2;
+        else if (*p != 'h')
+            conversion.longs++;
+        if (*p == 'L')
+            conversion.longDouble = true;
+        p++;
+    }
+    conversion.type = *p;
+    conversion.end = *p != '\0' ? p + 1 : p;
+    return true;
+}
+
+static bool storeValue(char *buffer, int &size, qint64 value)
+{
+    if (size + (int)sizeof(value) > LogArgumentsSize)
+        return false;
+    memcpy(buffer + size, &value, sizeof(value));
+    size += sizeof(value);
+    return true;
+}
+
+static bool loadValue(const char *buffer, int size, int &used, qint64 &value)
+{
+    if (used + (int)sizeof(value) > size)
+        return false;
+    memcpy(&value, buffer + used, sizeof(value));
+    used += sizeof(value);
+    return true;
+}
+
+// Copies the arguments of format into buffer and returns the bytes used.
+// Arguments that do not fit are dropped together with all that follow.
+static int captureArguments(const char *format, va_list arguments, char *buffer)
+{
+    int size = 0;
+    Conversion conversion;
+    for (const char *text = format; nextConversion(text, conversion); text = conversion.end) {
+        for (int i = 0; i < conversion.stars; i++) {
+            if (!storeValue(buffer, size, va_arg(arguments, int)))
+                return size;
+        }
+
+        qint64 value;
+        switch (conversion.type) {
+        case '%':
+            continue;
+        case 'd': case 'i':
+            if (conversion.longs == 0)
+                value = va_arg(arguments, int);
+            else if (conversion.longs == 1)
+                value = va_arg(arguments, long);
+            else
+                value = va_arg(arguments, long long);
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            if (conversion.longs == 0)
+                value = va_arg(arguments, unsigned int);
+            else if (conversion.longs == 1)
+                value = va_arg(arguments, unsigned long);
+            else
+                value = va_arg(arguments, unsigned long long);
+            break;
+        case 'c':
+            value = va_arg(arguments, int);
+            break;
+        case 'p':
+            value = (quintptr)va_arg(arguments, void *);
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+            double number;
+            if (conversion.longDouble)
+                number = va_arg(arguments, long double);
+            else
+                number = va_arg(arguments, double);
+            memcpy(&value, &number, sizeof(value));
+            break;
+        }
+        case 's': {
+            const char *string = va_arg(arguments, const char *);
+            if (string == NULL)
+                string = "(null)";
+            int room = LogArgumentsSize - size - 1;
+            if (room < 0)
+                return size;
+            int length = strlen(string);
+            if (length > room)
+                length = room;
+            memcpy(buffer + size, string, length);
+            buffer[size + length] = '\0';
+            size += length + 1;
+            continue;
+        }
+        default:
+            // %n and unknown conversions end the capture.
+            return size;
+        }
+
+        if (!storeValue(buffer, size, value))
+            return size;
+    }
+    return size;
+}
+
+static QString formatRecord(const char *format, const char *buffer, int size)
+{
+    QByteArray text;
+    int used = 0;
+    const char *rest = format;
+    Conversion conversion;
+    while (nextConversion(rest, conversion)) {
+        text.append(rest, conversion.start - rest);
+        rest = conversion.end;
+        if (conversion.type == '%') {
+            text.append('%');
+            continue;
+        }
+
+        // Rebuild the conversion with the '*' arguments written out and the
+        // length modifiers replaced to match how the argument was stored.
+        QByteArray spec;
+        for (const char *p = conversion.start; p < conversion.end - 1; p++) {
+            qint64 star;
+            if (*p == '*') {
+                if (!loadValue(buffer, size, used, star)) {
+                    text.append("...");
+                    return QString::fromLocal8Bit(text);
+                }
+                spec.append(QByteArray::number(star));
+            } else if (strchr("hlLqjzt", *p) == NULL) {
+                spec.append(*p);
+            }
+        }
+
+        char piece[256];
+        piece[0] = '\0';
+        qint64 value = 0;
+        if (conversion.type == 's') {
+            if (used >= size) {
+                text.append("...");
+                return QString::fromLocal8Bit(text);
+            }
+            const char *string = buffer + used;
+            used += qstrnlen(string, size - used) + 1;
+            spec.append('s');
+            snprintf(piece, sizeof(piece), spec.constData(), string);
+        } else if (!loadValue(buffer, size, used, value)) {
+            text.append("...");
+            return QString::fromLocal8Bit(text);
+        } else if (strchr("di", conversion.type) != NULL) {
+            spec.append("ll").append(conversion.type);
+            snprintf(piece, sizeof(piece), spec.constData(), (long long)value);
+        } else if (strchr("uoxX", conversion.type) != NULL) {
+            spec.append("ll").append(conversion.type);
+            snprintf(piece, sizeof(piece), spec.constData(), (unsigned long long)value);
+        } else if (conversion.type == 'c') {
+            spec.append('c');
+            snprintf(piece, sizeof(piece), spec.constData(), (int)value);
+        } else if (conversion.type == 'p') {
+            spec.append('p');
+            snprintf(piece, sizeof(piece), spec.constData(), (void *)(quintptr)value);
+        } else {
+            double number;
+            memcpy(&number, &value, sizeof(number));
+            spec.append(conversion.type);
+            snprintf(piece, sizeof(piece), spec.constData(), number);
+        }
+        text.append(piece);
+    }
+    text.append(rest);
+    return QString::fromLocal8Bit(text);
+}
+
+void ResourcePolicy::logToRing(const char *format, ...)
+{
+    LogRing *ring = currentRing();
+    LogRecord &record = ring->records[ring->next];
+    ring->next = (ring->next + 1) % ResourceLog::RingSize;
+
+    record.sequence.fetchAndAddOrdered(1);
+    record.time = monotonicNs();
+    record.thread = (quintptr)QThread::currentThreadId();
+    record.format = format;
+    va_list arguments;
+    va_start(arguments, format);
+    record.size = captureArguments(format, arguments, record.arguments);
+    va_end(arguments);
+    record.sequence.fetchAndAddOrdered(1);
+}
+
+void ResourceLog::setMode(Mode mode)
+{
+    printLogs = mode != Off;
+    ringLogs = mode == Ring;
+}
+
+ResourceLog::Mode ResourceLog::mode()
+{
+    if (!printLogs)
+        return Off;
+    return ringLogs ? Ring : Console;
+}
+
+struct LogEntry
+{
+    qint64 time;
+    quintptr thread;
+    QString text;
+};
+
+static bool logEntryLessThan(const LogEntry &first, const LogEntry &second)
+{
+    return first.time < second.time;
+}
+
+QStringList ResourceLog::records()
+{
+    QList<LogEntry> entries;
+    {
+        QMutexLocker locker(&ringsMutex);
+        for (LogRing *ring = rings; ring != NULL; ring = ring->link) {
+            for (int i = 0; i < RingSize; i++) {
+                LogRecord &record = ring->records[i];
+                int sequence = record.sequence.fetchAndAddOrdered(0);
+                if (sequence == 0 || (sequence & 1) != 0)
+                    continue;
+
+                LogEntry entry;
+                entry.time = record.time;
+                entry.thread = record.thread;
+                const char *format = record.format;
+                int size = qBound(0, record.size, (int)LogArgumentsSize);
+                char arguments[LogArgumentsSize];
+                memcpy(arguments, record.arguments, size);
+
+                // Overwritten while copying, so the copy may be torn.
+                if (record.sequence.fetchAndAddOrdered(0) != sequence || entry.time < clearedNs)
+                    continue;
+
+                entry.text = formatRecord(format, arguments, size);
+                entries.append(entry);
+            }
+        }
+    }
+
+    qStableSort(entries.begin(), entries.end(), logEntryLessThan);
+
+    QStringList lines;
+    for (int i = 0; i < entries.size(); i++) {
+        const LogEntry &entry = entries.at(i);
+        lines << QString("%1.%2 [%3] %4")
+                 .arg(entry.time / 1000000000)
+                 .arg(entry.time % 1000000000 / 1000, 6, 10, QChar('0'))
+                 .arg(entry.thread, 0, 16)
+                 .arg(entry.text);
+    }
+    return lines;
+}
+
+void ResourceLog::clear()
+{
+    QMutexLocker locker(&ringsMutex);
+    clearedNs = monotonicNs();
+}
@@ -0,0 +1,378 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include <policy/resource-request-future.h>
+#include <QSharedData>
+#include <QPointer>
+#include <QByteArray>
+#include <QVector>
+#include <QMutex>
+#include <QMetaObject>
+#include <QCoreApplication>
+#include <QEvent>
+
+using namespace ResourcePolicy;
+
+// The state shared by the copies of a future. A future made by whenAll()
+// is referenced by the futures it waits for, never the other way round, so
+// there are no reference cycles.
+class ResourceRequestFuture::Data: public QSharedData
+{
+public:
+    struct Continuation
+    {
+        QPointer<QObject> receiver;
+        QByteArray member;
+    };
+
+    struct Dependent
+    {
+        QExplicitlySharedDataPointer<Data> all;
+        int index;
+    };
+
+    struct DirectCallback
+    {
+        Callback callback;
+        void *context;
+    };
+
+    // Calls the callbacks of a finished future from the event loop of the
+    // thread it is posted on. They stay registered until then, so that
+    // removeOnFinished() still takes back those of waiters that go away.
+    // An event dropped undelivered, as when the thread ends first, still
+    // calls them as it goes.
+    class QueuedCallbacks: public QEvent
+    {
+    public:
+        explicit QueuedCallbacks(Data *data)
+            : QEvent(QEvent::User), data(data)
+        {
+        }
+
+        ~QueuedCallbacks()
+        {
+            run();
+        }
+
+        void run()
+        {
+            QList<DirectCallback> callbacks;
+            {
+                QMutexLocker locker(&data->mutex);
+                callbacks = data->callbacks;
+                data->callbacks.clear();
+            }
+            for (int i = 0; i < callbacks.size(); i++) {
+                callbacks.at(i).callback(callbacks.at(i).context);
+            }
+        }
+
+    private:
+        QExplicitlySharedDataPointer<Data> data;
+    };
+
+    // The receiver of a QueuedCallbacks event, made for it on the thread
+    // that finishes the future.
+    class QueuedCallbacksReceiver: public QObject
+    {
+    protected:
+        void customEvent(QEvent *event)
+        {
+            static_cast<QueuedCallbacks *>(event)->run();
+            deleteLater();
+        }
+    };
+
+    Data(ResourceRequest request)
+        : request(request), requestNumber(0), result(Pending), pendingParts(0)
+    {
+    }
+
+    QMutex mutex;
+    ResourceRequest request;
+    quint32 requestNumber;
+    Result result;
+    ResourceTypeMask granted;
+    QList<Continuation> continuations;
+    QList<DirectCallback> callbacks;
+    QList<Dependent> dependents;
+    // Of a whenAll() future: the results of its parts, in order.
+    QVector<Result> partResults;
+    int pendingParts;
+};
+
+// Queues the call of a continuation. member is as made by SLOT(), the
+// signature behind a code digit.
+static void invoke(const ResourceRequestFuture &future, QObject *receiver, const QByteArray &member)
+{
+    if (receiver == NULL)
+        return;
+
+    const char *method = member.constData();
+    if (*method >= '0' && *method <= '9')
+        method++;
+    QByteArray signature = QMetaObject::normalizedSignature(method);
+    int paren = signature.indexOf('(');
+    QByteArray name = signature.left(paren);
+
+    bool invoked;
+    if (signature.mid(paren) == "()") {
+        invoked = QMetaObject::invokeMethod(receiver, name.constData(), Qt::QueuedConnection);
+    }
+    else {
+        invoked = QMetaObject::invokeMethod(receiver, name.constData(), Qt::QueuedConnection,
+                                            Q_ARG(ResourcePolicy::ResourceRequestFuture, future));
+    }
+    if (!invoked) {
+        qWarning("ResourceRequestFuture: cannot call %s", signature.constData());
+    }
+}
+
+ResourceRequestFuture::ResourceRequestFuture()
+{
+}
+
+ResourceRequestFuture::ResourceRequestFuture(ResourceRequest request)
+        : d(new Data(request))
+{
+}
+
+ResourceRequestFuture::ResourceRequestFuture(Data *data)
+        : d(data)
+{
+}
+
+ResourceRequestFuture::ResourceRequestFuture(const ResourceRequestFuture &other)
+        : d(other.d)
+{
+}
+
+ResourceRequestFuture::~ResourceRequestFuture()
+{
+}
+
+ResourceRequestFuture &ResourceRequestFuture::operator=(const ResourceRequestFuture &other)
+{
+    d = other.d;
+    return *this;
+}
+
+bool ResourceRequestFuture::operator==(const ResourceRequestFuture &other) const
+{
+    return d == other.d;
+}
+
+bool ResourceRequestFuture::operator!=(const ResourceRequestFuture &other) const
+{
+    return d != other.d;
+}
+
+bool ResourceRequestFuture::isValid() const
+{
+    return d.data() != NULL;
+}
+
+bool ResourceRequestFuture::isFinished() const
+{
+    return result() != Pending;
+}
+
+ResourceRequestFuture::Result ResourceRequestFuture::result() const
+{
+    if (!d)
+        return Canceled;
+    QMutexLocker locker(&d->mutex);
+    return d->result;
+}
+
+bool ResourceRequestFuture::succeeded() const
+{
+    return result() == Succeeded;
+}
+
+ResourceRequest ResourceRequestFuture::request() const
+{
+    return d ? d->request : NumberOfRequests;
+}
+
+quint32 ResourceRequestFuture::requestNumber() const
+{
+    if (!d)
+        return 0;
+    QMutexLocker locker(&d->mutex);
+    return d->requestNumber;
+}
+
+ResourceTypeMask ResourceRequestFuture::grantedOptionalResources() const
+{
+    if (!d)
+        return ResourceTypeMask();
+    QMutexLocker locker(&d->mutex);
+    return d->granted;
+}
+
+void ResourceRequestFuture::then(QObject *receiver, const char *member) const
+{
+    if (receiver == NULL || member == NULL || member[0] == '\0') {
+        qWarning("ResourceRequestFuture::then: no receiver or slot");
+        return;
+    }
+    qRegisterMetaType<ResourcePolicy::ResourceRequestFuture>("ResourcePolicy::ResourceRequestFuture");
+
+    if (d) {
+        QMutexLocker locker(&d->mutex);
+        if (d->result == Pending) {
+            Data::Continuation continuation;
+            continuation.receiver = receiver;
+            continuation.member = member;
+            d->continuations.append(continuation);
+            return;
+        }
+    }
+    invoke(*this, receiver, member);
+}
+
+ResourceRequestFuture ResourceRequestFuture::whenAll(const QList<ResourceRequestFuture> &futures)
+{
+    ResourceRequestFuture all(NumberOfRequests);
+    all.d->partResults.fill(Pending, futures.size());
+    all.d->pendingParts = futures.size() + 1;
+
+    for (int i = 0; i < futures.size(); i++) {
+        Data *part = futures.at(i).d.data();
+        if (part != NULL) {
+            QMutexLocker locker(&part->mutex);
+            if (part->result == Pending) {
+                Data::Dependent dependent;
+                dependent.all = all.d;
+                dependent.index = i;
+                part->dependents.append(dependent);
+                continue;
+            }
+        }
+        partFinished(all.d.data(), i, futures.at(i).result(), false);
+    }
+
+    // The extra part keeps the future from finishing while it is set up.
+    partFinished(all.d.data(), -1, Succeeded, false);
+    return all;
+}
+
+bool ResourceRequestFuture::onFinished(Callback callback, void *context) const
+{
+    if (!d)
+        return false;
+    QMutexLocker locker(&d->mutex);
+    if (d->result != Pending)
+        return false;
+    Data::DirectCallback direct;
+    direct.callback = callback;
+    direct.context = context;
+    d->callbacks.append(direct);
+    return true;
+}
+
+void ResourceRequestFuture::removeOnFinished(Callback callback, void *context) const
+{
+    if (!d)
+        return;
+    QMutexLocker locker(&d->mutex);
+    for (int i = 0; i < d->callbacks.size(); i++) {
+        if (d->callbacks.at(i).callback == callback && d->callbacks.at(i).context == context) {
+            d->callbacks.removeAt(i);
+            return;
+        }
+    }
+}
+
+void ResourceRequestFuture::setRequestNumber(quint32 requestNumber)
+{
+    if (!d)
+        return;
+    QMutexLocker locker(&d->mutex);
+    d->requestNumber = requestNumber;
+}
+
+void ResourceRequestFuture::finish(Result result, const ResourceTypeMask &granted,
+                                   bool queueCallbacks)
+{
+    if (!d)
+        return;
+
+    QList<Data::Continuation> continuations;
+    QList<Data::Dependent> dependents;
+    QList<Data::DirectCallback> callbacks;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->result != Pending)
+            return;
+        d->result = result;
+        d->granted = granted;
+        continuations = d->continuations;
+        d->continuations.clear();
+        dependents = d->dependents;
+        d->dependents.clear();
+        if (!queueCallbacks) {
+            callbacks = d->callbacks;
+            d->callbacks.clear();
+        }
+        else if (!d->callbacks.isEmpty()) {
+            QCoreApplication::postEvent(new Data::QueuedCallbacksReceiver,
+                                        new Data::QueuedCallbacks(d.data()));
+        }
+    }
+
+    // A callback may destroy the object this was called on, so go on with
+    // a copy.
+    ResourceRequestFuture self(*this);
+    for (int i = 0; i < callbacks.size(); i++) {
+        callbacks.at(i).callback(callbacks.at(i).context);
+    }
+
+    for (int i = 0; i < continuations.size(); i++) {
+        invoke(self, continuations.at(i).receiver, continuations.at(i).member);
+    }
+    for (int i = 0; i < dependents.size(); i++) {
+        partFinished(dependents.at(i).all.data(), dependents.at(i).index, result, queueCallbacks);
+    }
+}
+
+void ResourceRequestFuture::partFinished(Data *all, int index, Result result, bool queueCallbacks)
+{
+    Result allResult = Succeeded;
+    {
+        QMutexLocker locker(&all->mutex);
+        if (index >= 0)
+            all->partResults[index] = result;
+        if (--all->pendingParts > 0)
+            return;
+
+        for (int i = 0; i < all->partResults.size(); i++) {
+            if (all->partResults.at(i) != Succeeded) {
+                allResult = all->partResults.at(i);
+                break;
+            }
+        }
+    }
+    ResourceRequestFuture future(all);
+    future.finish(allResult, ResourceTypeMask(), queueCallbacks);
+}
@@ -0,0 +1,266 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef RESOURCE_REQUEST_TRACKER_H
+#define RESOURCE_REQUEST_TRACKER_H
+
+#include <QtGlobal>
+#include <res-conn.h>
+#include <string.h>
+
+namespace ResourcePolicy {
+
+// The requests of a ResourceEngine that have been sent and not yet
+// answered, by request number. Kept in a ring of Capacity entries indexed
+// by the request number modulo Capacity, so tracking needs no allocation and
+// its size is bounded however long the set lives. Request numbers of an
+// engine only grow: a request still unanswered when the request Capacity
+// numbers younger is sent takes the same entry, and is given up as lost;
+// insert() reports it, so that the engine can fail it. Pipelined sets, which
+// may have more than Capacity requests out, ask hasRoomFor() first and hold
+// their requests back until the entry is free.
+//
+// Besides the type of each request, an entry keeps the monotonic send time
+// for the latency histograms (0 once recorded), whether the set had
+// resources granted when it was sent, and the monotonic deadline by which
+// the request must be answered (0 for none). A request whose deadline has
+// passed is abandoned: its entry stays as a tombstone, so that a late
+// answer is recognised and dropped instead of taken for another request's.
+// Likewise an update or release answered by its status is kept as answered
+// until the grant that may follow it, but no longer counted as outstanding.
+class RequestTracker
+{
+public:
+    enum { Capacity = 64 };
+
+    RequestTracker()
+    {
+        clear();
+    }
+
+    // Returns true if the entry of the request held another request still
+    // waiting for an answer, whose number and type are then stored in
+    // evictedNo and evictedType.
+    bool insert(quint32 requestNo, resmsg_type_t type, qint64 sentNs = 0, bool hadGrants = false,
+                quint32 *evictedNo = NULL, resmsg_type_t *evictedType = NULL)
+    {
+        Entry &entry = entries[requestNo % Capacity];
+        bool evicted = entry.used && !entry.abandoned && !entry.answered;
+        if (evicted) {
+            if (evictedNo != NULL)
+                *evictedNo = entry.requestNo;
+            if (evictedType != NULL)
+                *evictedType = entry.type;
+        }
+        else {
+            count++;
+        }
+        entry.requestNo = requestNo;
+        entry.type = type;
+        entry.sentNs = sentNs;
+        entry.deadlineNs = 0;
+        entry.used = true;
+        entry.hadGrants = hadGrants;
+        entry.abandoned = false;
+        entry.answered = false;
+        return evicted;
+    }
+
+    // Whether the request can be inserted without giving up one that is
+    // still waiting for an answer.
+    bool hasRoomFor(quint32 requestNo) const
+    {
+        const Entry &entry = entries[requestNo % Capacity];
+        return !entry.used || entry.abandoned || entry.answered || entry.requestNo == requestNo;
+    }
+
+    bool contains(quint32 requestNo) const
+    {
+        return find(requestNo) != NULL;
+    }
+
+    // The type of the request, or resmsg_type_t() if it is not outstanding.
+    resmsg_type_t value(quint32 requestNo) const
+    {
+        const Entry *entry = find(requestNo);
+        return entry != NULL ? entry->type : resmsg_type_t();
+    }
+
+    resmsg_type_t take(quint32 requestNo)
+    {
+        resmsg_type_t type = value(requestNo);
+        remove(requestNo);
+        return type;
+    }
+
+    void remove(quint32 requestNo)
+    {
+        Entry *entry = find(requestNo);
+        if (entry != NULL) {
+            if (!entry->abandoned && !entry->answered)
+                count--;
+            entry->used = false;
+        }
+    }
+
+    void clear()
+    {
+        memset(entries, 0, sizeof(entries));
+        count = 0;
+    }
+
+    qint64 sentNs(quint32 requestNo) const
+    {
+        const Entry *entry = find(requestNo);
+        return entry != NULL ? entry->sentNs : 0;
+    }
+
+    void clearSentNs(quint32 requestNo)
+    {
+        Entry *entry = find(requestNo);
+        if (entry != NULL)
+            entry->sentNs = 0;
+    }
+
+    bool hadGrants(quint32 requestNo) const
+    {
+        const Entry *entry = find(requestNo);
+        return entry != NULL && entry->hadGrants;
+    }
+
+    void setDeadline(quint32 requestNo, qint64 deadlineNs)
+    {
+        Entry *entry = find(requestNo);
+        if (entry != NULL)
+            entry->deadlineNs = deadlineNs;
+    }
+
+    // Marks the request as answered, while keeping its entry to recognise
+    // an answer that may still follow.
+    void answer(quint32 requestNo)
+    {
+        Entry *entry = find(requestNo);
+        if (entry != NULL && !entry->abandoned && !entry->answered) {
+            entry->answered = true;
+            entry->deadlineNs = 0;
+            count--;
+        }
+    }
+
+    bool isAnswered(quint32 requestNo) const
+    {
+        const Entry *entry = find(requestNo);
+        return entry != NULL && entry->answered;
+    }
+
+    // The earliest deadline of the requests that are not abandoned, or 0.
+    qint64 nextDeadline() const
+    {
+        qint64 next = 0;
+        for (int i = 0; i < Capacity; i++) {
+            const Entry &entry = entries[i];
+            if (entry.used && !entry.abandoned && entry.deadlineNs != 0 &&
+                (next == 0 || entry.deadlineNs < next))
+                next = entry.deadlineNs;
+        }
+        return next;
+    }
+
+    // Abandons the requests whose deadline is at or before now. Their
+    // numbers go to requestNos, oldest first; returns how many there are.
+    int abandonExpired(qint64 now, quint32 requestNos[Capacity])
+    {
+        int expired = 0;
+        for (int i = 0; i < Capacity; i++) {
+            Entry &entry = entries[i];
+            if (!entry.used || entry.abandoned || entry.deadlineNs == 0 || entry.deadlineNs > now)
+                continue;
+            entry.abandoned = true;
+            entry.deadlineNs = 0;
+            entry.sentNs = 0;
+            count--;
+            int at = expired++;
+            for (; at > 0 && requestNos[at - 1] > entry.requestNo; at--) {
+                requestNos[at] = requestNos[at - 1];
+            }
+            requestNos[at] = entry.requestNo;
+        }
+        return expired;
+    }
+
+    void abandon(quint32 requestNo)
+    {
+        Entry *entry = find(requestNo);
+        if (entry != NULL && !entry->abandoned) {
+            entry->abandoned = true;
+            if (!entry->answered)
+                count--;
+            entry->answered = false;
+            entry->deadlineNs = 0;
+            entry->sentNs = 0;
+        }
+    }
+
+    bool isAbandoned(quint32 requestNo) const
+    {
+        const Entry *entry = find(requestNo);
+        return entry != NULL && entry->abandoned;
+    }
+
+    // The number of requests waiting for an answer, abandoned and answered
+    // ones aside.
+    int outstanding() const
+    {
+        return count;
+    }
+
+private:
+    struct Entry
+    {
+        quint32 requestNo;
+        resmsg_type_t type;
+        qint64 sentNs;
+        qint64 deadlineNs;
+        bool used;
+        bool hadGrants;
+        bool abandoned;
+        bool answered;
+    };
+
+    Entry *find(quint32 requestNo)
+    {
+        Entry &entry = entries[requestNo % Capacity];
+        return entry.used && entry.requestNo == requestNo ? &entry : NULL;
+    }
+
+    const Entry *find(quint32 requestNo) const
+    {
+        const Entry &entry = entries[requestNo % Capacity];
+        return entry.used && entry.requestNo == requestNo ? &entry : NULL;
+    }
+
+    Entry entries[Capacity];
+    int count;
+};
+
+}
+
+#endif
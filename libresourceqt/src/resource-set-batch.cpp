@@ -0,0 +1,149 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include <policy/resource-set-batch.h>
+#include "resource-engine.h"
+
+using namespace ResourcePolicy;
+
+extern bool printLogs;
+
+ResourceSetBatch::ResourceSetBatch(QObject *parent)
+        : QObject(parent)
+{
+}
+
+ResourceSetBatch::~ResourceSetBatch()
+{
+}
+
+void ResourceSetBatch::addResourceSet(ResourceSet *resourceSet)
+{
+    if (resourceSet == NULL || sets.contains(resourceSet))
+        return;
+
+    sets.append(resourceSet);
+
+    QObject::connect(resourceSet, SIGNAL(destroyed(QObject *)),
+                     this, SLOT(handleSetDestroyed(QObject *)));
+}
+
+void ResourceSetBatch::removeResourceSet(ResourceSet *resourceSet)
+{
+    if (!sets.removeOne(resourceSet))
+        return;
+
+    resourceSet->disconnect(this);
+    setAnswered(resourceSet);
+}
+
+QList<ResourceSet *> ResourceSetBatch::resourceSets() const
+{
+    return sets;
+}
+
+bool ResourceSetBatch::acquire()
+{
+    return request(Acquire);
+}
+
+bool ResourceSetBatch::release()
+{
+    return request(Release);
+}
+
+bool ResourceSetBatch::update()
+{
+    return request(Update);
+}
+
+bool ResourceSetBatch::isPending() const
+{
+    return !awaitingReply.isEmpty();
+}
+
+// The future of each request tells when the set is done with it, also for
+// requests that get no signal of the set: merged into another request,
+// queued behind one, or answered without alwaysReply.
+bool ResourceSetBatch::request(requestType theRequest)
+{
+    LOG_DEBUG("ResourceSetBatch::%s(%d) - %d sets", __FUNCTION__, theRequest, sets.size());
+
+    awaitingReply.clear();
+
+    bool success = true;
+    ResourceEngine::beginBatch();
+    for (int i = 0; i < sets.size(); i++) {
+        ResourceSet *resourceSet = sets.at(i);
+        ResourceRequestFuture future;
+        switch (theRequest) {
+        case Acquire: future = resourceSet->acquireAsync(); break;
+        case Update:  future = resourceSet->updateAsync();  break;
+        case Release: future = resourceSet->releaseAsync(); break;
+        }
+        if (future.result() == ResourceRequestFuture::Failed)
+            success = false;
+        awaitingReply.insert(resourceSet, future);
+        //Queued, so it never runs from inside this loop.
+        future.then(this, SLOT(handleRequestFinished(ResourcePolicy::ResourceRequestFuture)));
+    }
+    success = ResourceEngine::endBatch() && success;
+
+    if (awaitingReply.isEmpty()) {
+        emit finished();
+    }
+    return success;
+}
+
+void ResourceSetBatch::setAnswered(ResourceSet *resourceSet)
+{
+    if (awaitingReply.remove(resourceSet) == 0)
+        return;
+
+    LOG_DEBUG("ResourceSetBatch::%s(%d) - %d sets left", __FUNCTION__,
+              resourceSet->id(), awaitingReply.size());
+    if (awaitingReply.isEmpty()) {
+        emit finished();
+    }
+}
+
+// Only the latest request of a set counts; the futures of earlier ones, and
+// of sets removed meanwhile, are not in awaitingReply.
+void ResourceSetBatch::handleRequestFinished(ResourcePolicy::ResourceRequestFuture future)
+{
+    QHash<ResourceSet *, ResourceRequestFuture>::iterator i;
+    for (i = awaitingReply.begin(); i != awaitingReply.end(); ++i) {
+        if (i.value() == future) {
+            setAnswered(i.key());
+            return;
+        }
+    }
+}
+
+void ResourceSetBatch::handleSetDestroyed(QObject *object)
+{
+    // The set is already gone, so only its address may be used here.
+    ResourceSet *resourceSet = static_cast<ResourceSet *>(object);
+    sets.removeOne(resourceSet);
+    if (awaitingReply.remove(resourceSet) > 0 && awaitingReply.isEmpty()) {
+        emit finished();
+    }
+}
@@ -19,30 +19,123 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
 USA.
 *************************************************************************/
 #include <policy/resource-set.h>
+#include <policy/resource-log.h>
 #include "resource-engine.h"
+#include <QCoreApplication>
+#include <QEvent>
+#include <QMetaMethod>
+#include <QPointer>
+#include <QSharedData>
+#include <QThread>
+#include <QWaitCondition>
+#include <limits.h>
+#include <string.h>
 using namespace ResourcePolicy;
 
-static quint32 resourceSetId=1;
+// Sets may be created from several threads, so hand out ids atomically.
+static QAtomicInt resourceSetId(1);
 
 class ResourceSetPrivate
 {
 public:
     ResourceSetPrivate();
+    ~ResourceSetPrivate();
+
+    struct QueuedRequest
+    {
+        ResourceSet::requestType type;
+        int timeoutMs;
+        // The number the engine sent the request as, 0 until then.
+        quint32 requestNo;
+        // Of the *Async() calls made for this request, if any.
+        ResourceRequestFuture future;
+    };
+
+    // The requests made and not yet answered, oldest first. Unless the set
+    // is pipelined only the first one is in flight.
+    QVector<QueuedRequest> requests;
+    bool pipelined;
+    // Whether queued requests are merged, see coalesceRequest(), and how
+    // many were merged away.
+    bool coalesceRequests;
+    quint32 coalescedRequestCount;
+
+    // Allocated on the first answer. Guarded by its own mutex, because the
+    // engine records answers while ResourceSet methods may hold reqMutex.
+    LatencyHistogram *latencyHistograms;
+    QMutex latencyMutex;
+    // The libresource bitmask of the resources in the set, kept up to date
+    // so that the grant path only visits the resources that are there.
+    quint32 allMask;
+    // Whether the signals with a QList argument have ever been connected.
+    // Asking receivers() allocates, so the grant path asks these instead.
+    bool grantedListConnected;
+    bool availableListConnected;
+    // The future of the *Async() call being made, until the request
+    // takes it, see takeRequestFuture().
+    ResourceRequestFuture *requestFuture;
+    // Of the acquires and updates that wait for the connection.
+    ResourceRequestFuture pendingAcquireFuture;
+    ResourceRequestFuture pendingUpdateFuture;
+    // The earliest timeout given to the acquires and updates that wait for
+    // the connection, 0 for none.
+    int pendingAcquireTimeoutMs;
+    int pendingUpdateTimeoutMs;
+    // The acquires asked for since the last release was, to tell whether
+    // the grant of a blocking acquire whose caller gave up is wanted by
+    // anyone else.
+    int acquiresSinceRelease;
 };
 
+// Merges the timeout of a request into that of the pending request it joins,
+// like coalesceRequest() does for queued ones.
+static void keepEarlierTimeout(int &pendingTimeoutMs, int timeoutMs)
+{
+    if ( timeoutMs > 0 && ( pendingTimeoutMs <= 0 || timeoutMs < pendingTimeoutMs ) )
+        pendingTimeoutMs = timeoutMs;
+}
+
+ResourceSetPrivate::ResourceSetPrivate()
+        : pipelined(false), coalesceRequests(false), coalescedRequestCount(0),
+          latencyHistograms(NULL), allMask(0), grantedListConnected(false),
+          availableListConnected(false), requestFuture(NULL), pendingAcquireTimeoutMs(0),
+          pendingUpdateTimeoutMs(0), acquiresSinceRelease(0)
+{
+}
+
+ResourceSetPrivate::~ResourceSetPrivate()
+{
+    delete [] latencyHistograms;
+}
+
 bool printLogs = false;
 
+// DEBUG=ring keeps the log in ring buffers, any other value prints it.
+static void logModeFromEnvironment()
+{
+    const char *debug = getenv("DEBUG");
+    if (debug != NULL) {
+        ResourceLog::setMode(strcmp(debug, "ring") == 0 ? ResourceLog::Ring : ResourceLog::Console);
+    }
+}
+
+// The public ResourceRequest of each requestType, as also used in the trace.
+static const ResourceRequest publicRequests[] = { AcquireRequest, UpdateRequest, ReleaseRequest };
+
 ResourceSet::ResourceSet(const QString &applicationClass, QObject * parent,
                          bool initialAlwaysReply, bool initialAutoRelease)
         : QObject(parent), resourceClass(applicationClass), resourceEngine(NULL),
         audioResource(NULL), autoRelease(initialAutoRelease),
         alwaysReply(initialAlwaysReply), initialized(false), pendingAcquire(false),
         pendingUpdate(false), pendingAudioProperties(false), pendingVideoProperties(false),
-        inAcquireMode(false), reqMutex(QMutex::Recursive), ignoreQ(false)
+        inAcquireMode(false), reqMutex(QMutex::Recursive), ignoreQ(false),
+        d(new ResourceSetPrivate)
 {
-    identifier = resourceSetId++;
+    identifier = resourceSetId.fetchAndAddOrdered(1);
+    qRegisterMetaType<ResourcePolicy::ResourceTypeMask>("ResourcePolicy::ResourceTypeMask");
+    qRegisterMetaType<ResourcePolicy::ResourceRequest>("ResourcePolicy::ResourceRequest");
     memset(resourceSet, 0, sizeof(Resource *)*NumberOfTypes);
-    if ( NULL != getenv("DEBUG") ) printLogs = true;
+    logModeFromEnvironment();
 }
 
 ResourceSet::ResourceSet(const QString &applicationClass, QObject * parent)
@@ -50,24 +143,41 @@ ResourceSet::ResourceSet(const QString &applicationClass, QObject * parent)
         audioResource(NULL), autoRelease(false),
         alwaysReply(false), initialized(false), pendingAcquire(false),
         pendingUpdate(false), pendingAudioProperties(false), pendingVideoProperties(false),
-        inAcquireMode(false), reqMutex(QMutex::Recursive), ignoreQ(false)
+        inAcquireMode(false), reqMutex(QMutex::Recursive), ignoreQ(false),
+        d(new ResourceSetPrivate)
 {
-    identifier = resourceSetId++;
+    identifier = resourceSetId.fetchAndAddOrdered(1);
+    qRegisterMetaType<ResourcePolicy::ResourceTypeMask>("ResourcePolicy::ResourceTypeMask");
+    qRegisterMetaType<ResourcePolicy::ResourceRequest>("ResourcePolicy::ResourceRequest");
     memset(resourceSet, 0, sizeof(Resource *)*NumberOfTypes);
-    if ( NULL != getenv("DEBUG") ) printLogs = true;
+    logModeFromEnvironment();
 }
 
 ResourceSet::~ResourceSet()
 {
     LOG_DEBUG("ResourceSet::%s(%d)", __FUNCTION__, identifier);
+    // The engine outlives the set until the manager has answered the
+    // unregistration; what it gets meanwhile must not reach the set.
+    if (resourceEngine != NULL) {
+        resourceEngine->detachFromSet();
+    }
     for (int i = 0;i < NumberOfTypes;i++) {
         delete resourceSet[i];
     }
+    //Code waiting on the futures must not run against the half-destroyed
+    //set, so it is resumed from the event loop.
+    for (int i = 0; i < d->requests.size(); i++) {
+        d->requests[i].future.finish(ResourceRequestFuture::Canceled, ResourceTypeMask(), true);
+    }
+    d->requests.clear();
+    d->pendingAcquireFuture.finish(ResourceRequestFuture::Canceled, ResourceTypeMask(), true);
+    d->pendingUpdateFuture.finish(ResourceRequestFuture::Canceled, ResourceTypeMask(), true);
     if(resourceEngine != NULL) {
         LOG_DEBUG("ResourceSet::%s(%d) - resourceEngine->disconnectFromManager()", __FUNCTION__, identifier);
         resourceEngine->disconnect(this);
         resourceEngine->disconnectFromManager();
     }
+    delete d;
     LOG_DEBUG("ResourceSet::%s(%d) - deleted!", __FUNCTION__, identifier);
 }
 
@@ -79,22 +189,26 @@ bool ResourceSet::initialize()
     }
     QObject::connect(resourceEngine, SIGNAL(connectedToManager()),
                      this, SLOT(connectedHandler()));
-    QObject::connect(resourceEngine, SIGNAL(resourcesGranted(quint32)),
-                     this, SLOT(handleGranted(quint32)));
-    QObject::connect(resourceEngine, SIGNAL(resourcesDenied()),
-                     this, SLOT(handleDeny()));
-    QObject::connect(resourceEngine, SIGNAL(resourcesReleased()),
-                     this, SLOT(handleReleased()));
+    QObject::connect(resourceEngine, SIGNAL(resourcesGranted(quint32, quint32)),
+                     this, SLOT(handleGranted(quint32, quint32)));
+    QObject::connect(resourceEngine, SIGNAL(resourcesDenied(quint32)),
+                     this, SLOT(handleDeny(quint32)));
+    QObject::connect(resourceEngine, SIGNAL(resourcesReleased(quint32)),
+                     this, SLOT(handleReleased(quint32)));
     QObject::connect(resourceEngine, SIGNAL(resourcesLost(quint32)),
                      this, SLOT(handleResourcesLost(quint32)));
     QObject::connect(resourceEngine, SIGNAL(resourcesBecameAvailable(quint32)),
                      this, SLOT(handleResourcesBecameAvailable(quint32)));
-    QObject::connect(resourceEngine, SIGNAL(errorCallback(quint32, const char*)),
-                     this, SIGNAL(errorCallback(quint32, const char*)));
+    QObject::connect(resourceEngine, SIGNAL(errorCallback(quint32, const QByteArray &)),
+                     this, SLOT(handleError(quint32, const QByteArray &)));
     QObject::connect(resourceEngine, SIGNAL(resourcesReleasedByManager()),
                      this, SLOT(handleReleasedByManager()));
-    QObject::connect(resourceEngine, SIGNAL(updateOK(bool)),
-                     this, SLOT(handleUpdateOK(bool)));
+    QObject::connect(resourceEngine, SIGNAL(updateOK(bool, quint32)),
+                     this, SLOT(handleUpdateOK(bool, quint32)));
+    QObject::connect(resourceEngine, SIGNAL(requestTimedOut(ResourcePolicy::ResourceRequest, quint32)),
+                     this, SLOT(handleRequestTimedOut(ResourcePolicy::ResourceRequest, quint32)));
+    QObject::connect(resourceEngine, SIGNAL(requestFailed(ResourcePolicy::ResourceRequest, quint32)),
+                     this, SLOT(handleRequestFailed(ResourcePolicy::ResourceRequest, quint32)));
 
     LOG_DEBUG("initializing resource engine...");
     if (!resourceEngine->initialize()) {
@@ -119,6 +233,8 @@ void ResourceSet::addResourceObject(Resource *resource)
     delete resourceSet[resource->type()];
     resourceSet[resource->type()] = resource;
 
+    d->allMask |= resourceTypeToLibresourceType(resource->type());
+
     if ( resource->type() == AudioPlaybackType ) {
 
         LOG_DEBUG("**************** ResourceSet::%s(%d).... %d", __FUNCTION__,this->id(), __LINE__);
@@ -230,6 +346,7 @@ void ResourceSet::deleteResource(ResourceType type)
     }
     delete resourceSet[type];
     resourceSet[type] = NULL;
+    d->allMask &= ~resourceTypeToLibresourceType(type);
 
     if (resourceEngine &&
        (resourceEngine->isConnectedToManager() || resourceEngine->isConnectingToManager()) )
@@ -306,26 +423,56 @@ bool ResourceSet::initAndConnect()
 }
 
 
-bool ResourceSet::proceedIfImFirst( requestType theRequest )
+bool ResourceSet::proceedIfImFirst( requestType theRequest, int timeoutMs )
 {
-    if  (!ignoreQ)
-        requestQ.push_back( theRequest );
+    ResourceRequestFuture *future = takeRequestFuture();
+    ResourceSetPrivate::QueuedRequest queued;
+    queued.type = theRequest;
+    queued.timeoutMs = timeoutMs;
+    queued.requestNo = 0;
+    if (future != NULL)
+        queued.future = *future;
+
+    if (d->pipelined)
+    {
+        // Send right away, unless the engine cannot track another request
+        // or earlier ones are held back already; sendHeldRequests() sends
+        // those in order once answers make room.
+        bool holdBack = ( !d->requests.isEmpty() && d->requests.last().requestNo == 0 ) ||
+                        !resourceEngine->hasRoomForRequest();
+        d->requests.push_back( queued );
+        RESOURCE_TRACE3(enqueue, identifier, publicRequests[theRequest], d->requests.size());
+        if ( holdBack ) {
+            LOG_DEBUG("ResourceSet::%s()...holding back request %d.", __FUNCTION__, d->requests.size());
+            return false;
+        }
+        LOG_DEBUG("ResourceSet::%s()...pipelining request %d.", __FUNCTION__, d->requests.size());
+        return true;
+    }
+
+    if ( d->coalesceRequests && !ignoreQ && coalesceRequest( theRequest, timeoutMs, future ) )
+        return false;
+
+    if  (!ignoreQ) {
+        d->requests.push_back( queued );
+        RESOURCE_TRACE3(enqueue, identifier, publicRequests[theRequest], d->requests.size());
+    }
     else
     {
-        LOG_DEBUG("ResourceSet::%s()...executing first request of %d.", __FUNCTION__, requestQ.size() );
+        LOG_DEBUG("ResourceSet::%s()...executing first request of %d.", __FUNCTION__, d->requests.size() );
         return true;
     }
 
     //Execute if this is the first request or the next is run from slot.
-    if ( requestQ.size() == 1  )
+    if ( d->requests.size() == 1  )
     {
         if (!ignoreQ) { LOG_DEBUG("ResourceSet::%s()...allowing only request directly.", __FUNCTION__); }
         return true;
     }
 
-    if ( requestQ.size() > 1 )
+    if ( d->requests.size() > 1 )
     {
-        LOG_DEBUG("ResourceSet::%s()...queuing request %d.", __FUNCTION__, requestQ.size());
+        LOG_DEBUG("ResourceSet::%s()...queuing request %d.", __FUNCTION__, d->requests.size());
 
         switch (theRequest)
         {
@@ -342,42 +489,122 @@ bool ResourceSet::proceedIfImFirst( requestType theRequest )
 }
 
 
-void ResourceSet::executeNextRequest()
+// Folds theRequest into the requests that are queued but not yet sent. The
+// first entry of d->requests is the one in flight, so only the tail beyond it
+// may be touched. Returns true if theRequest needs no message of its own.
+bool ResourceSet::coalesceRequest( requestType theRequest, int timeoutMs, ResourceRequestFuture *future )
+{
+    if ( d->requests.size() < 2 )
+        return false;
+
+    requestType lastReq = d->requests.last().type;
+
+    if ( lastReq == theRequest )
+    {
+        //An update sends the set as it is when the update goes out, so one
+        //queued update covers any number of them. Repeated acquires and
+        //releases change nothing. The shorter deadline applies.
+        LOG_DEBUG("ResourceSet::%s()...merging request %d into the queued one.", __FUNCTION__, theRequest);
+        ResourceSetPrivate::QueuedRequest &queued = d->requests.last();
+        if ( timeoutMs > 0 && ( queued.timeoutMs <= 0 || timeoutMs < queued.timeoutMs ) )
+            queued.timeoutMs = timeoutMs;
+        //Both callers wait for the same answer.
+        if ( future != NULL ) {
+            if ( queued.future.isValid() )
+                *future = queued.future;
+            else
+                queued.future = *future;
+        }
+        d->coalescedRequestCount += 1;
+        return true;
+    }
+
+    if ( (lastReq == Acquire && theRequest == Release) ||
+         (lastReq == Release && theRequest == Acquire) )
+    {
+        LOG_DEBUG("ResourceSet::%s()...request %d cancels the queued %d.", __FUNCTION__, theRequest, lastReq);
+        ResourceRequestFuture cancelled = d->requests.last().future;
+        d->requests.remove( d->requests.size() - 1 );
+        //The set now ends up as the request before the cancelled one leaves
+        //it, so the caller waits for that.
+        if ( future != NULL ) {
+            ResourceSetPrivate::QueuedRequest &previous = d->requests.last();
+            if ( previous.future.isValid() )
+                *future = previous.future;
+            else
+                previous.future = *future;
+        }
+        d->coalescedRequestCount += 2;
+        cancelled.finish( ResourceRequestFuture::Canceled );
+        return true;
+    }
+
+    return false;
+}
+
+// The position in d->requests of the request the engine sent as requestNo, or
+// -1 if it is not queued, as for answers the set did not ask for.
+int ResourceSet::findRequest(quint32 requestNo) const
+{
+    if ( requestNo == 0 )
+        return -1;
+    for (int i = 0; i < d->requests.size(); i++) {
+        if ( d->requests.at(i).requestNo == requestNo )
+            return i;
+    }
+    return -1;
+}
+
+void ResourceSet::executeNextRequest(quint32 answeredRequestNo)
 {
     LOG_DEBUG("ResourceSet::%s().", __FUNCTION__);
 
-    if ( requestQ.isEmpty() )
+    int at = findRequest(answeredRequestNo);
+    if ( at < 0 )
     {
-        LOG_DEBUG("ResourceSet::%s()...the completed request is not present.",
-               __FUNCTION__);
+        LOG_DEBUG("ResourceSet::%s()...the completed request %u is not present.",
+               __FUNCTION__, answeredRequestNo);
         return;
     }
 
-    requestQ.removeFirst(); //Remove completed request.
+    RESOURCE_TRACE3(dequeue, identifier, publicRequests[d->requests.at(at).type], d->requests.size() - 1);
+    d->requests.remove(at); //Remove completed request.
 
-    if ( requestQ.isEmpty() )
+    if ( d->pipelined )
+    {
+        LOG_DEBUG("ResourceSet::%s()...%d pipelined requests queued.", __FUNCTION__, d->requests.size());
+        sendHeldRequests();
+        return;
+    }
+
+    //Only the first request is in flight, the others wait for it.
+    if ( at != 0 || d->requests.isEmpty() )
     {
         LOG_DEBUG("ResourceSet::%s()...last request acknowledged and removed.", __FUNCTION__);
         return;
     }
 
-    requestType nxtReq = requestQ.at(0);
+    ResourceSetPrivate::QueuedRequest nxtReq = d->requests.at(0);
 
     //Ensure that proceedIfimFirst() lets through.
+    QPointer<ResourceSet> alive(this);
     ignoreQ = true;
     //Having recursive mutexes, because it is taken again in proceedIfImFirst.
-    LOG_DEBUG("ResourceSet::%s()...executing first request of %d.", __FUNCTION__, requestQ.size() );
+    LOG_DEBUG("ResourceSet::%s()...executing first request of %d.", __FUNCTION__, d->requests.size() );
 
-    switch (nxtReq)
+    switch (nxtReq.type)
     {
-    case Acquire: LOG_DEBUG("ResourceSet::%s()...Acquire.", __FUNCTION__); this->acquire();  break;
-    case Update:  LOG_DEBUG("ResourceSet::%s()...Update.",  __FUNCTION__); this->update();   break;
-    case Release: LOG_DEBUG("ResourceSet::%s()...Release.", __FUNCTION__); this->release();  break;
+    case Acquire: LOG_DEBUG("ResourceSet::%s()...Acquire.", __FUNCTION__); this->acquire(nxtReq.timeoutMs);  break;
+    case Update:  LOG_DEBUG("ResourceSet::%s()...Update.",  __FUNCTION__); this->update(nxtReq.timeoutMs);   break;
+    case Release: LOG_DEBUG("ResourceSet::%s()...Release.", __FUNCTION__); this->release(nxtReq.timeoutMs);  break;
     }
 
+    //A failed send finishes requests, whose waiters may delete the set.
+    if (alive.isNull())
+        return;
     ignoreQ = false;
 
-    //Q_ASSERT_X(0, "executeNextRequest", "should not happen since requestQ.isEmpty() was false.");
+    //Q_ASSERT_X(0, "executeNextRequest", "should not happen since d->requests.isEmpty() was false.");
 
 }
 
@@ -385,10 +612,27 @@ void ResourceSet::executeNextRequest()
 
 bool ResourceSet::acquire()
 {
+    return acquire(0);
+}
+
+bool ResourceSet::acquire(int timeoutMs)
+{
+    //Queued requests sent by executeNextRequest() were counted when made.
+    if ( !ignoreQ )
+        d->acquiresSinceRelease++;
 
     if ( !initialized || !resourceEngine->isConnectedToManager() )
     {
         pendingAcquire = true;
+        keepEarlierTimeout(d->pendingAcquireTimeoutMs, timeoutMs);
+        //Acquires made before the connection is up are sent as one.
+        ResourceRequestFuture *future = takeRequestFuture();
+        if ( future != NULL ) {
+            if ( d->pendingAcquireFuture.isValid() && !d->pendingAcquireFuture.isFinished() )
+                *future = d->pendingAcquireFuture;
+            else
+                d->pendingAcquireFuture = *future;
+        }
         return initAndConnect();
     }
     else
@@ -405,43 +649,384 @@ bool ResourceSet::acquire()
             if ( inAcquireMode ) return true;
         }*/
 
-        if ( !proceedIfImFirst( Acquire ) ) return true;
+        if ( !proceedIfImFirst( Acquire, timeoutMs ) ) return true;
 
         LOG_DEBUG("ResourceSet::%s().... acquiring", __FUNCTION__);
-        return resourceEngine->acquireResources();
+        return sendRequest( Acquire, timeoutMs );
 
     }
 }
 
 bool ResourceSet::release()
 {
+    return release(0);
+}
+
+bool ResourceSet::release(int timeoutMs)
+{
+    if ( !ignoreQ )
+        d->acquiresSinceRelease = 0;
     if (!initialized || !resourceEngine->isConnectedToManager()) {
+        //Nothing is held without a connection, so the release is done at
+        //once and has no timeout to keep. It takes back an acquire still
+        //waiting for the connection, which would otherwise be sent after it.
+        if (pendingAcquire) {
+            pendingAcquire = false;
+            d->pendingAcquireTimeoutMs = 0;
+            d->pendingAcquireFuture.finish(ResourceRequestFuture::Canceled);
+            d->pendingAcquireFuture = ResourceRequestFuture();
+        }
+        ResourceRequestFuture *future = takeRequestFuture();
+        if (future != NULL)
+            future->finish(ResourceRequestFuture::Succeeded);
         return true;
     }
 
-    if ( !proceedIfImFirst( Release ) ) return true;
+    if ( !proceedIfImFirst( Release, timeoutMs ) ) return true;
 
     //inAcquireMode = false;
     LOG_DEBUG("ResourceSet::%s().... releasing...", __FUNCTION__);
-    return resourceEngine->releaseResources();
+    return sendRequest( Release, timeoutMs );
 }
 
 bool ResourceSet::update()
+{
+    return update(0);
+}
+
+bool ResourceSet::update(int timeoutMs)
 {
     if (!initialized) {
+        ResourceRequestFuture *future = takeRequestFuture();
+        if (future != NULL)
+            future->finish(ResourceRequestFuture::Succeeded);
         return true;
     }
 
     if (!resourceEngine->isConnectedToManager()) {
         pendingUpdate = true;
+        keepEarlierTimeout(d->pendingUpdateTimeoutMs, timeoutMs);
+        ResourceRequestFuture *future = takeRequestFuture();
+        if ( future != NULL ) {
+            if ( d->pendingUpdateFuture.isValid() && !d->pendingUpdateFuture.isFinished() )
+                *future = d->pendingUpdateFuture;
+            else
+                d->pendingUpdateFuture = *future;
+        }
         resourceEngine->connectToManager();
         return true;
     }
 
-    if ( !proceedIfImFirst( Update ) ) return true;
+    if ( !proceedIfImFirst( Update, timeoutMs ) ) return true;
 
     LOG_DEBUG("ResourceSet::%s().... updating...", __FUNCTION__);
-    return resourceEngine->updateResources();
+    return sendRequest( Update, timeoutMs );
+}
+
+ResourceRequestFuture ResourceSet::acquireAsync(int timeoutMs)
+{
+    return requestAsync(Acquire, timeoutMs);
+}
+
+ResourceRequestFuture ResourceSet::releaseAsync(int timeoutMs)
+{
+    return requestAsync(Release, timeoutMs);
+}
+
+ResourceRequestFuture ResourceSet::updateAsync(int timeoutMs)
+{
+    return requestAsync(Update, timeoutMs);
+}
+
+ResourceRequestFuture ResourceSet::requestAsync(requestType theRequest, int timeoutMs)
+{
+    //The request takes the future from requestFuture, and may swap in the
+    //future of a queued request it is merged into.
+    ResourceRequestFuture future(publicRequests[theRequest]);
+    d->requestFuture = &future;
+
+    bool success = true;
+    switch (theRequest)
+    {
+    case Acquire: success = acquire(timeoutMs); break;
+    case Update:  success = update(timeoutMs);  break;
+    case Release: success = release(timeoutMs); break;
+    }
+
+    d->requestFuture = NULL;
+    if (!success)
+        future.finish(ResourceRequestFuture::Failed);
+    return future;
+}
+
+// A *Blocking() call. Referenced by the caller, by the event that carries
+// it to the thread of the set, and on behalf of the callback of its future,
+// because the caller may give up and return before the others are done.
+class BlockingRequest: public QSharedData
+{
+public:
+    BlockingRequest(ResourceSet *set, ResourceRequest request, int timeoutMs)
+        : set(set), request(request), timeoutMs(timeoutMs),
+          result(ResourceRequestFuture::Pending), abandoned(false)
+    {
+    }
+
+    ResourceSet *set;
+    ResourceRequest request;
+    int timeoutMs;
+    // Only used on the thread of the set.
+    ResourceRequestFuture future;
+
+    QMutex mutex;
+    QWaitCondition answered;
+    ResourceRequestFuture::Result result;
+    // The caller has timed out and returned.
+    bool abandoned;
+};
+
+static const QEvent::Type blockingRequestEventType = QEvent::Type(QEvent::registerEventType());
+
+class BlockingRequestEvent: public QEvent
+{
+public:
+    BlockingRequestEvent(BlockingRequest *call)
+        : QEvent(blockingRequestEventType), call(call)
+    {
+    }
+
+    // An event dropped undelivered, as when the set is deleted first, must
+    // still wake the caller.
+    ~BlockingRequestEvent();
+
+    QExplicitlySharedDataPointer<BlockingRequest> call;
+};
+
+// Hands the result to the caller. Returns false if the caller is gone.
+static bool finishBlockingRequest(BlockingRequest *call, ResourceRequestFuture::Result result)
+{
+    QMutexLocker locker(&call->mutex);
+    if (call->abandoned)
+        return false;
+    if (call->result == ResourceRequestFuture::Pending) {
+        call->result = result;
+        call->answered.wakeAll();
+    }
+    return true;
+}
+
+BlockingRequestEvent::~BlockingRequestEvent()
+{
+    if (call)
+        finishBlockingRequest(call.data(), ResourceRequestFuture::Canceled);
+}
+
+// The grant of an acquire whose caller gave up is released, unless someone
+// else has asked for the resources meanwhile: another acquire queued or
+// waiting for the connection, or any acquire since the last release, which
+// may have shared this very request or been granted before it.
+void ResourceSet::blockingRequestAnswered(void *context)
+{
+    BlockingRequest *call = static_cast<BlockingRequest *>(context);
+    ResourceRequestFuture::Result result = call->future.result();
+    if (!finishBlockingRequest(call, result) &&
+        result == ResourceRequestFuture::Succeeded && call->request == AcquireRequest) {
+        ResourceSet *set = call->set;
+        bool wanted = set->pendingAcquire || set->d->acquiresSinceRelease != 1;
+        for (int i = 0; !wanted && i < set->d->requests.size(); i++) {
+            wanted = set->d->requests.at(i).type == Acquire && set->d->requests.at(i).future != call->future;
+        }
+        if (wanted) {
+            LOG_DEBUG("ResourceSet::%s(): keeping grant another acquire asked for", __FUNCTION__);
+        }
+        else {
+            LOG_DEBUG("ResourceSet::%s(): releasing grant nobody waits for", __FUNCTION__);
+            set->release();
+        }
+    }
+    if (!call->ref.deref())
+        delete call;
+}
+
+ResourceRequestFuture::Result ResourceSet::acquireBlocking(int timeoutMs)
+{
+    return requestBlocking(AcquireRequest, timeoutMs);
+}
+
+ResourceRequestFuture::Result ResourceSet::releaseBlocking(int timeoutMs)
+{
+    return requestBlocking(ReleaseRequest, timeoutMs);
+}
+
+ResourceRequestFuture::Result ResourceSet::requestBlocking(ResourceRequest request, int timeoutMs)
+{
+    if (QThread::currentThread() == thread()) {
+        qWarning("ResourceSet: blocking request on the thread of the set, which would never answer it");
+        return ResourceRequestFuture::Failed;
+    }
+
+    QExplicitlySharedDataPointer<BlockingRequest> call(new BlockingRequest(this, request, timeoutMs));
+    QMutexLocker locker(&call->mutex);
+    QCoreApplication::postEvent(this, new BlockingRequestEvent(call.data()));
+
+    unsigned long waitMs = timeoutMs > 0 ? (unsigned long)timeoutMs : ULONG_MAX;
+    while (call->result == ResourceRequestFuture::Pending) {
+        if (!call->answered.wait(&call->mutex, waitMs) &&
+            call->result == ResourceRequestFuture::Pending) {
+            call->abandoned = true;
+            return ResourceRequestFuture::TimedOut;
+        }
+    }
+    return call->result;
+}
+
+#if QT_VERSION >= 0x050000
+void ResourceSet::connectNotify(const QMetaMethod &signal)
+{
+    if (signal == QMetaMethod::fromSignal(&ResourceSet::resourcesGranted))
+        d->grantedListConnected = true;
+    else if (signal == QMetaMethod::fromSignal(&ResourceSet::resourcesBecameAvailable))
+        d->availableListConnected = true;
+}
+#else
+void ResourceSet::connectNotify(const char *signal)
+{
+    if (qstrcmp(signal, SIGNAL(resourcesGranted(QList<ResourcePolicy::ResourceType>))) == 0)
+        d->grantedListConnected = true;
+    else if (qstrcmp(signal, SIGNAL(resourcesBecameAvailable(QList<ResourcePolicy::ResourceType>))) == 0)
+        d->availableListConnected = true;
+}
+#endif
+
+// Makes the request of a *Blocking() call on the thread of the set.
+bool ResourceSet::event(QEvent *e)
+{
+    if (e->type() != blockingRequestEventType)
+        return QObject::event(e);
+
+    BlockingRequestEvent *blockingEvent = static_cast<BlockingRequestEvent *>(e);
+    BlockingRequest *call = blockingEvent->call.data();
+    {
+        QMutexLocker locker(&call->mutex);
+        if (call->abandoned)
+            return true;
+    }
+
+    call->future = call->request == AcquireRequest ? acquireAsync(call->timeoutMs)
+                                                   : releaseAsync(call->timeoutMs);
+    call->ref.ref();
+    if (!call->future.onFinished(&blockingRequestAnswered, call))
+        blockingRequestAnswered(call);
+    blockingEvent->call.reset();
+    return true;
+}
+
+// Takes the future of the *Async() call being made, so that requests made
+// by slots while it is sent do not pick it up as well. NULL if there is none.
+ResourceRequestFuture *ResourceSet::takeRequestFuture()
+{
+    ResourceRequestFuture *future = d->requestFuture;
+    d->requestFuture = NULL;
+    return future;
+}
+
+// Sends the request proceedIfImFirst() has just let through: the next one
+// executeNextRequest() sends, the first one a pipelined set held back, or
+// else the one just queued. The engine numbers the request in the queue
+// before it sends it, so that an answer delivered while it is being sent
+// already finds it there.
+bool ResourceSet::sendRequest( requestType theRequest, int timeoutMs )
+{
+    quint32 unqueuedNo = 0;
+    quint32 *requestNo = &unqueuedNo;
+    ResourceRequestFuture future;
+    if ( !d->requests.isEmpty() ) {
+        int at = ignoreQ ? 0 : d->requests.size() - 1;
+        if ( d->pipelined ) {
+            for (at = 0; at < d->requests.size() - 1 && d->requests.at(at).requestNo != 0; at++)
+                ;
+        }
+        ResourceSetPrivate::QueuedRequest &queued = d->requests[at];
+        requestNo = &queued.requestNo;
+        future = queued.future;
+    }
+
+    bool sent = false;
+    switch (theRequest)
+    {
+    case Acquire: sent = resourceEngine->acquireResources(timeoutMs, requestNo); break;
+    case Update:  sent = resourceEngine->updateResources(timeoutMs, requestNo);  break;
+    case Release: sent = resourceEngine->releaseResources(timeoutMs, requestNo); break;
+    }
+
+    if ( !sent ) {
+        //Nothing went out, so nothing has changed the queue meanwhile. No
+        //answer will come either, so the queue goes on without the request.
+        quint32 failedNo = *requestNo;
+        QPointer<ResourceSet> alive(this);
+        future.finish(ResourceRequestFuture::Failed);
+        if (alive.isNull())
+            return false;
+        executeNextRequest(failedNo);
+        return false;
+    }
+
+    //An answer may have changed the queue while the request was sent, so it
+    //is looked up again rather than through requestNo.
+    for (int i = 0; future.isValid() && !future.isFinished() && i < d->requests.size(); i++) {
+        if ( d->requests.at(i).future == future ) {
+            future.setRequestNumber(d->requests.at(i).requestNo);
+            break;
+        }
+    }
+    return true;
+}
+
+// Sends the requests a pipelined set held back, oldest first, for as long
+// as the engine can track them.
+void ResourceSet::sendHeldRequests()
+{
+    QPointer<ResourceSet> alive(this);
+    while ( !alive.isNull() && resourceEngine->hasRoomForRequest() ) {
+        int at = 0;
+        while ( at < d->requests.size() && d->requests.at(at).requestNo != 0 )
+            at++;
+        if ( at == d->requests.size() )
+            return;
+        LOG_DEBUG("ResourceSet::%s()...sending held back request %d.", __FUNCTION__, at + 1);
+        ResourceSetPrivate::QueuedRequest held = d->requests.at(at);
+        sendRequest( held.type, held.timeoutMs );
+    }
+}
+
+// Finishes the future of the request the engine sent as requestNo, if it is
+// queued. Called before executeNextRequest() removes it. Code waiting on the
+// future may run from here and make new requests, which queue up behind the
+// answered one, or delete the set: false is returned then, and the caller
+// must not touch the set any more.
+bool ResourceSet::finishRequest(quint32 requestNo, ResourceRequestFuture::Result result,
+                                const ResourceTypeMask &granted)
+{
+    int at = findRequest(requestNo);
+    if (at < 0)
+        return true;
+    ResourceRequestFuture future = d->requests.at(at).future;
+    future.setRequestNumber(requestNo);
+    QPointer<ResourceSet> alive(this);
+    future.finish(result, granted);
+    return !alive.isNull();
+}
+
+// Returns false if code waiting on the futures deleted the set.
+bool ResourceSet::cancelRequests()
+{
+    //Take the queue first, as code waiting on the futures may run from here.
+    QVector<ResourceSetPrivate::QueuedRequest> cancelled = d->requests;
+    d->requests.clear();
+    QPointer<ResourceSet> alive(this);
+    for (int i = 0; i < cancelled.size(); i++) {
+        cancelled[i].future.finish(ResourceRequestFuture::Canceled);
+    }
+    return !alive.isNull();
 }
 
 QString ResourceSet::applicationClass()
@@ -475,6 +1060,93 @@ bool ResourceSet::alwaysGetReply()
     return alwaysReply;
 }
 
+bool ResourceSet::setPipelined()
+{
+    if(initialized)
+        return false;
+    d->pipelined = true;
+    return true;
+}
+
+bool ResourceSet::isPipelined()
+{
+    return d->pipelined;
+}
+
+bool ResourceSet::setRequestCoalescing()
+{
+    if(initialized)
+        return false;
+    d->coalesceRequests = true;
+    return true;
+}
+
+bool ResourceSet::willCoalesceRequests()
+{
+    return d->coalesceRequests;
+}
+
+quint32 ResourceSet::coalescedRequests() const
+{
+    return d->coalescedRequestCount;
+}
+
+LatencyHistogram ResourceSet::latencyHistogram(ResourceRequest request, LatencyStage stage) const
+{
+    QMutexLocker locker(&d->latencyMutex);
+    if (d->latencyHistograms == NULL || (quint32)request >= (quint32)NumberOfRequests ||
+        (quint32)stage >= (quint32)NumberOfLatencyStages) {
+        return LatencyHistogram();
+    }
+    return d->latencyHistograms[request * NumberOfLatencyStages + stage];
+}
+
+void ResourceSet::resetLatencyHistograms()
+{
+    QMutexLocker locker(&d->latencyMutex);
+    if (d->latencyHistograms == NULL)
+        return;
+    for (int i = 0; i < NumberOfRequests * NumberOfLatencyStages; i++) {
+        d->latencyHistograms[i].reset();
+    }
+}
+
+int ResourceSet::outstandingRequests() const
+{
+    if (resourceEngine == NULL)
+        return 0;
+    return resourceEngine->outstandingRequests();
+}
+
+quint32 ResourceSet::allResourcesMask() const
+{
+    return d->allMask;
+}
+
+// Visits only the resources in the set, so it needs neither a walk over
+// every type nor a mask that Resource::setOptional() would have to update.
+quint32 ResourceSet::optionalResourcesMask() const
+{
+    quint32 optionalMask = 0;
+    quint32 remaining = d->allMask;
+    while (remaining) {
+        quint32 bit = remaining & -remaining;
+        ResourceType type = takeLowestResourceType(remaining);
+        if (resourceSet[type]->isOptional())
+            optionalMask |= bit;
+    }
+    return optionalMask;
+}
+
+void ResourceSet::recordLatency(ResourceRequest request, LatencyStage stage, qint64 nanoseconds)
+{
+    QMutexLocker locker(&d->latencyMutex);
+    if (d->latencyHistograms == NULL) {
+        d->latencyHistograms = new LatencyHistogram[NumberOfRequests * NumberOfLatencyStages];
+    }
+    d->latencyHistograms[request * NumberOfLatencyStages + stage].record(nanoseconds);
+}
+
 void ResourceSet::connectedHandler()
 {
     LOG_DEBUG("**************** ResourceSet::%s().... %d", __FUNCTION__, __LINE__);
@@ -489,12 +1161,28 @@ void ResourceSet::connectedHandler()
             registerVideoProperties();
         }
         if (pendingUpdate) {
-            resourceEngine->updateResources();
+            ResourceRequestFuture future = d->pendingUpdateFuture;
+            int timeoutMs = d->pendingUpdateTimeoutMs;
+            d->pendingUpdateFuture = ResourceRequestFuture();
+            d->pendingUpdateTimeoutMs = 0;
             pendingUpdate = false;
+            d->requestFuture = future.isValid() ? &future : NULL;
+            update(timeoutMs);
+            d->requestFuture = NULL;
         }
         if (pendingAcquire) {
-            acquire();
+            ResourceRequestFuture future = d->pendingAcquireFuture;
+            int timeoutMs = d->pendingAcquireTimeoutMs;
+            d->pendingAcquireFuture = ResourceRequestFuture();
+            d->pendingAcquireTimeoutMs = 0;
             pendingAcquire = false;
+            d->requestFuture = future.isValid() ? &future : NULL;
+            //The acquire was counted when it was made.
+            if (proceedIfImFirst(Acquire, timeoutMs)) {
+                LOG_DEBUG("ResourceSet::%s().... acquiring", __FUNCTION__);
+                sendRequest(Acquire, timeoutMs);
+            }
+            d->requestFuture = NULL;
         }
     }
     else { // assuming reconnecting
@@ -521,7 +1209,8 @@ void ResourceSet::connectedHandler()
                 }
             }
         }
-        // now reconnect
+        // The properties and the acquire are restored once the manager has
+        // answered the registration, see above.
         resourceEngine->connectToManager();
     }
 }
@@ -535,22 +1224,7 @@ void ResourceSet::registerAudioProperties()
         return;
     }
     else if (resourceEngine->isConnectedToManager()) {
-        LOG_DEBUG("Registering new audio settings");
-        //LOG_DEBUG( "\taudio group: %s", audioResource->audioGroup().toStdString().c_str() );
-        //LOG_DEBUG( "\tPID: %d ", audioResource->processID() );
-        //LOG_DEBUG( "\taudio stream: %s:%s",  audioResource->streamTagName().toStdString().c_str(),
-        //         audioResource->streamTagValue().toStdString().c_str() );
-
-        if((audioResource->processID() > 0) && audioResource->streamTagName() != "media.name") {
-            qWarning() << "streamTagName should be 'media.name' it is '" << audioResource->streamTagName() << "'";
-        }
-        bool r = resourceEngine->registerAudioProperties(audioResource->audioGroup(),
-                                                         audioResource->processID(),
-                                                         audioResource->streamTagName(),
-                                                         audioResource->streamTagValue());
-        LOG_DEBUG("resourceEngine->registerAudioProperties returned %s", r?"true":"false");
-
-        pendingAudioProperties = false;
+        sendAudioProperties();
     }
     else { //if (!resourceEngine->isConnectedToManager() && !resourceEngine->isConnectingToManager()) {
         LOG_DEBUG("%s(): Connecting to Manager...", __FUNCTION__);
@@ -570,19 +1244,7 @@ void ResourceSet::registerVideoProperties()
         return;
     }
     else if (resourceEngine->isConnectedToManager()) {
-
-        LOG_DEBUG("Registering new video settings:");
-        LOG_DEBUG("\tPID:%d", videoResource->processID() );
-
-        if( videoResource->processID() < 2 ) {
-            qWarning() << "processID should be > 1 '" << "'";
-        }
-
-        bool r = resourceEngine->registerVideoProperties( videoResource->processID() );
-
-        LOG_DEBUG("resourceEngine->registerVideoProperties returned %s", r?"true":"false");
-
-        pendingVideoProperties = false;
+        sendVideoProperties();
     }
     else { //if (!resourceEngine->isConnectedToManager() && !resourceEngine->isConnectingToManager()) {
         LOG_DEBUG("%s(): Connecting to Manager...", __FUNCTION__);
@@ -593,39 +1255,73 @@ void ResourceSet::registerVideoProperties()
     }
 }
 
-void ResourceSet::handleGranted(quint32 bitmaskOfGrantedResources)
+void ResourceSet::sendAudioProperties()
+{
+    LOG_DEBUG("Registering new audio settings");
+    //LOG_DEBUG( "\taudio group: %s", audioResource->audioGroup().toStdString().c_str() );
+    //LOG_DEBUG( "\tPID: %d ", audioResource->processID() );
+    //LOG_DEBUG( "\taudio stream: %s:%s",  audioResource->streamTagName().toStdString().c_str(),
+    //         audioResource->streamTagValue().toStdString().c_str() );
+
+    if((audioResource->processID() > 0) && audioResource->streamTagName() != "media.name") {
+        qWarning() << "streamTagName should be 'media.name' it is '" << audioResource->streamTagName() << "'";
+    }
+    bool r = resourceEngine->registerAudioProperties(audioResource->audioGroup(),
+                                                     audioResource->processID(),
+                                                     audioResource->streamTagName(),
+                                                     audioResource->streamTagValue());
+    LOG_DEBUG("resourceEngine->registerAudioProperties returned %s", r?"true":"false");
+
+    pendingAudioProperties = false;
+}
+
+void ResourceSet::sendVideoProperties()
+{
+    LOG_DEBUG("Registering new video settings:");
+    LOG_DEBUG("\tPID:%d", videoResource->processID() );
+
+    if( videoResource->processID() < 2 ) {
+        qWarning() << "processID should be > 1 '" << "'";
+    }
+
+    bool r = resourceEngine->registerVideoProperties( videoResource->processID() );
+
+    LOG_DEBUG("resourceEngine->registerVideoProperties returned %s", r?"true":"false");
+
+    pendingVideoProperties = false;
+}
+
+void ResourceSet::handleGranted(quint32 bitmaskOfGrantedResources, quint32 requestNo)
 {
     LOG_DEBUG(" ResourceSet::%s",__FUNCTION__);
-    QList<ResourceType> optionalResources;
+    ResourceTypeMask optionalResources;
     LOG_DEBUG("Acquired resources: 0x%04x", bitmaskOfGrantedResources);
 
     bool setChanged   = false;
 
-    for(int i=0;i < NumberOfTypes; i++) {
-
-        if(resourceSet[i] == NULL)
-            continue;
-
-        ResourceType type = (ResourceType)i;
-        quint32 bitmask   = resourceTypeToLibresourceType(type);
+    //Visit only the resources in the set.
+    quint32 remaining = d->allMask;
+    while (remaining) {
+        quint32 bitmask   = remaining & -remaining;
+        ResourceType type = takeLowestResourceType(remaining);
         LOG_DEBUG("Checking if resource 0x%04x is in the set", bitmask);
 
-        if ((bitmask & bitmaskOfGrantedResources) == bitmask) {
-            if (resourceSet[i]->isOptional()) {
-                optionalResources << type;
+        if (bitmask & bitmaskOfGrantedResources) {
+            if (resourceSet[type]->isOptional()) {
+                optionalResources.insert(type);
             }
-            if ( !resourceSet[i]->isGranted() )
+            if ( !resourceSet[type]->isGranted() )
                 setChanged = true;
 
-            resourceSet[i]->setGranted();
-            LOG_DEBUG("Resource 0x%04x is now granted", i);
+            resourceSet[type]->setGranted();
+            LOG_DEBUG("Resource 0x%04x is now granted", type);
         }
         else
         {
-            if ( resourceSet[i]->isGranted() )
+            if ( resourceSet[type]->isGranted() )
                 setChanged = true;
 
-            resourceSet[i]->unsetGranted();
+            resourceSet[type]->unsetGranted();
             setChanged = true;
         }
     }
@@ -633,68 +1329,80 @@ void ResourceSet::handleGranted(quint32 bitmaskOfGrantedResources)
     //When we come to this slot bitmaskOfGrantedResources contains resources.
     if ( alwaysReply || ( !alwaysReply && setChanged ) ) {
         LOG_DEBUG(" ResourceSet::%s - emitting resourcesGranted(optionalResources) ",__FUNCTION__);
-        emit resourcesGranted(optionalResources);
+        emit resourcesGrantedMask(optionalResources);
+        //Only build the list when someone listens to it.
+        if (d->grantedListConnected)
+            emit resourcesGranted(optionalResources.toList());
     }
 
     inAcquireMode = true;
-    executeNextRequest();
+    RESOURCE_TRACE2(state, identifier, 1);
+    if (!finishRequest(requestNo, ResourceRequestFuture::Succeeded, optionalResources))
+        return;
+    executeNextRequest(requestNo);
 }
 
-void ResourceSet::handleReleased()
+void ResourceSet::handleReleased(quint32 requestNo)
 {
-    for(int i=0;i < NumberOfTypes; i++) {
-        if(resourceSet[i] != NULL) {
-            resourceSet[i]->unsetGranted();
-        }
+    quint32 remaining = d->allMask;
+    while (remaining) {
+        resourceSet[takeLowestResourceType(remaining)]->unsetGranted();
     }
 
     if ( alwaysReply || ( !alwaysReply && inAcquireMode)  ) emit resourcesReleased();
 
     LOG_DEBUG("ResourceSet(%d) - resourcesReleased!", identifier);
     inAcquireMode = false;
+    RESOURCE_TRACE2(state, identifier, 0);
 
-    executeNextRequest();
+    if (!finishRequest(requestNo, ResourceRequestFuture::Succeeded))
+        return;
+    executeNextRequest(requestNo);
     //emit resourcesReleased();
 }
 
-void ResourceSet::handleDeny()
+void ResourceSet::handleDeny(quint32 requestNo)
 {
-    for(int i=0;i < NumberOfTypes; i++) {
-        if(resourceSet[i] != NULL) {
-            resourceSet[i]->unsetGranted();
-        }
+    quint32 remaining = d->allMask;
+    while (remaining) {
+        resourceSet[takeLowestResourceType(remaining)]->unsetGranted();
     }
-    executeNextRequest();
-    emit resourcesDenied();
+    if (!finishRequest(requestNo, ResourceRequestFuture::Denied))
+        return;
+    executeNextRequest(requestNo);
+    if (alwaysReply) emit resourcesDenied();
 }
 
 void ResourceSet::handleResourcesLost(quint32 lostResourcesBitmask)
 {
-    for(int i=0;i < NumberOfTypes; i++) {
-        quint32 bitmask = resourceTypeToLibresourceType((ResourceType)i);
-        if ((bitmask & lostResourcesBitmask) == bitmask) {
-            resourceSet[i]->unsetGranted();
-            LOG_DEBUG("Resource %04x is now lost", bitmask);
-        }
+    //Only resources in the set can be lost.
+    quint32 remaining = lostResourcesBitmask & d->allMask;
+    while (remaining) {
+        ResourceType type = takeLowestResourceType(remaining);
+        resourceSet[type]->unsetGranted();
+        LOG_DEBUG("Resource %04x is now lost", resourceTypeToLibresourceType(type));
     }
 
     //All requests are invalid when we are pre-empted.
-   requestQ.clear();
+   if (!cancelRequests())
+       return;
     if (inAcquireMode) emit lostResources();
 
 }
 
 void ResourceSet::handleResourcesBecameAvailable(quint32 availableResources)
 {
-    QList<ResourceType> listOfResources;
-    for (int i=0;i < NumberOfTypes; i++) {
-        ResourceType type = (ResourceType)i;
-        quint32 bitmask = resourceTypeToLibresourceType(type);
-        if ((bitmask & availableResources) == bitmask) {
-            listOfResources.append(type);
+    ResourceTypeMask availableTypes;
+    quint32 remaining = availableResources;
+    while (remaining) {
+        ResourceType type = takeLowestResourceType(remaining);
+        if (type != NumberOfTypes) {
+            availableTypes.insert(type);
         }
     }
-    emit resourcesBecameAvailable(listOfResources);
+    emit resourcesBecameAvailableMask(availableTypes);
+    if (d->availableListConnected)
+        emit resourcesBecameAvailable(availableTypes.toList());
 }
 
 void ResourceSet::handleAudioPropertiesChanged(const QString &, quint32,
@@ -711,14 +1419,16 @@ void ResourceSet::handleVideoPropertiesChanged( quint32)
 void ResourceSet::handleReleasedByManager()
 {
     //All requests are invalid when we are pre-empted.
-   requestQ.clear();
+   if (!cancelRequests())
+       return;
 
    resourceEngine->releaseResources();
    inAcquireMode = false;
+   RESOURCE_TRACE2(state, identifier, 0);
    emit resourcesReleasedByManager();
 }
 
-void ResourceSet::handleUpdateOK(bool resend)
+void ResourceSet::handleUpdateOK(bool resend, quint32 requestNo)
 {
     pendingUpdate = false;
     LOG_DEBUG("ResourceSet::%s().... %d", __FUNCTION__, __LINE__);
@@ -741,6 +1451,32 @@ void ResourceSet::handleUpdateOK(bool resend)
     }
 
     LOG_DEBUG("ResourceSet::%s()...about to exe next request....", __FUNCTION__);
-    executeNextRequest();
+    if (!finishRequest(requestNo, ResourceRequestFuture::Succeeded))
+        return;
+    executeNextRequest(requestNo);
+
+}
+
+// The engine hands over a copy of the message, which stays valid for as
+// long as the receivers of errorCallback() are called.
+void ResourceSet::handleError(quint32 code, const QByteArray &message)
+{
+    emit errorCallback(code, message.constData());
+}
+
+void ResourceSet::handleRequestTimedOut(ResourcePolicy::ResourceRequest request, quint32 requestNo)
+{
+    LOG_DEBUG("ResourceSet(%d) - request %d (%u) timed out", identifier, request, requestNo);
+    if (!finishRequest(requestNo, ResourceRequestFuture::TimedOut))
+        return;
+    executeNextRequest(requestNo);
+    emit requestTimedOut(request);
+}
 
+void ResourceSet::handleRequestFailed(ResourcePolicy::ResourceRequest request, quint32 requestNo)
+{
+    LOG_DEBUG("ResourceSet(%d) - request %d (%u) failed", identifier, request, requestNo);
+    if (!finishRequest(requestNo, ResourceRequestFuture::Failed))
+        return;
+    executeNextRequest(requestNo);
 }
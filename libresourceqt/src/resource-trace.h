@@ -0,0 +1,57 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef RESOURCE_TRACE_H
+#define RESOURCE_TRACE_H
+
+// Static tracepoints on the request path. Each RESOURCE_TRACEn() is a
+// systemtap SDT probe of the provider "libresourceqt": a single nop, with
+// its arguments left where they already are, until a tracer (perf, lttng,
+// systemtap, bpftrace) attaches to it. The probes are in every build that
+// has sys/sdt.h, unless it is configured with CONFIG+=resourceqt_no_trace;
+// without them the macros and their arguments compile to nothing. The
+// first argument of every probe is the id of the resource set; request
+// types are ResourcePolicy::ResourceRequest values.
+// resourceqt-trace-timeline turns `perf script` output of these probes into
+// per-request timelines.
+
+// qmake finds sys/sdt.h for compilers that cannot look for it themselves.
+#if !defined(RESOURCEQT_TRACE) && !defined(RESOURCEQT_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define RESOURCEQT_TRACE
+#endif
+#endif
+
+#if defined(RESOURCEQT_TRACE) && !defined(RESOURCEQT_NO_TRACE)
+
+#include <sys/sdt.h>
+
+#define RESOURCE_TRACE2(name, a, b)       DTRACE_PROBE2(libresourceqt, name, a, b)
+#define RESOURCE_TRACE3(name, a, b, c)    DTRACE_PROBE3(libresourceqt, name, a, b, c)
+
+#else
+
+#define RESOURCE_TRACE2(name, a, b)       do { } while (0)
+#define RESOURCE_TRACE3(name, a, b, c)    do { } while (0)
+
+#endif
+
+#endif
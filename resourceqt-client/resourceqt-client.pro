@@ -46,3 +46,8 @@ QMAKE_DISTCLEAN += -r .moc .obj
 # Install options
 target.path = /usr/bin/
 INSTALLS    = target
+
+# Turns perf traces of the libresourceqt probes into request timelines.
+timeline.files = resourceqt-trace-timeline
+timeline.path  = /usr/bin/
+INSTALLS      += timeline
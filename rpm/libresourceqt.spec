@@ -171,6 +171,7 @@ rm -rf %{buildroot}
 %files client
 %defattr(-,root,root,-)
 %{_bindir}/resourceqt-client
+%{_bindir}/resourceqt-trace-timeline
 # >> files client
 # << files client
 
@@ -0,0 +1,269 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "benchmark-dbus-qeventloop.h"
+#include <QCoreApplication>
+#include <QTime>
+#include <QVector>
+#include <QTimer>
+#include <time.h>
+
+// Needs test-dbus-pong running on the session bus.
+static const char *PONG_SERVICE = "com.nokia.dbusqeventloop.test";
+static const int PINGS_PER_ROUND = 100;
+static const int LATENCY_PINGS = 50;
+static const int BUSY_FRAME_MS = 8;
+
+static qint64 monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (qint64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+BenchmarkDbusQEventLoop::BenchmarkDbusQEventLoop() : replies(0), sentNs(0), latencyNs(0)
+{
+}
+
+BenchmarkDbusQEventLoop::~BenchmarkDbusQEventLoop()
+{
+}
+
+void BenchmarkDbusQEventLoop::pendingNotify(DBusPendingCall *pending, void *data)
+{
+    BenchmarkDbusQEventLoop *benchmark = reinterpret_cast<BenchmarkDbusQEventLoop *>(data);
+
+    DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+    if (reply)
+        dbus_message_unref(reply);
+    dbus_pending_call_unref(pending);
+
+    benchmark->replies++;
+}
+
+// Sends a burst of pings and runs the Qt event loop until all replies are in.
+bool BenchmarkDbusQEventLoop::pingRound(DBusConnection *bus, int pings)
+{
+    const char *text = "ping";
+
+    replies = 0;
+    for (int i = 0; i < pings; i++) {
+        DBusMessage *message = dbus_message_new_method_call(PONG_SERVICE, "/", NULL, "ping");
+        dbus_message_append_args(message, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+
+        DBusPendingCall *pending = NULL;
+        dbus_connection_send_with_reply(bus, message, &pending, 3000);
+        dbus_message_unref(message);
+        if (pending == NULL)
+            return false;
+        dbus_pending_call_set_notify(pending, BenchmarkDbusQEventLoop::pendingNotify, this, NULL);
+    }
+
+    QTime started;
+    started.start();
+    while (replies < pings) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        if (started.elapsed() > 5000)
+            return false;
+    }
+    return true;
+}
+
+// Message rate of each backend: the socket notifiers look the watch up in a
+// QMultiHash on every wakeup, the epoll backend gets it from the event.
+void BenchmarkDbusQEventLoop::benchmarkPingRate_data()
+{
+    QTest::addColumn<int>("backend");
+
+    QTest::newRow("socket notifiers") << (int)DBUSConnectionEventLoop::SocketNotifierBackend;
+    QTest::newRow("epoll") << (int)DBUSConnectionEventLoop::EpollBackend;
+}
+
+void BenchmarkDbusQEventLoop::benchmarkPingRate()
+{
+    QFETCH(int, backend);
+
+    QVERIFY(DBUSConnectionEventLoop::setBackend((DBUSConnectionEventLoop::Backend)backend));
+
+    DBusConnection *bus = dbus_bus_get_private(DBUS_BUS_SESSION, NULL);
+    QVERIFY(bus != NULL);
+    dbus_connection_set_exit_on_disconnect(bus, FALSE);
+    QVERIFY2(dbus_bus_name_has_owner(bus, PONG_SERVICE, NULL), "test-dbus-pong is not running");
+    QVERIFY(DBUSConnectionEventLoop::addConnection(bus));
+
+    bool allReplied = true;
+    QBENCHMARK {
+        allReplied = pingRound(bus, PINGS_PER_ROUND) && allReplied;
+    }
+
+    DBUSConnectionEventLoop::removeConnection(bus);
+    dbus_connection_close(bus);
+    dbus_connection_unref(bus);
+
+    QVERIFY(allReplied);
+}
+
+// Arming and disarming the timeouts of many outstanding method calls. Every
+// pending call adds a DBusTimeout and cancelling it removes the timeout.
+void BenchmarkDbusQEventLoop::benchmarkPendingCallTimeouts_data()
+{
+    QTest::addColumn<int>("calls");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+}
+
+void BenchmarkDbusQEventLoop::benchmarkPendingCallTimeouts()
+{
+    QFETCH(int, calls);
+
+    DBusConnection *bus = dbus_bus_get_private(DBUS_BUS_SESSION, NULL);
+    QVERIFY(bus != NULL);
+    dbus_connection_set_exit_on_disconnect(bus, FALSE);
+    QVERIFY2(dbus_bus_name_has_owner(bus, PONG_SERVICE, NULL), "test-dbus-pong is not running");
+    QVERIFY(DBUSConnectionEventLoop::addConnection(bus));
+
+    const char *text = "ping";
+    QVector<DBusPendingCall *> pending(calls);
+    bool allSent = true;
+
+    QBENCHMARK {
+        for (int i = 0; i < calls; i++) {
+            DBusMessage *message = dbus_message_new_method_call(PONG_SERVICE, "/", NULL, "ping");
+            dbus_message_append_args(message, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+            pending[i] = NULL;
+            dbus_connection_send_with_reply(bus, message, &pending[i], 25000);
+            dbus_message_unref(message);
+            allSent = allSent && pending[i] != NULL;
+        }
+        for (int i = 0; i < calls; i++) {
+            if (pending[i] == NULL)
+                continue;
+            dbus_pending_call_cancel(pending[i]);
+            dbus_pending_call_unref(pending[i]);
+        }
+    }
+
+    // Let the replies to the cancelled calls drain before disconnecting
+    QTime started;
+    started.start();
+    while (started.elapsed() < 200)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
+
+    DBUSConnectionEventLoop::removeConnection(bus);
+    dbus_connection_close(bus);
+    dbus_connection_unref(bus);
+
+    QVERIFY(allSent);
+}
+
+// Records when the reply arrived, in whichever thread handles it.
+void BenchmarkDbusQEventLoop::latencyNotify(DBusPendingCall *pending, void *data)
+{
+    BenchmarkDbusQEventLoop *benchmark = reinterpret_cast<BenchmarkDbusQEventLoop *>(data);
+
+    benchmark->latencyNs += monotonicNs() - benchmark->sentNs;
+
+    DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+    if (reply)
+        dbus_message_unref(reply);
+    dbus_pending_call_unref(pending);
+
+    benchmark->answered.fetchAndAddOrdered(1);
+}
+
+// Stands in for a GUI thread that keeps rendering frames.
+void BenchmarkDbusQEventLoop::busyFrame()
+{
+    qint64 end = monotonicNs() + BUSY_FRAME_MS * 1000000LL;
+    while (monotonicNs() < end)
+        ;
+}
+
+// Round-trip time of a ping while the thread running the Qt event loop is
+// busy, with the D-Bus I/O in that thread and in the I/O thread.
+void BenchmarkDbusQEventLoop::benchmarkLatencyUnderLoad_data()
+{
+    QTest::addColumn<bool>("ioThread");
+
+    QTest::newRow("main thread") << false;
+    QTest::newRow("I/O thread") << true;
+}
+
+void BenchmarkDbusQEventLoop::benchmarkLatencyUnderLoad()
+{
+    QFETCH(bool, ioThread);
+
+    QVERIFY(DBUSConnectionEventLoop::setIoThreadEnabled(ioThread));
+
+    DBusConnection *bus = dbus_bus_get_private(DBUS_BUS_SESSION, NULL);
+    QVERIFY(bus != NULL);
+    dbus_connection_set_exit_on_disconnect(bus, FALSE);
+    QVERIFY2(dbus_bus_name_has_owner(bus, PONG_SERVICE, NULL), "test-dbus-pong is not running");
+    QVERIFY(DBUSConnectionEventLoop::addConnection(bus));
+
+    QTimer frames;
+    connect(&frames, SIGNAL(timeout()), SLOT(busyFrame()));
+    frames.start(0);
+
+    const char *text = "ping";
+    bool allReplied = true;
+    latencyNs = 0;
+    answered.fetchAndStoreOrdered(0);
+
+    for (int i = 0; i < LATENCY_PINGS && allReplied; i++) {
+        DBusMessage *message = dbus_message_new_method_call(PONG_SERVICE, "/", NULL, "ping");
+        dbus_message_append_args(message, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+
+        DBusPendingCall *pending = NULL;
+        sentNs = monotonicNs();
+        dbus_connection_send_with_reply(bus, message, &pending, 3000);
+        dbus_message_unref(message);
+        if (pending == NULL) {
+            allReplied = false;
+            break;
+        }
+        dbus_pending_call_set_notify(pending, BenchmarkDbusQEventLoop::latencyNotify, this, NULL);
+
+        QTime started;
+        started.start();
+        while (answered.fetchAndAddOrdered(0) <= i) {
+            QCoreApplication::processEvents(QEventLoop::AllEvents);
+            if (started.elapsed() > 5000) {
+                allReplied = false;
+                break;
+            }
+        }
+    }
+
+    frames.stop();
+
+    DBUSConnectionEventLoop::removeConnection(bus);
+    dbus_connection_close(bus);
+    dbus_connection_unref(bus);
+    QVERIFY(DBUSConnectionEventLoop::setIoThreadEnabled(false));
+
+    QVERIFY(allReplied);
+    QTest::setBenchmarkResult(latencyNs / 1000000.0 / LATENCY_PINGS, QTest::WalltimeMilliseconds);
+}
+
+QTEST_MAIN(BenchmarkDbusQEventLoop)
@@ -0,0 +1,62 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef BENCHMARK_DBUS_QEVENTLOOP_H
+#define BENCHMARK_DBUS_QEVENTLOOP_H
+
+#include <QtTest/QTest>
+#include <QObject>
+#include <QAtomicInt>
+#include "dbusconnectioneventloop.h"
+
+class BenchmarkDbusQEventLoop: public QObject
+{
+    Q_OBJECT
+public:
+    BenchmarkDbusQEventLoop();
+    ~BenchmarkDbusQEventLoop();
+
+    int replies;
+
+    // Latency of the ping in flight, written by the thread handling replies
+    qint64 sentNs;
+    qint64 latencyNs;
+    QAtomicInt answered;
+
+private:
+    bool pingRound(DBusConnection *bus, int pings);
+
+    static void pendingNotify(DBusPendingCall *pending, void *data);
+    static void latencyNotify(DBusPendingCall *pending, void *data);
+
+public slots:
+    void busyFrame();
+
+private slots:
+    void benchmarkPingRate_data();
+    void benchmarkPingRate();
+    void benchmarkPendingCallTimeouts_data();
+    void benchmarkPendingCallTimeouts();
+    void benchmarkLatencyUnderLoad_data();
+    void benchmarkLatencyUnderLoad();
+};
+
+#endif
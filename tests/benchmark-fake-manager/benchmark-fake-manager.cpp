@@ -0,0 +1,338 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "benchmark-fake-manager.h"
+#include "fake-manager.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QSignalSpy>
+#include <QThread>
+
+using namespace ResourcePolicy;
+
+static const int ROUNDS_PER_THREAD = 100;
+
+// Owns one ResourceSet and runs acquire and release rounds from its own
+// thread, waiting for each answer in its own event loop.
+class ClientThread: public QThread
+{
+public:
+    ClientThread(int rounds) : rounds(rounds), answers(0) {}
+
+    int rounds;
+    int answers;
+
+protected:
+    void run() {
+        ResourceSet resourceSet("player");
+        resourceSet.addResource(AudioPlaybackType);
+
+        QEventLoop loop;
+        QObject::connect(&resourceSet, SIGNAL(managerIsUp()), &loop, SLOT(quit()));
+        QObject::connect(&resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)),
+                         &loop, SLOT(quit()));
+        QObject::connect(&resourceSet, SIGNAL(resourcesReleased()), &loop, SLOT(quit()));
+
+        answers = 0;
+        if (!resourceSet.initAndConnect())
+            return;
+        loop.exec();
+
+        for (int i = 0; i < rounds; i++) {
+            resourceSet.acquire();
+            loop.exec();
+            resourceSet.release();
+            loop.exec();
+            answers += 2;
+        }
+    }
+};
+
+BenchmarkFakeManager::BenchmarkFakeManager()
+{
+}
+
+BenchmarkFakeManager::~BenchmarkFakeManager()
+{
+}
+
+QList<ResourceSet *> BenchmarkFakeManager::connectedSets(int count, bool alwaysReply)
+{
+    QList<ResourceSet *> sets;
+    for (int i = 0; i < count; i++) {
+        ResourceSet *resourceSet = new ResourceSet("player", NULL, alwaysReply, false);
+        resourceSet->addResource(AudioPlaybackType);
+        resourceSet->addResource(VideoPlaybackType);
+        resourceSet->initAndConnect();
+        sets << resourceSet;
+    }
+    FakeManager::instance()->waitForIdle();
+    return sets;
+}
+
+void BenchmarkFakeManager::deleteSets(QList<ResourceSet *> &sets)
+{
+    qDeleteAll(sets);
+    sets.clear();
+    FakeManager::instance()->waitForIdle();
+}
+
+// Registering a set with the manager and unregistering it again.
+void BenchmarkFakeManager::benchmarkConnect()
+{
+    FakeManager *manager = FakeManager::instance();
+
+    QBENCHMARK {
+        ResourceSet *resourceSet = new ResourceSet("player");
+        resourceSet->addResource(AudioPlaybackType);
+        resourceSet->initAndConnect();
+        manager->waitForIdle();
+        delete resourceSet;
+        manager->waitForIdle();
+    }
+
+    QCOMPARE(manager->registeredSets(), 0);
+}
+
+void BenchmarkFakeManager::benchmarkAcquire()
+{
+    QList<ResourceSet *> sets = connectedSets(1, true);
+    ResourceSet *resourceSet = sets.first();
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+
+    QBENCHMARK {
+        resourceSet->acquire();
+        FakeManager::instance()->waitForIdle();
+    }
+
+    QVERIFY(grantedSpy.count() > 0);
+    deleteSets(sets);
+}
+
+void BenchmarkFakeManager::benchmarkRelease()
+{
+    QList<ResourceSet *> sets = connectedSets(1, true);
+    ResourceSet *resourceSet = sets.first();
+    QSignalSpy releasedSpy(resourceSet, SIGNAL(resourcesReleased()));
+
+    QBENCHMARK {
+        resourceSet->release();
+        FakeManager::instance()->waitForIdle();
+    }
+
+    QVERIFY(releasedSpy.count() > 0);
+    deleteSets(sets);
+}
+
+void BenchmarkFakeManager::benchmarkUpdate()
+{
+    QList<ResourceSet *> sets = connectedSets(1);
+    ResourceSet *resourceSet = sets.first();
+    FakeManager *manager = FakeManager::instance();
+    quint64 handled = manager->handledMessages();
+
+    QBENCHMARK {
+        resourceSet->update();
+        manager->waitForIdle();
+    }
+
+    QVERIFY(manager->handledMessages() > handled);
+    deleteSets(sets);
+}
+
+void BenchmarkFakeManager::benchmarkAudioProperties()
+{
+    QList<ResourceSet *> sets = connectedSets(1);
+    AudioResource *audioResource = static_cast<AudioResource *>(sets.first()->resource(AudioPlaybackType));
+    FakeManager *manager = FakeManager::instance();
+    quint64 handled = manager->handledMessages();
+
+    quint32 pid = 1;
+    QBENCHMARK {
+        audioResource->setProcessID(++pid);
+        manager->waitForIdle();
+    }
+
+    QVERIFY(manager->handledMessages() > handled);
+    deleteSets(sets);
+}
+
+void BenchmarkFakeManager::benchmarkVideoProperties()
+{
+    QList<ResourceSet *> sets = connectedSets(1);
+    VideoResource *videoResource = static_cast<VideoResource *>(sets.first()->resource(VideoPlaybackType));
+    FakeManager *manager = FakeManager::instance();
+    quint64 handled = manager->handledMessages();
+
+    quint32 pid = 1;
+    QBENCHMARK {
+        videoResource->setProcessID(++pid);
+        manager->waitForIdle();
+    }
+
+    QVERIFY(manager->handledMessages() > handled);
+    deleteSets(sets);
+}
+
+// Acquiring and releasing every set of a client with many of them.
+void BenchmarkFakeManager::benchmarkManySets_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("1 set") << 1;
+    QTest::newRow("10 sets") << 10;
+    QTest::newRow("100 sets") << 100;
+    QTest::newRow("1000 sets") << 1000;
+}
+
+void BenchmarkFakeManager::benchmarkManySets()
+{
+    QFETCH(int, count);
+
+    QList<ResourceSet *> sets = connectedSets(count);
+    QCOMPARE(FakeManager::instance()->registeredSets(), count);
+
+    QBENCHMARK {
+        for (int i = 0; i < sets.size(); i++) {
+            sets.at(i)->acquire();
+        }
+        FakeManager::instance()->waitForIdle();
+        for (int i = 0; i < sets.size(); i++) {
+            sets.at(i)->release();
+        }
+        FakeManager::instance()->waitForIdle();
+    }
+
+    deleteSets(sets);
+}
+
+// Every thread owns a set and runs acquire and release rounds, while the
+// main thread delivers the answers of the manager.
+void BenchmarkFakeManager::benchmarkManyThreads_data()
+{
+    QTest::addColumn<int>("threads");
+
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("2 threads") << 2;
+    QTest::newRow("4 threads") << 4;
+    QTest::newRow("8 threads") << 8;
+}
+
+void BenchmarkFakeManager::benchmarkManyThreads()
+{
+    QFETCH(int, threads);
+
+    QList<ClientThread *> clients;
+    QEventLoop loop;
+    for (int i = 0; i < threads; i++) {
+        ClientThread *client = new ClientThread(ROUNDS_PER_THREAD);
+        QObject::connect(client, SIGNAL(finished()), &loop, SLOT(quit()));
+        clients << client;
+    }
+
+    QBENCHMARK {
+        for (int i = 0; i < clients.size(); i++) {
+            clients.at(i)->start();
+        }
+        for (int i = 0; i < clients.size(); i++) {
+            while (!clients.at(i)->isFinished()) {
+                loop.exec();
+            }
+        }
+        FakeManager::instance()->waitForIdle();
+    }
+
+    for (int i = 0; i < clients.size(); i++) {
+        QCOMPARE(clients.at(i)->answers, 2 * ROUNDS_PER_THREAD);
+    }
+    qDeleteAll(clients);
+}
+
+// A restart of the manager makes every set register again, restore its
+// audio and video properties and acquire the resources it had. Measured until every
+// set has been granted again.
+void BenchmarkFakeManager::benchmarkReconnectStorm_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("10 sets") << 10;
+    QTest::newRow("100 sets") << 100;
+    QTest::newRow("1000 sets") << 1000;
+}
+
+void BenchmarkFakeManager::benchmarkReconnectStorm()
+{
+    QFETCH(int, count);
+
+    FakeManager *manager = FakeManager::instance();
+    QList<ResourceSet *> sets = connectedSets(count);
+    for (int i = 0; i < sets.size(); i++) {
+        AudioResource *audioResource = static_cast<AudioResource *>(sets.at(i)->resource(AudioPlaybackType));
+        audioResource->setStreamTag("media.name", "player");
+        audioResource->setProcessID(1000 + i);
+        static_cast<VideoResource *>(sets.at(i)->resource(VideoPlaybackType))->setProcessID(1000 + i);
+        sets.at(i)->acquire();
+    }
+    manager->waitForIdle();
+
+    // The registration, then the properties and the acquire once it is
+    // answered, and nothing more.
+    quint64 handled = manager->handledMessages();
+    manager->restart();
+    manager->waitForIdle();
+    QCOMPARE(manager->handledMessages() - handled, (quint64)(4 * count));
+
+    QBENCHMARK {
+        manager->restart();
+        manager->waitForIdle();
+    }
+
+    QCOMPARE(manager->registeredSets(), count);
+    for (int i = 0; i < sets.size(); i++) {
+        QVERIFY(sets.at(i)->resource(AudioPlaybackType)->isGranted());
+    }
+    deleteSets(sets);
+}
+
+// Acquire and release rounds with the manager answering before each
+// request returns, so only the client code is measured.
+void BenchmarkFakeManager::benchmarkSynchronous()
+{
+    FakeManager *manager = FakeManager::instance();
+    QList<ResourceSet *> sets = connectedSets(1, true);
+    ResourceSet *resourceSet = sets.first();
+    quint64 handled = manager->handledMessages();
+
+    manager->setSynchronous(true);
+    QBENCHMARK {
+        for (int i = 0; i < 1000; i++) {
+            resourceSet->acquire();
+            resourceSet->release();
+        }
+    }
+    manager->setSynchronous(false);
+
+    QVERIFY(manager->handledMessages() > handled);
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+    deleteSets(sets);
+}
+
+QTEST_MAIN(BenchmarkFakeManager)
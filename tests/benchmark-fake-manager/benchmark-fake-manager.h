@@ -0,0 +1,57 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef BENCHMARK_FAKE_MANAGER_H
+#define BENCHMARK_FAKE_MANAGER_H
+
+#include <QtTest/QTest>
+#include <QObject>
+#include <QList>
+#include <policy/resource-set.h>
+
+class BenchmarkFakeManager: public QObject
+{
+    Q_OBJECT
+public:
+    BenchmarkFakeManager();
+    ~BenchmarkFakeManager();
+
+private:
+    QList<ResourcePolicy::ResourceSet *> connectedSets(int count, bool alwaysReply = false);
+    void deleteSets(QList<ResourcePolicy::ResourceSet *> &sets);
+
+private slots:
+    void benchmarkConnect();
+    void benchmarkAcquire();
+    void benchmarkRelease();
+    void benchmarkUpdate();
+    void benchmarkAudioProperties();
+    void benchmarkVideoProperties();
+    void benchmarkManySets_data();
+    void benchmarkManySets();
+    void benchmarkManyThreads_data();
+    void benchmarkManyThreads();
+    void benchmarkReconnectStorm_data();
+    void benchmarkReconnectStorm();
+    void benchmarkSynchronous();
+};
+
+#endif
@@ -0,0 +1,66 @@
+##############################################################################
+#  This file is part of libresourceqt                                        #
+#                                                                            #
+#  Copyright (C) 2011 Nokia Corporation.                                     #
+#                                                                            #
+#  This library is free software; you can redistribute                       #
+#  it and/or modify it under the terms of the GNU Lesser General Public      #
+#  License as published by the Free Software Foundation                      #
+#  version 2.1 of the License.                                               #
+#                                                                            #
+#  This library is distributed in the hope that it will be useful,           #
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of            #
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          #
+#  Lesser General Public License for more details.                           #
+#                                                                            #
+#  You should have received a copy of the GNU Lesser General Public          #
+#  License along with this library; if not, write to the Free Software       #
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  #
+#  USA.                                                                      #
+##############################################################################
+
+include(../../common.pri)
+TEMPLATE = app
+TARGET = benchmark-fake-manager
+DESTDIR = build
+DEPENDPATH += $${POLICY} $${LIBRESOURCEQT}/src .
+INCLUDEPATH += $${LIBRESOURCEQT}/src $${LIBRESOURCEINC} $${LIBDBUSQEVENTLOOP} ../fake-manager /usr/include/resource
+
+# Input
+HEADERS +=  $${POLICY}/resource.h \
+            $${POLICY}/resources.h \
+            $${POLICY}/resource-set.h \
+            $${POLICY}/audio-resource.h \
+            $${LIBRESOURCEQT}/src/resource-engine.h \
+            benchmark-fake-manager.h
+
+SOURCES +=  $${LIBRESOURCEQT}/src/resource.cpp \
+            $${LIBRESOURCEQT}/src/resources.cpp \
+            $${LIBRESOURCEQT}/src/resource-latency-histogram.cpp \
+            $${LIBRESOURCEQT}/src/resource-log.cpp \
+            $${LIBRESOURCEQT}/src/resource-request-future.cpp \
+            $${LIBRESOURCEQT}/src/resource-set.cpp \
+            $${LIBRESOURCEQT}/src/resource-engine.cpp \
+            $${LIBRESOURCEQT}/src/audio-resource.cpp \
+            benchmark-fake-manager.cpp
+
+OBJECTS_DIR = build
+MOC_DIR = build/moc
+QMAKE_CXXFLAGS += -Wall
+
+# libresource and the system bus are replaced by the in-process fake
+# manager of fake-libresource, so the benchmark runs anywhere. Run it with
+# -csv and compare two runs with compare-benchmarks.sh.
+CONFIG  += qt warn_on link_pkgconfig
+QT += testlib
+QT -= gui
+PKGCONFIG += dbus-1
+LIBS += -L../fake-manager/build -lfake-libresource -lrt
+PRE_TARGETDEPS += ../fake-manager/build/libfake-libresource.a
+
+# Install directives
+INSTALLBASE    = /usr
+target.path    = $${INSTALLBASE}/lib/$${TESTSTARGETDIR}/
+compare.path   = $${INSTALLBASE}/lib/$${TESTSTARGETDIR}/
+compare.files  = compare-benchmarks.sh
+INSTALLS       = target compare
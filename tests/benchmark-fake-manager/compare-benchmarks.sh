@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# This file is part of libresourceqt
+#
+# Copyright (C) 2011 Nokia Corporation.
+#
+# This library is free software; you can redistribute
+# it and/or modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation
+# version 2.1 of the License.
+#
+# Compares two runs of a QTest benchmark saved with its -csv option, e.g.
+#
+#   benchmark-fake-manager -csv > before.csv
+#   ... change things ...
+#   benchmark-fake-manager -csv > after.csv
+#   compare-benchmarks.sh before.csv after.csv
+#
+# Prints every benchmark found in both runs with its change in percent, and
+# exits with 1 if any of them got slower by more than the threshold (10% by
+# default, set with -t).
+
+threshold=10
+if [ "$1" = "-t" ]; then
+    threshold=$2
+    shift 2
+fi
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 [-t percent] before.csv after.csv" >&2
+    exit 2
+fi
+
+awk -F, -v threshold="$threshold" '
+# Lines are "function","tag",value,... or "function","tag","metric",value,...
+function parse(    i) {
+    for (i = 1; i <= NF; i++)
+        gsub(/^ *"|" *$/, "", $i)
+    if (NF < 3)
+        return 0
+    key = $1 "(" $2 ")"
+    if ($3 ~ /^[-+0-9.eE]+$/) {
+        value = $3
+    } else if (NF >= 4 && $4 ~ /^[-+0-9.eE]+$/) {
+        key = key " " $3
+        value = $4
+    } else {
+        return 0
+    }
+    return 1
+}
+
+FNR == NR {
+    if (parse())
+        before[key] = value
+    next
+}
+
+parse() && (key in before) {
+    old = before[key] + 0
+    change = old != 0 ? (value - old) * 100 / old : 0
+    verdict = ""
+    if (change > threshold) {
+        verdict = "  REGRESSION"
+        regressions++
+    } else if (change < -threshold) {
+        verdict = "  improved"
+    }
+    printf "%-60s %14.6g %14.6g %+8.1f%%%s\n", key, old, value, change, verdict
+    compared++
+}
+
+END {
+    printf "%d benchmarks compared, %d slower by more than %s%%\n", compared, regressions, threshold
+    exit regressions > 0
+}
+' "$1" "$2"
@@ -0,0 +1,399 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "benchmark-resource-engine.h"
+#include <policy/resource-log.h>
+#include <QThread>
+#include <QList>
+#include <dbus/dbus.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+using namespace ResourcePolicy;
+
+static const int REQUESTS_PER_ENGINE = 10000;
+
+// The grant handler the engine registers with the stubbed libresource.
+static resproto_handler_t grantCallback = NULL;
+
+// Heap allocations made while countAllocations is set.
+static bool countAllocations = false;
+static int allocations = 0;
+
+// Owns one ResourceSet and ResourceEngine and hammers the send path from
+// its own thread, the way a media daemon drives sets from worker threads.
+class EngineThread: public QThread
+{
+public:
+    EngineThread(int requests) : requests(requests) {}
+
+protected:
+    void run() {
+        ResourceSet resourceSet("player");
+        resourceSet.addResource(AudioPlaybackType);
+        resourceSet.addResource(VideoPlaybackType);
+
+        ResourceEngine *resourceEngine = new ResourceEngine(&resourceSet);
+        resourceEngine->initialize();
+        resourceEngine->connectToManager();
+
+        for (int i = 0; i < requests; i++) {
+            resourceEngine->updateResources();
+            resourceEngine->acquireResources();
+            resourceEngine->releaseResources();
+        }
+
+        delete resourceEngine;
+    }
+
+private:
+    int requests;
+};
+
+BenchmarkResourceEngine::BenchmarkResourceEngine()
+{
+}
+
+BenchmarkResourceEngine::~BenchmarkResourceEngine()
+{
+}
+
+// Every engine runs the same amount of work in its own thread, so with no
+// shared lock on the send path the wall time stays flat as engines are added.
+void BenchmarkResourceEngine::benchmarkContention_data()
+{
+    QTest::addColumn<int>("engines");
+
+    QTest::newRow("1 engine") << 1;
+    QTest::newRow("2 engines") << 2;
+    QTest::newRow("4 engines") << 4;
+    QTest::newRow("8 engines") << 8;
+}
+
+void BenchmarkResourceEngine::benchmarkContention()
+{
+    QFETCH(int, engines);
+
+    QList<EngineThread *> threads;
+    for (int i = 0; i < engines; i++) {
+        threads << new EngineThread(REQUESTS_PER_ENGINE);
+    }
+
+    QBENCHMARK {
+        for (int i = 0; i < threads.size(); i++) {
+            threads.at(i)->start();
+        }
+        for (int i = 0; i < threads.size(); i++) {
+            threads.at(i)->wait();
+        }
+    }
+
+    qDeleteAll(threads);
+}
+
+// Routing a grant to its engine is one hash lookup, so the cost per message
+// stays flat however many sets share the connection.
+void BenchmarkResourceEngine::benchmarkRouteGrant_data()
+{
+    QTest::addColumn<int>("sets");
+
+    QTest::newRow("1 set") << 1;
+    QTest::newRow("100 sets") << 100;
+    QTest::newRow("1000 sets") << 1000;
+    QTest::newRow("10000 sets") << 10000;
+}
+
+void BenchmarkResourceEngine::benchmarkRouteGrant()
+{
+    QFETCH(int, sets);
+
+    QList<ResourceSet *> resourceSets;
+    QList<ResourceEngine *> resourceEngines;
+    for (int i = 0; i < sets; i++) {
+        ResourceSet *resourceSet = new ResourceSet("player");
+        resourceSet->addResource(AudioPlaybackType);
+        ResourceEngine *resourceEngine = new ResourceEngine(resourceSet);
+        resourceEngine->initialize();
+        resourceEngine->connectToManager();
+        resourceSets << resourceSet;
+        resourceEngines << resourceEngine;
+    }
+    QVERIFY(grantCallback != NULL);
+
+    ResourceEngine *target = resourceEngines.last();
+    resmsg_t message;
+    memset(&message, 0, sizeof(resmsg_t));
+    message.notify.type = RESMSG_GRANT;
+    message.notify.id = target->id();
+    message.notify.resrc = RESMSG_AUDIO_PLAYBACK;
+
+    QBENCHMARK {
+        grantCallback(&message, target->libresourceSet, NULL);
+    }
+
+    qDeleteAll(resourceEngines);
+    qDeleteAll(resourceSets);
+}
+
+// Neither a grant of a request nor one the engine cannot match to a
+// request, which is a preemption that reports every resource of the set as
+// lost, may touch the heap, in the engine or in the set that handles it.
+void BenchmarkResourceEngine::benchmarkGrantAllocations()
+{
+    ResourceSet resourceSet("player");
+    resourceSet.addResource(AudioPlaybackType);
+    resourceSet.addResource(VideoPlaybackType);
+    resourceSet.resource(VideoPlaybackType)->setOptional();
+
+    ResourceEngine *resourceEngine = new ResourceEngine(&resourceSet);
+    resourceEngine->initialize();
+    resourceEngine->connectToManager();
+    QVERIFY(grantCallback != NULL);
+
+    // The set handles what the engine reports, as it does for its own.
+    QObject::connect(resourceEngine, SIGNAL(resourcesGranted(quint32, quint32)),
+                     &resourceSet, SLOT(handleGranted(quint32, quint32)));
+    QObject::connect(resourceEngine, SIGNAL(resourcesLost(quint32)),
+                     &resourceSet, SLOT(handleResourcesLost(quint32)));
+
+    resmsg_t granted;
+    memset(&granted, 0, sizeof(resmsg_t));
+    granted.notify.type = RESMSG_GRANT;
+    granted.notify.id = resourceEngine->id();
+    granted.notify.resrc = RESMSG_AUDIO_PLAYBACK | RESMSG_VIDEO_PLAYBACK;
+
+    resmsg_t preempted;
+    memset(&preempted, 0, sizeof(resmsg_t));
+    preempted.notify.type = RESMSG_GRANT;
+    preempted.notify.id = resourceEngine->id();
+    preempted.notify.reqno = 0xffff;
+    preempted.notify.resrc = 0;
+
+    // The first answer allocates the latency histograms of the set.
+    quint32 requestNo = 0;
+    QVERIFY(resourceEngine->acquireResources(0, &requestNo));
+    granted.notify.reqno = requestNo;
+    grantCallback(&granted, resourceEngine->libresourceSet, NULL);
+    QVERIFY(resourceSet.resource(VideoPlaybackType)->isGranted());
+    grantCallback(&preempted, resourceEngine->libresourceSet, NULL);
+    QVERIFY(!resourceSet.resource(VideoPlaybackType)->isGranted());
+
+    allocations = 0;
+    for (int i = 0; i < 1000; i++) {
+        // Only the answers are counted, not the sending of the acquire.
+        resourceEngine->acquireResources(0, &requestNo);
+        granted.notify.reqno = requestNo;
+        countAllocations = true;
+        grantCallback(&granted, resourceEngine->libresourceSet, NULL);
+        grantCallback(&preempted, resourceEngine->libresourceSet, NULL);
+        countAllocations = false;
+    }
+    QCOMPARE(allocations, 0);
+
+    QBENCHMARK {
+        grantCallback(&preempted, resourceEngine->libresourceSet, NULL);
+    }
+
+    delete resourceEngine;
+}
+
+// A grant notification walks the set bits of the set, so its cost follows
+// the number of resources in the set rather than NumberOfTypes.
+void BenchmarkResourceEngine::benchmarkNotifyGranted_data()
+{
+    QTest::addColumn<int>("resources");
+
+    QTest::newRow("1 resource") << 1;
+    QTest::newRow("4 resources") << 4;
+    QTest::newRow("all resources") << (int)NumberOfTypes;
+}
+
+void BenchmarkResourceEngine::benchmarkNotifyGranted()
+{
+    QFETCH(int, resources);
+
+    ResourceSet resourceSet("player");
+    quint32 bitmask = 0;
+    for (int i = 0; i < resources; i++) {
+        resourceSet.addResource((ResourceType)i);
+        bitmask |= resourceTypeToLibresourceType((ResourceType)i);
+    }
+    QVERIFY(resourceSet.initAndConnect());
+    QVERIFY(grantCallback != NULL);
+
+    resmsg_t message;
+    memset(&message, 0, sizeof(resmsg_t));
+    message.notify.type = RESMSG_GRANT;
+    message.notify.id = resourceSet.id();
+    message.notify.resrc = bitmask;
+
+    QBENCHMARK {
+        grantCallback(&message, NULL, NULL);
+    }
+}
+
+#if QT_VERSION >= 0x050000
+static void discardMessage(QtMsgType, const QMessageLogContext &, const QString &)
+{
+}
+#else
+static void discardMessage(QtMsgType, const char *)
+{
+}
+#endif
+
+// What the debug log costs an acquire and release round: nothing when off,
+// a copy into the thread's ring buffer in Ring mode, formatting and the
+// global qDebug() lock in Console mode. Building with
+// CONFIG+=resourceqt_no_logs gives the cost with the log compiled out.
+void BenchmarkResourceEngine::benchmarkLogging_data()
+{
+    QTest::addColumn<int>("mode");
+
+    QTest::newRow("off") << (int)ResourceLog::Off;
+    QTest::newRow("ring buffer") << (int)ResourceLog::Ring;
+    QTest::newRow("qDebug") << (int)ResourceLog::Console;
+}
+
+void BenchmarkResourceEngine::benchmarkLogging()
+{
+    QFETCH(int, mode);
+
+    ResourceSet resourceSet("player");
+    resourceSet.addResource(AudioPlaybackType);
+    ResourceEngine *resourceEngine = new ResourceEngine(&resourceSet);
+    resourceEngine->initialize();
+    resourceEngine->connectToManager();
+
+    ResourceLog::Mode oldMode = ResourceLog::mode();
+#if QT_VERSION >= 0x050000
+    QtMessageHandler oldHandler = qInstallMessageHandler(discardMessage);
+#else
+    QtMsgHandler oldHandler = qInstallMsgHandler(discardMessage);
+#endif
+    ResourceLog::setMode((ResourceLog::Mode)mode);
+
+    QBENCHMARK {
+        resourceEngine->acquireResources();
+        resourceEngine->releaseResources();
+    }
+
+    ResourceLog::setMode(oldMode);
+#if QT_VERSION >= 0x050000
+    qInstallMessageHandler(oldHandler);
+#else
+    qInstallMsgHandler(oldHandler);
+#endif
+
+#ifndef RESOURCEQT_NO_LOGS
+    if (mode == ResourceLog::Ring) {
+        QVERIFY(!ResourceLog::records().isEmpty());
+    }
+#endif
+    ResourceLog::clear();
+
+    delete resourceEngine;
+}
+
+QTEST_MAIN(BenchmarkResourceEngine)
+
+////////////////////////////////////////////////////////////////
+// Counting allocator for benchmarkGrantAllocations.
+
+#if __cplusplus >= 201103L
+#define THROWS_BAD_ALLOC
+#define THROWS_NOTHING noexcept
+#else
+#define THROWS_BAD_ALLOC throw(std::bad_alloc)
+#define THROWS_NOTHING throw()
+#endif
+
+void *operator new(size_t size) THROWS_BAD_ALLOC
+{
+    if (countAllocations)
+        allocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) THROWS_BAD_ALLOC
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) THROWS_NOTHING
+{
+    free(p);
+}
+
+void operator delete[](void *p) THROWS_NOTHING
+{
+    free(p);
+}
+
+////////////////////////////////////////////////////////////////
+// Stand-ins for the system bus, the D-Bus event loop and libresource.
+
+DBusConnection *dbus_bus_get_private(DBusBusType, DBusError *)
+{
+    static int dummyConnection;
+    return reinterpret_cast<DBusConnection *>(&dummyConnection);
+}
+
+bool DBUSConnectionEventLoop::addConnection(DBusConnection *)
+{
+    return true;
+}
+
+resconn_t* resproto_init(resproto_role_t, resproto_transport_t, ...)
+{
+    return (resconn_t *) calloc(1, sizeof(resconn_t));
+}
+
+int resproto_set_handler(union resconn_u *, resmsg_type_t type,
+                         resproto_handler_t callbackFunction)
+{
+    if (type == RESMSG_GRANT) {
+        grantCallback = callbackFunction;
+    }
+    return 1;
+}
+
+resset_t *resconn_connect(resconn_t *, resmsg_t *message, resproto_status_t)
+{
+    resset_t *resSet = (resset_t *) calloc(1, sizeof(resset_t));
+    resSet->id = message->record.id;
+    return resSet;
+}
+
+int resconn_disconnect(resset_t *, resmsg_t *, resproto_status_t)
+{
+    return 1;
+}
+
+int resproto_send_message(resset_t *, resmsg_t *message, resproto_status_t)
+{
+    return message->record.reqno != 0;
+}
@@ -0,0 +1,51 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef BENCHMARK_RESOURCE_ENGINE_H
+#define BENCHMARK_RESOURCE_ENGINE_H
+
+#include <QtTest/QTest>
+#include <QObject>
+
+class BenchmarkResourceEngine;
+
+#include "resource-engine.h"
+
+class BenchmarkResourceEngine: public QObject
+{
+    Q_OBJECT
+public:
+    BenchmarkResourceEngine();
+    ~BenchmarkResourceEngine();
+
+private slots:
+    void benchmarkContention_data();
+    void benchmarkContention();
+    void benchmarkRouteGrant_data();
+    void benchmarkRouteGrant();
+    void benchmarkGrantAllocations();
+    void benchmarkNotifyGranted_data();
+    void benchmarkNotifyGranted();
+    void benchmarkLogging_data();
+    void benchmarkLogging();
+};
+
+#endif
@@ -156,4 +156,105 @@ void BenchmarkResourceSet::benchmarkRelease()
     }
 }
 
+QList<ResourceSet *> BenchmarkResourceSet::connectedSets(int count)
+{
+    QList<ResourceSet *> sets;
+    for (int i = 0; i < count; i++) {
+        ResourceSet *resourceSet = new ResourceSet("player", this, true, false);
+        resourceSet->addResource(AudioPlaybackType);
+        resourceSet->initAndConnect();
+        waitForSignal(resourceSet, SIGNAL(managerIsUp()));
+        sets << resourceSet;
+    }
+    return sets;
+}
+
+// An application switch acquires and then releases every set. Serially,
+// each set waits for its own reply before the next request goes out.
+void BenchmarkResourceSet::benchmarkSerialSwitch_data()
+{
+    QTest::addColumn<int>("sets");
+
+    QTest::newRow("20 sets") << 20;
+    QTest::newRow("40 sets") << 40;
+}
+
+void BenchmarkResourceSet::benchmarkSerialSwitch()
+{
+    QFETCH(int, sets);
+    QList<ResourceSet *> resourceSets = connectedSets(sets);
+
+    QBENCHMARK {
+        for (int i = 0; i < resourceSets.size(); i++) {
+            resourceSets.at(i)->acquire();
+            waitForSignal(resourceSets.at(i), SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+        }
+        for (int i = 0; i < resourceSets.size(); i++) {
+            resourceSets.at(i)->release();
+            waitForSignal(resourceSets.at(i), SIGNAL(resourcesReleased()));
+        }
+    }
+
+    qDeleteAll(resourceSets);
+}
+
+// The same switch through a ResourceSetBatch: all requests go out together
+// and the replies are collected into a single finished() signal.
+void BenchmarkResourceSet::benchmarkBatchSwitch_data()
+{
+    benchmarkSerialSwitch_data();
+}
+
+void BenchmarkResourceSet::benchmarkBatchSwitch()
+{
+    QFETCH(int, sets);
+    QList<ResourceSet *> resourceSets = connectedSets(sets);
+
+    ResourceSetBatch batch;
+    for (int i = 0; i < resourceSets.size(); i++) {
+        batch.addResourceSet(resourceSets.at(i));
+    }
+
+    QBENCHMARK {
+        batch.acquire();
+        if (batch.isPending())
+            waitForSignal(&batch, SIGNAL(finished()));
+        batch.release();
+        if (batch.isPending())
+            waitForSignal(&batch, SIGNAL(finished()));
+    }
+
+    qDeleteAll(resourceSets);
+}
+
+// update() followed by acquire() waits for two round trips when requests
+// are serialised, and for about one when they are pipelined.
+void BenchmarkResourceSet::benchmarkUpdateAcquire_data()
+{
+    QTest::addColumn<bool>("pipelined");
+
+    QTest::newRow("serial") << false;
+    QTest::newRow("pipelined") << true;
+}
+
+void BenchmarkResourceSet::benchmarkUpdateAcquire()
+{
+    QFETCH(bool, pipelined);
+
+    ResourceSet resourceSet("player", NULL, true, false);
+    if (pipelined)
+        resourceSet.setPipelined();
+    resourceSet.addResource(AudioPlaybackType);
+    resourceSet.initAndConnect();
+    waitForSignal(&resourceSet, SIGNAL(managerIsUp()));
+
+    QBENCHMARK {
+        resourceSet.update();
+        resourceSet.acquire();
+        waitForSignal(&resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+        resourceSet.release();
+        waitForSignal(&resourceSet, SIGNAL(resourcesReleased()));
+    }
+}
+
 QTEST_MAIN(BenchmarkResourceSet)
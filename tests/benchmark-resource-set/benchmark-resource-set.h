@@ -26,6 +26,7 @@ USA.
 #include <QList>
 #include <QtTest/QTest>
 #include <policy/resource-set.h>
+#include <policy/resource-set-batch.h>
 
 class BenchmarkResourceSet: public QObject
 {
@@ -49,6 +50,7 @@ private:
     ResourcePolicy::Resource * resourceFromType(ResourcePolicy::ResourceType type);
 
     void waitForSignal(const QObject *sender, const char *signal, quint32 timeout = 1000);
+    QList<ResourcePolicy::ResourceSet *> connectedSets(int count);
 
 public:
     BenchmarkResourceSet();
@@ -62,6 +64,14 @@ private slots:
     void benchmarkReleaseSend();
     void benchmarkAcquire();
     void benchmarkRelease();
+
+    void benchmarkSerialSwitch_data();
+    void benchmarkSerialSwitch();
+    void benchmarkBatchSwitch_data();
+    void benchmarkBatchSwitch();
+
+    void benchmarkUpdateAcquire_data();
+    void benchmarkUpdateAcquire();
 };
 
 #endif
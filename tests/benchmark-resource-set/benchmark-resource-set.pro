@@ -32,6 +32,7 @@ DEFINES += QT_NO_DEBUG_OUTPUT
 # Input
 HEADERS +=  $${POLICY}/resources.h \
             $${POLICY}/resource-set.h \
+            $${POLICY}/resource-set-batch.h \
             $${POLICY}/audio-resource.h \
             $${LIBRESOURCEQT}/src/resource-engine.h \
             benchmark-resource-set.h
@@ -40,7 +41,11 @@ SOURCES +=  $${LIBRESOURCEQT}/src/resource.cpp \
             $${LIBRESOURCEQT}/src/resources.cpp \
             $${LIBRESOURCEQT}/src/resource-engine.cpp \
             $${LIBRESOURCEQT}/src/audio-resource.cpp \
+            $${LIBRESOURCEQT}/src/resource-latency-histogram.cpp \
+            $${LIBRESOURCEQT}/src/resource-log.cpp \
+            $${LIBRESOURCEQT}/src/resource-request-future.cpp \
             $${LIBRESOURCEQT}/src/resource-set.cpp \
+            $${LIBRESOURCEQT}/src/resource-set-batch.cpp \
             benchmark-resource-set.cpp
 
 OBJECTS_DIR = build
@@ -0,0 +1,524 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "fake-manager.h"
+#include <QCoreApplication>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
+#include <dbus/dbus.h>
+#include <dbusconnectioneventloop.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+FakeManager *FakeManager::instance()
+{
+    static QMutex instanceMutex;
+    static FakeManager *manager = NULL;
+
+    QMutexLocker locker(&instanceMutex);
+    if (manager == NULL) {
+        manager = new FakeManager;
+        // Answers are delivered by the main thread, also when the first
+        // client happens to live in another one.
+        if (QCoreApplication::instance() != NULL)
+            manager->moveToThread(QCoreApplication::instance()->thread());
+    }
+    return manager;
+}
+
+FakeManager::FakeManager()
+        : QObject(), connection(NULL), linkUp(NULL), synchronous(false), inDelivery(0),
+        deliveryScheduled(false), handled(0), downUntil(0), delayTimer(this)
+{
+    clock.start();
+    delayTimer.setSingleShot(true);
+    QObject::connect(&delayTimer, SIGNAL(timeout()), this, SLOT(deliver()));
+}
+
+void FakeManager::addRule(resmsg_type_t request, Action action, int delay, int times)
+{
+    Rule rule;
+    rule.request = request;
+    rule.action = action;
+    rule.delay = delay;
+    rule.times = times;
+
+    QMutexLocker locker(&mutex);
+    rules.append(rule);
+}
+
+bool FakeManager::loadScript(const QString &script)
+{
+    static const char *requestNames[] = { "register", "acquire", "release", "update", "audio", "video" };
+    static const resmsg_type_t requestTypes[] = { RESMSG_REGISTER, RESMSG_ACQUIRE, RESMSG_RELEASE,
+                                                  RESMSG_UPDATE, RESMSG_AUDIO, RESMSG_VIDEO };
+    static const char *actionNames[] = { "grant", "deny", "fail", "drop" };
+
+    QList<Rule> parsed;
+    QStringList lines = script.split('\n');
+    for (int i = 0; i < lines.size(); i++) {
+        QString line = lines.at(i).section('#', 0, 0).trimmed();
+        if (line.isEmpty())
+            continue;
+
+        QStringList words = line.split(' ', QString::SkipEmptyParts);
+        if (words.size() < 2 || words.size() % 2 != 0)
+            return false;
+
+        Rule rule;
+        rule.delay = 0;
+        rule.times = -1;
+        int request = -1, action = -1;
+        for (int n = 0; n < 6; n++) {
+            if (words.at(0) == requestNames[n])
+                request = n;
+        }
+        for (int n = 0; n < 4; n++) {
+            if (words.at(1) == actionNames[n])
+                action = n;
+        }
+        if (request < 0 || action < 0)
+            return false;
+        rule.request = requestTypes[request];
+        rule.action = (Action)action;
+
+        for (int w = 2; w < words.size(); w += 2) {
+            bool ok;
+            int value = words.at(w + 1).toInt(&ok);
+            if (!ok || value < 0)
+                return false;
+            if (words.at(w) == "delay")
+                rule.delay = value;
+            else if (words.at(w) == "times")
+                rule.times = value;
+            else
+                return false;
+        }
+        parsed.append(rule);
+    }
+
+    QMutexLocker locker(&mutex);
+    rules += parsed;
+    return true;
+}
+
+void FakeManager::reset()
+{
+    QMutexLocker locker(&mutex);
+    rules.clear();
+    synchronous = false;
+}
+
+void FakeManager::setSynchronous(bool newSynchronous)
+{
+    QMutexLocker locker(&mutex);
+    synchronous = newSynchronous;
+}
+
+void FakeManager::preempt(quint32 setId)
+{
+    // A grant of nothing for a request the client never sent.
+    unsolicited(GrantReply, setId, 0);
+}
+
+void FakeManager::releaseSet(quint32 setId)
+{
+    unsolicited(ReleaseReply, setId, 0);
+}
+
+void FakeManager::advise(quint32 setId, quint32 resources)
+{
+    unsolicited(AdviceReply, setId, resources);
+}
+
+void FakeManager::restart(int downMs)
+{
+    Replies out;
+    {
+        QMutexLocker locker(&mutex);
+        QList<quint32> ids = registered.keys();
+        registered.clear();
+        Reply reply;
+        memset(&reply, 0, sizeof(reply));
+        for (int i = 0; i < ids.size(); i++) {
+            reply.type = UnregisterReply;
+            reply.libresourceSet = sets.value(ids.at(i));
+            reply.id = ids.at(i);
+            out.append(reply);
+        }
+        memset(&reply, 0, sizeof(reply));
+        reply.type = LinkUpReply;
+        reply.due = clock.elapsed() + downMs;
+        downUntil = reply.due;
+        out.append(reply);
+    }
+    post(out);
+}
+
+bool FakeManager::waitForIdle(int timeout)
+{
+    QTime timer;
+    timer.start();
+    for (;;) {
+        {
+            QMutexLocker locker(&mutex);
+            if (replies.isEmpty() && inDelivery == 0)
+                break;
+        }
+        if (timer.elapsed() > timeout)
+            return false;
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+    }
+    // Hand the signals the answers caused to their receivers.
+    QCoreApplication::processEvents();
+    return true;
+}
+
+int FakeManager::registeredSets()
+{
+    QMutexLocker locker(&mutex);
+    return registered.size();
+}
+
+quint64 FakeManager::handledMessages()
+{
+    QMutexLocker locker(&mutex);
+    return handled;
+}
+
+resconn_t *FakeManager::init(resconn_linkup_t linkUpCallback)
+{
+    QMutexLocker locker(&mutex);
+    if (connection == NULL)
+        connection = (resconn_t *) calloc(1, sizeof(resconn_t));
+    linkUp = linkUpCallback;
+    return connection;
+}
+
+void FakeManager::setHandler(resmsg_type_t type, resproto_handler_t handler)
+{
+    QMutexLocker locker(&mutex);
+    handlers.insert(type, handler);
+}
+
+resset_t *FakeManager::connect(resmsg_t *message, resproto_status_t statusCallback)
+{
+    Replies out;
+    resset_t *libresourceSet;
+    {
+        QMutexLocker locker(&mutex);
+        libresourceSet = sets.value(message->record.id);
+        if (libresourceSet == NULL) {
+            libresourceSet = (resset_t *) calloc(1, sizeof(resset_t));
+            libresourceSet->id = message->record.id;
+            sets.insert(message->record.id, libresourceSet);
+        }
+        answer(out, libresourceSet, message, statusCallback);
+    }
+    post(out, false);
+    return libresourceSet;
+}
+
+int FakeManager::disconnect(resset_t *libresourceSet, resmsg_t *message,
+                            resproto_status_t statusCallback)
+{
+    Replies out;
+    {
+        QMutexLocker locker(&mutex);
+        answer(out, libresourceSet, message, statusCallback);
+    }
+    post(out, false);
+    return 1;
+}
+
+int FakeManager::send(resset_t *libresourceSet, resmsg_t *message,
+                      resproto_status_t statusCallback)
+{
+    Replies out;
+    {
+        QMutexLocker locker(&mutex);
+        if (!registered.contains(message->any.id))
+            return 0;
+        answer(out, libresourceSet, message, statusCallback);
+    }
+    post(out);
+    return 1;
+}
+
+// Called with the mutex held.
+FakeManager::Action FakeManager::decide(resmsg_type_t request, int &delay)
+{
+    delay = 0;
+    for (int i = 0; i < rules.size(); i++) {
+        Rule &rule = rules[i];
+        if (rule.request != request || rule.times == 0)
+            continue;
+        if (rule.times > 0)
+            rule.times--;
+        delay = rule.delay;
+        return rule.action;
+    }
+    return Grant;
+}
+
+// Works out the answers to a message. Called with the mutex held.
+void FakeManager::answer(Replies &out, resset_t *libresourceSet, resmsg_t *message,
+                         resproto_status_t statusCallback)
+{
+    handled++;
+
+    // Unregistration always goes through, as with the real manager.
+    int delay = 0;
+    Action action = Grant;
+    if (message->type == RESMSG_UNREGISTER)
+        registered.remove(message->record.id);
+    else if (clock.elapsed() < downUntil)
+        action = Fail;
+    else
+        action = decide(message->type, delay);
+
+    if (action == Drop)
+        return;
+    if (action == Deny && message->type != RESMSG_ACQUIRE)
+        action = Fail;
+
+    Reply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.type = StatusReply;
+    reply.libresourceSet = libresourceSet;
+    reply.statusCallback = statusCallback;
+    reply.id = message->any.id;
+    reply.reqno = message->any.reqno;
+    reply.error = action == Fail ? 1 : 0;
+    reply.due = clock.elapsed() + delay;
+    out.append(reply);
+    if (action == Fail)
+        return;
+
+    switch (message->type) {
+    case RESMSG_REGISTER:
+    case RESMSG_UPDATE:
+        registered.insert(message->record.id, message->record.rset.all);
+        break;
+    case RESMSG_ACQUIRE:
+        reply.type = GrantReply;
+        reply.resources = action == Grant ? registered.value(message->any.id) : 0;
+        out.append(reply);
+        break;
+    case RESMSG_RELEASE:
+        reply.type = GrantReply;
+        out.append(reply);
+        break;
+    default:
+        break;
+    }
+}
+
+void FakeManager::unsolicited(ReplyType type, quint32 setId, quint32 resources)
+{
+    Replies out;
+    {
+        QMutexLocker locker(&mutex);
+        if (!registered.contains(setId))
+            return;
+        Reply reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.type = type;
+        reply.libresourceSet = sets.value(setId);
+        reply.id = setId;
+        reply.resources = resources;
+        reply.due = clock.elapsed();
+        out.append(reply);
+    }
+    post(out);
+}
+
+// Delivers the answers right away in synchronous mode, unless they are
+// delayed, and otherwise queues them for deliver().
+void FakeManager::post(Replies &out, bool mayDeliverNow)
+{
+    QMutexLocker locker(&mutex);
+    if (synchronous && mayDeliverNow) {
+        bool delayed = false;
+        for (int i = 0; i < out.size(); i++) {
+            delayed = delayed || out.at(i).due > clock.elapsed();
+        }
+        if (!delayed && replies.isEmpty()) {
+            inDelivery++;
+            locker.unlock();
+            deliverNow(out);
+            locker.relock();
+            inDelivery--;
+            return;
+        }
+    }
+
+    replies += out;
+    if (!deliveryScheduled) {
+        deliveryScheduled = true;
+        QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+    }
+}
+
+void FakeManager::deliver()
+{
+    Replies delivering;
+    int next = -1;
+    {
+        QMutexLocker locker(&mutex);
+        deliveryScheduled = false;
+        int now = clock.elapsed();
+        Replies waiting;
+        for (int i = 0; i < replies.size(); i++) {
+            const Reply &reply = replies.at(i);
+            if (reply.due <= now) {
+                delivering.append(reply);
+            } else {
+                waiting.append(reply);
+                if (next < 0 || reply.due < next)
+                    next = reply.due;
+            }
+        }
+        replies = waiting;
+        inDelivery++;
+        if (next >= 0)
+            next -= now;
+    }
+
+    if (next >= 0)
+        delayTimer.start(next);
+
+    deliverNow(delivering);
+
+    QMutexLocker locker(&mutex);
+    inDelivery--;
+}
+
+void FakeManager::deliverNow(const Replies &delivering)
+{
+    resconn_t *linkedConnection;
+    resconn_linkup_t linkUpCallback;
+    QHash<int, resproto_handler_t> callbacks;
+    {
+        QMutexLocker locker(&mutex);
+        linkedConnection = connection;
+        linkUpCallback = linkUp;
+        callbacks = handlers;
+    }
+
+    static const char *errorMessage = "refused by the fake manager";
+    for (int i = 0; i < delivering.size(); i++) {
+        const Reply &reply = delivering.at(i);
+        resmsg_t message;
+        memset(&message, 0, sizeof(message));
+        resproto_handler_t handler = NULL;
+        switch (reply.type) {
+        case StatusReply:
+            message.status.type = RESMSG_STATUS;
+            message.status.id = reply.id;
+            message.status.reqno = reply.reqno;
+            message.status.errcod = reply.error;
+            message.status.errmsg = reply.error ? (char *) errorMessage : NULL;
+            reply.statusCallback(reply.libresourceSet, &message);
+            continue;
+        case GrantReply:
+            message.notify.type = RESMSG_GRANT;
+            handler = callbacks.value(RESMSG_GRANT);
+            break;
+        case ReleaseReply:
+            message.notify.type = RESMSG_RELEASE;
+            handler = callbacks.value(RESMSG_RELEASE);
+            break;
+        case AdviceReply:
+            message.notify.type = RESMSG_ADVICE;
+            handler = callbacks.value(RESMSG_ADVICE);
+            break;
+        case UnregisterReply:
+            message.any.type = RESMSG_UNREGISTER;
+            message.any.id = reply.id;
+            handler = callbacks.value(RESMSG_UNREGISTER);
+            if (handler != NULL)
+                handler(&message, reply.libresourceSet, NULL);
+            continue;
+        case LinkUpReply:
+            if (linkUpCallback != NULL)
+                linkUpCallback(linkedConnection);
+            continue;
+        }
+
+        message.notify.id = reply.id;
+        message.notify.reqno = reply.reqno;
+        message.notify.resrc = reply.resources;
+        if (handler != NULL)
+            handler(&message, reply.libresourceSet, NULL);
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// The client side of libresource and the system bus, routed to the fake.
+
+DBusConnection *dbus_bus_get_private(DBusBusType, DBusError *)
+{
+    static int dummyConnection;
+    return reinterpret_cast<DBusConnection *>(&dummyConnection);
+}
+
+bool DBUSConnectionEventLoop::addConnection(DBusConnection *)
+{
+    return true;
+}
+
+resconn_t *resproto_init(resproto_role_t, resproto_transport_t transport, ...)
+{
+    va_list args;
+    va_start(args, transport);
+    resconn_linkup_t linkUp = va_arg(args, resconn_linkup_t);
+    va_end(args);
+
+    return FakeManager::instance()->init(linkUp);
+}
+
+int resproto_set_handler(union resconn_u *, resmsg_type_t type,
+                         resproto_handler_t callbackFunction)
+{
+    FakeManager::instance()->setHandler(type, callbackFunction);
+    return 1;
+}
+
+resset_t *resconn_connect(resconn_t *, resmsg_t *message, resproto_status_t callbackFunction)
+{
+    return FakeManager::instance()->connect(message, callbackFunction);
+}
+
+int resconn_disconnect(resset_t *libresourceSet, resmsg_t *message,
+                       resproto_status_t callbackFunction)
+{
+    return FakeManager::instance()->disconnect(libresourceSet, message, callbackFunction);
+}
+
+int resproto_send_message(resset_t *libresourceSet, resmsg_t *message,
+                          resproto_status_t callbackFunction)
+{
+    return FakeManager::instance()->send(libresourceSet, message, callbackFunction);
+}
@@ -0,0 +1,171 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef FAKE_MANAGER_H
+#define FAKE_MANAGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QTime>
+#include <QTimer>
+#include <res-conn.h>
+
+// An in-process stand-in for the resource policy manager, built as the
+// static library fake-libresource. It replaces the client side of
+// libresource (resproto_init(), resconn_connect(), resproto_send_message()
+// and friends) and the system bus, so programs linking it talk to the
+// manager without D-Bus or a running policy daemon.
+//
+// Like the real manager it answers asynchronously by default: every
+// request gets a status reply and, for acquire and release, a grant,
+// delivered from the event loop of the main thread. In synchronous mode
+// the answers are delivered before the request returns, which is what
+// high-volume tests want. Registration and unregistration are still
+// answered from the event loop: the client only learns its libresource set
+// when connecting returns, and may delete itself on the unregister reply.
+//
+// What the manager answers is decided by rules, see addRule() and
+// loadScript(). Requests no rule matches are granted all resources of the
+// set.
+class FakeManager: public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(FakeManager)
+
+public:
+    enum Action {
+        Grant,  // status, and for acquire a grant of every resource of the set
+        Deny,   // status, and for acquire an empty grant; Fail for others
+        Fail,   // an error status
+        Drop    // no answer at all
+    };
+
+    static FakeManager *instance();
+
+    // Adds a rule for requests of the given type (RESMSG_REGISTER,
+    // RESMSG_ACQUIRE, RESMSG_RELEASE, RESMSG_UPDATE, RESMSG_AUDIO or
+    // RESMSG_VIDEO). The first rule for a type that has uses left decides;
+    // times < 0 never runs out. The answer is held back for delay ms.
+    void addRule(resmsg_type_t request, Action action, int delay = 0, int times = -1);
+
+    // Adds the rules of a script with one rule per line:
+    //   <request> <action> [delay <ms>] [times <n>]
+    // with request one of register, acquire, release, update, audio or
+    // video and action one of grant, deny, fail or drop. Text after '#' is
+    // ignored. Returns false, adding nothing, if a line does not parse.
+    bool loadScript(const QString &script);
+
+    // Removes all rules and leaves synchronous mode.
+    void reset();
+
+    void setSynchronous(bool synchronous);
+
+    // Unsolicited messages of the manager to a registered set.
+    void preempt(quint32 setId);
+    void releaseSet(quint32 setId);
+    void advise(quint32 setId, quint32 resources);
+
+    // Drops every registration and comes back up, like a restart of the
+    // policy manager. The sets react by registering again. For downMs
+    // milliseconds before it is back, every request fails.
+    void restart(int downMs = 0);
+
+    // Runs the event loop until every queued answer has been delivered.
+    // Returns false if that takes longer than timeout milliseconds.
+    bool waitForIdle(int timeout = 5000);
+
+    int registeredSets();
+    quint64 handledMessages();
+
+    // libresource entry points, see fake-manager.cpp.
+    resconn_t *init(resconn_linkup_t linkUp);
+    void setHandler(resmsg_type_t type, resproto_handler_t handler);
+    resset_t *connect(resmsg_t *message, resproto_status_t statusCallback);
+    int disconnect(resset_t *libresourceSet, resmsg_t *message, resproto_status_t statusCallback);
+    int send(resset_t *libresourceSet, resmsg_t *message, resproto_status_t statusCallback);
+
+private slots:
+    void deliver();
+
+private:
+    FakeManager();
+
+    enum ReplyType { StatusReply, GrantReply, UnregisterReply, ReleaseReply,
+                     AdviceReply, LinkUpReply };
+
+    struct Reply
+    {
+        ReplyType type;
+        resset_t *libresourceSet;
+        resproto_status_t statusCallback;
+        quint32 id;
+        quint32 reqno;
+        quint32 resources;
+        qint32 error;
+        int due;
+    };
+
+    struct Rule
+    {
+        resmsg_type_t request;
+        Action action;
+        int delay;
+        int times;
+    };
+
+    typedef QList<Reply> Replies;
+
+    Action decide(resmsg_type_t request, int &delay);
+    void answer(Replies &out, resset_t *libresourceSet, resmsg_t *message,
+                resproto_status_t statusCallback);
+    void unsolicited(ReplyType type, quint32 setId, quint32 resources);
+    void post(Replies &out, bool mayDeliverNow = true);
+    void deliverNow(const Replies &delivering);
+
+    // Guards everything below. Never held while calling back into the
+    // client, which takes its own locks and may send from there.
+    QMutex mutex;
+    resconn_t *connection;
+    resconn_linkup_t linkUp;
+    QHash<int, resproto_handler_t> handlers;
+    // The libresource set of every client set, by set id. Sets are kept
+    // across unregistration, the client may still hold them.
+    QHash<quint32, resset_t *> sets;
+    // The resources of every registered set.
+    QHash<quint32, quint32> registered;
+    QList<Rule> rules;
+    bool synchronous;
+    Replies replies;
+    int inDelivery;
+    bool deliveryScheduled;
+    quint64 handled;
+    QTime clock;
+    // Requests fail until the clock reaches this, see restart().
+    int downUntil;
+    // Wakes deliver() for the earliest delayed answer. Only touched from
+    // the thread of the manager.
+    QTimer delayTimer;
+};
+
+#endif
@@ -0,0 +1,41 @@
+##############################################################################
+#  This file is part of libresourceqt                                        #
+#                                                                            #
+#  Copyright (C) 2011 Nokia Corporation.                                     #
+#                                                                            #
+#  This library is free software; you can redistribute                       #
+#  it and/or modify it under the terms of the GNU Lesser General Public      #
+#  License as published by the Free Software Foundation                      #
+#  version 2.1 of the License.                                               #
+#                                                                            #
+#  This library is distributed in the hope that it will be useful,           #
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of            #
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          #
+#  Lesser General Public License for more details.                           #
+#                                                                            #
+#  You should have received a copy of the GNU Lesser General Public          #
+#  License along with this library; if not, write to the Free Software       #
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  #
+#  USA.                                                                      #
+##############################################################################
+
+
+include(../../common.pri)
+TEMPLATE = lib
+TARGET = fake-libresource
+DESTDIR = build
+DEPENDPATH += .
+INCLUDEPATH += $${LIBDBUSQEVENTLOOP} /usr/include/resource
+
+# The in-process fake policy manager, linked statically by the tests and
+# benchmarks that run without D-Bus. Not installed.
+HEADERS +=  fake-manager.h
+SOURCES +=  fake-manager.cpp
+
+OBJECTS_DIR = build
+MOC_DIR = build/moc
+QMAKE_CXXFLAGS += -Wall
+
+CONFIG  += qt staticlib warn_on link_pkgconfig
+QT = core
+PKGCONFIG += dbus-1
@@ -37,6 +37,9 @@ SOURCES +=  $${LIBRESOURCEQT}/src/resource.cpp \
             $${LIBRESOURCEQT}/src/resources.cpp \
             $${LIBRESOURCEQT}/src/resource-engine.cpp \
             $${LIBRESOURCEQT}/src/audio-resource.cpp \
+            $${LIBRESOURCEQT}/src/resource-latency-histogram.cpp \
+            $${LIBRESOURCEQT}/src/resource-log.cpp \
+            $${LIBRESOURCEQT}/src/resource-request-future.cpp \
             $${LIBRESOURCEQT}/src/resource-set.cpp \
             test-auto-release.cpp
 
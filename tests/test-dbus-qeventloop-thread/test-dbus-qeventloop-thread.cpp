@@ -0,0 +1,292 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "dbusconnectioneventloop.h"
+#include <QtTest/QtTest>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThread>
+
+// The test talks to itself: one connection serves the calls that another
+// makes, and both are run by the I/O thread of the event loop.
+static const char *SERVICE = "com.nokia.dbusqeventloop.threadtest";
+
+class TestDbusQEventLoopThread;
+
+// One outstanding call. The reply is taken by whichever comes first: the
+// notify function, or the sender noticing that the call already completed
+// before the notify function was set.
+struct Call
+{
+    Call(TestDbusQEventLoopThread *test, DBusPendingCall *pending) : test(test), pending(pending), claimed(0) {}
+
+    TestDbusQEventLoopThread*   test;
+    DBusPendingCall*            pending;
+    QAtomicInt                  claimed;
+};
+
+// Sends calls from a thread of its own
+class CallerThread: public QThread
+{
+public:
+    CallerThread(TestDbusQEventLoopThread *test, int count) : test(test), count(count), sent(0) {}
+
+    TestDbusQEventLoopThread *test;
+    int count;
+    int sent;
+
+protected:
+    void run();
+};
+
+class TestDbusQEventLoopThread: public QObject
+{
+    Q_OBJECT
+
+public:
+    DBusConnection*     server;
+    DBusConnection*     client;
+    QThread*            mainThread;
+
+    QMutex              resultMutex;
+    QList<Call*>        calls;
+    int                 replies;
+    int                 errors;
+    int                 notifiedInMainThread;
+    QSemaphore          finished;
+
+    TestDbusQEventLoopThread() : server(NULL), client(NULL), mainThread(NULL) {
+        resetValues();
+    }
+
+    void resetValues() {
+        QMutexLocker locker(&resultMutex);
+        qDeleteAll(calls);
+        calls.clear();
+        replies = 0;
+        errors = 0;
+        notifiedInMainThread = 0;
+        finished.acquire(finished.available());
+    }
+
+    // Sends a method call and arranges for its reply to be counted
+    bool call(const char *method, int timeout) {
+        const char *text = "kohutik";
+        DBusMessage *message = dbus_message_new_method_call(SERVICE, "/", NULL, method);
+        if (message == NULL)
+            return false;
+        dbus_message_append_args(message, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+
+        DBusPendingCall *pending = NULL;
+        dbus_connection_send_with_reply(client, message, &pending, timeout);
+        dbus_message_unref(message);
+        if (pending == NULL)
+            return false;
+
+        Call *outstanding = new Call(this, pending);
+        resultMutex.lock();
+        calls.append(outstanding);
+        resultMutex.unlock();
+
+        // Keep the call alive until it has been checked, the I/O thread
+        // may complete and release it at any moment
+        dbus_pending_call_ref(pending);
+        dbus_pending_call_set_notify(pending, TestDbusQEventLoopThread::pendingNotify, outstanding, NULL);
+        if (dbus_pending_call_get_completed(pending))
+            finish(outstanding);
+        dbus_pending_call_unref(pending);
+        return true;
+    }
+
+    static void finish(Call *call) {
+        if (!call->claimed.testAndSetOrdered(0, 1))
+            return;
+
+        TestDbusQEventLoopThread *pThis = call->test;
+        DBusMessage *reply = dbus_pending_call_steal_reply(call->pending);
+        const char *text = NULL;
+        bool isError = reply == NULL || dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR;
+
+        if (!isError)
+            dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+
+        pThis->resultMutex.lock();
+        if (isError)
+            pThis->errors++;
+        else if (text != NULL && strcmp(text, "kohutik") == 0)
+            pThis->replies++;
+        pThis->resultMutex.unlock();
+
+        if (reply)
+            dbus_message_unref(reply);
+        dbus_pending_call_unref(call->pending);
+        pThis->finished.release();
+    }
+
+    static void pendingNotify(DBusPendingCall *, void *user_data) {
+        Call *call = reinterpret_cast<Call *>(user_data);
+        TestDbusQEventLoopThread *pThis = call->test;
+
+        if (QThread::currentThread() == pThis->mainThread) {
+            QMutexLocker locker(&pThis->resultMutex);
+            pThis->notifiedInMainThread++;
+        }
+        finish(call);
+    }
+
+    // Answers "ping" with its argument and never answers "ignore"
+    static DBusHandlerResult serverFilter(DBusConnection *connection, DBusMessage *message, void *) {
+        if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL ||
+            dbus_message_get_member(message) == NULL)
+            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+        if (strcmp(dbus_message_get_member(message), "ignore") == 0)
+            return DBUS_HANDLER_RESULT_HANDLED;
+        if (strcmp(dbus_message_get_member(message), "ping") != 0)
+            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+        const char *text = NULL;
+        dbus_message_get_args(message, NULL, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+
+        DBusMessage *reply = dbus_message_new_method_return(message);
+        dbus_message_append_args(reply, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+        dbus_connection_send(connection, reply, NULL);
+        dbus_message_unref(reply);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+private slots:
+    void initTestCase() {
+        mainThread = QThread::currentThread();
+
+        // The mode has to be chosen before there are connections
+        QVERIFY(DBUSConnectionEventLoop::setIoThreadEnabled(true) == true);
+        QVERIFY(DBUSConnectionEventLoop::isIoThreadEnabled() == true);
+        QVERIFY(DBUSConnectionEventLoop::backend() == DBUSConnectionEventLoop::EpollBackend);
+        QVERIFY(DBUSConnectionEventLoop::setBackend(DBUSConnectionEventLoop::SocketNotifierBackend) == false);
+
+        server = dbus_bus_get_private(DBUS_BUS_SESSION, NULL);
+        client = dbus_bus_get_private(DBUS_BUS_SESSION, NULL);
+        QVERIFY(server != NULL);
+        QVERIFY(client != NULL);
+        dbus_connection_set_exit_on_disconnect(server, FALSE);
+        dbus_connection_set_exit_on_disconnect(client, FALSE);
+
+        QVERIFY(dbus_bus_request_name(server, SERVICE, DBUS_NAME_FLAG_DO_NOT_QUEUE, NULL) ==
+                DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER);
+        QVERIFY(dbus_connection_add_filter(server, TestDbusQEventLoopThread::serverFilter, NULL, NULL));
+
+        QVERIFY(DBUSConnectionEventLoop::addConnection(server) == true);
+        QVERIFY(DBUSConnectionEventLoop::addConnection(client) == true);
+
+        // Connections are there now
+        QVERIFY(DBUSConnectionEventLoop::setIoThreadEnabled(false) == false);
+    }
+
+    void cleanupTestCase() {
+        resetValues();
+
+        DBUSConnectionEventLoop::removeConnection(client);
+        DBUSConnectionEventLoop::removeConnection(server);
+        dbus_connection_close(client);
+        dbus_connection_close(server);
+        dbus_connection_unref(client);
+        dbus_connection_unref(server);
+
+        QVERIFY(DBUSConnectionEventLoop::setIoThreadEnabled(false) == true);
+        QVERIFY(DBUSConnectionEventLoop::isIoThreadEnabled() == false);
+    }
+
+    // The main thread does not run its event loop while waiting, so the
+    // reply can only arrive through the I/O thread.
+    void pingWithBlockedMainThreadTest() {
+        resetValues();
+
+        QVERIFY(call("ping", 3000));
+        QVERIFY(finished.tryAcquire(1, 4000));
+
+        QMutexLocker locker(&resultMutex);
+        QCOMPARE(replies, 1);
+        QCOMPARE(errors, 0);
+        QCOMPARE(notifiedInMainThread, 0);
+    }
+
+    // The timeout is armed from the main thread and has to fire in the I/O thread
+    void timeoutWithBlockedMainThreadTest() {
+        resetValues();
+
+        QVERIFY(call("ignore", 300));
+        QVERIFY(finished.tryAcquire(1, 3000));
+
+        QMutexLocker locker(&resultMutex);
+        QCOMPARE(replies, 0);
+        QCOMPARE(errors, 1);
+        QCOMPARE(notifiedInMainThread, 0);
+    }
+
+    void pingFromManyThreadsTest() {
+        const int threadCount = 4;
+        const int callsPerThread = 250;
+        CallerThread *threads[threadCount];
+        int sent = 0;
+
+        resetValues();
+
+        for (int i = 0; i < threadCount; i++) {
+            threads[i] = new CallerThread(this, callsPerThread);
+            threads[i]->start();
+        }
+        for (int i = 0; i < threadCount; i++) {
+            QVERIFY(threads[i]->wait(10000));
+            sent += threads[i]->sent;
+            delete threads[i];
+        }
+
+        QCOMPARE(sent, threadCount * callsPerThread);
+        QVERIFY(finished.tryAcquire(sent, 10000));
+
+        QMutexLocker locker(&resultMutex);
+        QCOMPARE(replies, sent);
+        QCOMPARE(errors, 0);
+        QCOMPARE(notifiedInMainThread, 0);
+    }
+
+    // The dispatcher runs in the I/O thread
+    void dispatchStatisticsTest() {
+        DBUSConnectionEventLoop::DispatchStatistics before = DBUSConnectionEventLoop::dispatchStatistics();
+        resetValues();
+        QVERIFY(call("ping", 3000));
+        QVERIFY(finished.tryAcquire(1, 4000));
+        DBUSConnectionEventLoop::DispatchStatistics after = DBUSConnectionEventLoop::dispatchStatistics();
+        QVERIFY(after.messages > before.messages);
+    }
+};
+
+void CallerThread::run()
+{
+    for (int i = 0; i < count; i++) {
+        if (test->call("ping", 5000))
+            sent++;
+    }
+}
+
+QTEST_MAIN(TestDbusQEventLoopThread)
+#include "test-dbus-qeventloop-thread.moc"
@@ -24,6 +24,23 @@ USA.
 #include "dbusconnectioneventloop.h"
 #include <stdint.h>
 #include <QtTest/QtTest>
+#include <QThread>
+
+// Wakes the event loop up repeatedly, as libdbus does from its own threads
+class WakeupThread: public QThread
+{
+public:
+    WakeupThread(int count) : count(count) {}
+
+protected:
+    void run() {
+        for (int i = 0; i < count; i++)
+            DBUSConnectionEventLoop::wakeup();
+    }
+
+private:
+    int count;
+};
 
 class TestDbusQEventLoop: public QObject
 {
@@ -153,6 +170,11 @@ protected:
 
 private slots:
     void initTestCase() {
+        // Select the backend under test, the socket notifiers by default
+        if (qgetenv("DBUS_QEVENTLOOP_BACKEND") == "epoll") {
+            QVERIFY(DBUSConnectionEventLoop::setBackend(DBUSConnectionEventLoop::EpollBackend) == true);
+        }
+
         // First allocate and obtain
         systemBus = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
         sessionBus = dbus_bus_get(DBUS_BUS_SESSION, NULL);
@@ -296,6 +318,123 @@ private slots:
         // Small pause to process reply
         sleep(1);
     }
+
+    void budgetedDispatchSessionBusTest() {
+        const int count = 20;
+        DBusPendingCall* pending[count];
+        const char* temp = "pekny kohutik";
+
+        // One message per turn, the rest has to be rescheduled
+        DBUSConnectionEventLoop::setDispatchBudget(1, 0);
+        DBUSConnectionEventLoop::resetDispatchStatistics();
+
+        // Send a burst of pings
+        for (int i = 0; i < count; i++) {
+            DBusMessage* message = dbus_message_new_method_call("com.nokia.dbusqeventloop.test", "/", NULL, "ping");
+            QVERIFY(message != NULL);
+            dbus_message_append_args(message, DBUS_TYPE_STRING, &temp, DBUS_TYPE_INVALID);
+            dbus_connection_send_with_reply(sessionBus, message, &pending[i], 3000);
+            dbus_message_unref(message);
+        }
+
+        // Pump QT event loop until every reply has arrived
+        resetValues();
+        int activeTimer = startTimer(4000);
+        int completed = 0;
+        while (completed < count && !timerTimeout) {
+            QCoreApplication::processEvents(QEventLoop::AllEvents);
+            completed = 0;
+            for (int i = 0; i < count; i++)
+                completed += dbus_pending_call_get_completed(pending[i]) ? 1 : 0;
+        }
+        if (!timerTimeout)
+            killTimer(activeTimer);
+
+        for (int i = 0; i < count; i++)
+            dbus_pending_call_unref(pending[i]);
+
+        DBUSConnectionEventLoop::DispatchStatistics statistics = DBUSConnectionEventLoop::dispatchStatistics();
+        DBUSConnectionEventLoop::setDispatchBudget(64, 4000);
+
+        // Check results
+        QVERIFY(timerTimeout == false);
+        QCOMPARE(completed, count);
+        QVERIFY(statistics.messages >= (quint64)count);
+        QVERIFY(statistics.turns >= statistics.messages);
+        QVERIFY(statistics.maxTurnNs >= statistics.lastTurnNs);
+        QVERIFY(statistics.totalTurnNs >= statistics.maxTurnNs);
+    }
+
+    void connectionStatisticsTest() {
+        DBUSConnectionEventLoop::resetDispatchStatistics();
+
+        // Adding a connection twice keeps a single entry
+        QVERIFY(DBUSConnectionEventLoop::addConnection(sessionBus) == true);
+
+        // Create message
+        DBusMessage* message = dbus_message_new_method_call("com.nokia.dbusqeventloop.test", "/", NULL, "ping");
+        QVERIFY(message != NULL);
+        const char* temp = "pekny kohutik";
+        dbus_message_append_args(message, DBUS_TYPE_STRING, &temp, DBUS_TYPE_INVALID);
+
+        DBusPendingCall* pending;
+        dbus_connection_send_with_reply(sessionBus, message, &pending, 3000);
+        dbus_message_unref(message);
+        processQTEventLoop(pending, 4000);
+        QVERIFY(timerTimeout == false);
+
+        // The reply was read and dispatched on the session bus, once
+        DBUSConnectionEventLoop::ConnectionStatistics session = DBUSConnectionEventLoop::connectionStatistics(sessionBus);
+        DBUSConnectionEventLoop::DispatchStatistics all = DBUSConnectionEventLoop::dispatchStatistics();
+        QVERIFY(session.messages >= 1);
+        QVERIFY(session.bytesRead > 0);
+        QVERIFY(session.dispatchNs >= 0);
+        QVERIFY(session.messages <= all.messages);
+
+        // Nothing is known of connections that were not added
+        DBUSConnectionEventLoop::ConnectionStatistics unknown = DBUSConnectionEventLoop::connectionStatistics(NULL);
+        QCOMPARE(unknown.messages, (quint64)0);
+        QCOMPARE(unknown.bytesRead, (quint64)0);
+    }
+
+    void coalescedWakeupTest() {
+        const int threadCount = 4;
+        const int wakeupsPerThread = 5000;
+        WakeupThread* threads[threadCount];
+
+        DBUSConnectionEventLoop::resetDispatchStatistics();
+
+        // Fire the wakeups while the event loop is not running
+        for (int i = 0; i < threadCount; i++) {
+            threads[i] = new WakeupThread(wakeupsPerThread);
+            threads[i]->start();
+        }
+        for (int i = 0; i < threadCount; i++) {
+            QVERIFY(threads[i]->wait(10000));
+            delete threads[i];
+        }
+
+        // And some from the loop's own thread
+        for (int i = 0; i < wakeupsPerThread; i++)
+            DBUSConnectionEventLoop::wakeup();
+
+        QCoreApplication::processEvents(QEventLoop::AllEvents);
+        QCoreApplication::processEvents(QEventLoop::AllEvents);
+
+        // All of them should have been served by a single dispatcher run,
+        // allow one more for wakeups that libdbus itself may have made
+        DBUSConnectionEventLoop::DispatchStatistics statistics = DBUSConnectionEventLoop::dispatchStatistics();
+        quint64 runs = statistics.scheduledRuns;
+        QVERIFY(statistics.wakeups >= (quint64)(threadCount + 1) * wakeupsPerThread);
+        QVERIFY(runs >= 1);
+        QVERIFY(runs <= 2);
+
+        // A wakeup after the run schedules a new one
+        DBUSConnectionEventLoop::wakeup();
+        QCoreApplication::processEvents(QEventLoop::AllEvents);
+        statistics = DBUSConnectionEventLoop::dispatchStatistics();
+        QVERIFY(statistics.scheduledRuns > runs);
+    }
 };
 
 QTEST_MAIN(TestDbusQEventLoop)
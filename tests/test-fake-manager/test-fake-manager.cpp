@@ -0,0 +1,348 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "test-fake-manager.h"
+#include "fake-manager.h"
+#include <QSignalSpy>
+#include <QTime>
+
+using namespace ResourcePolicy;
+
+TestFakeManager::TestFakeManager()
+        : resourceSet(NULL), availableCount(0), errorCount(0), lastError(0)
+{
+}
+
+TestFakeManager::~TestFakeManager()
+{
+}
+
+void TestFakeManager::resourcesBecameAvailable(const QList<ResourceType> &)
+{
+    availableCount++;
+}
+
+void TestFakeManager::errorCallback(quint32 code, const char *)
+{
+    errorCount++;
+    lastError = code;
+}
+
+void TestFakeManager::init()
+{
+    availableCount = 0;
+    errorCount = 0;
+    lastError = 0;
+
+    resourceSet = new ResourceSet("player", NULL, true, false);
+    resourceSet->addResource(AudioPlaybackType);
+    QObject::connect(resourceSet, SIGNAL(resourcesBecameAvailable(const QList<ResourcePolicy::ResourceType> &)),
+                     this, SLOT(resourcesBecameAvailable(const QList<ResourcePolicy::ResourceType> &)));
+    QObject::connect(resourceSet, SIGNAL(errorCallback(quint32, const char*)),
+                     this, SLOT(errorCallback(quint32, const char*)));
+    QVERIFY(resourceSet->initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(FakeManager::instance()->registeredSets(), 1);
+}
+
+void TestFakeManager::cleanup()
+{
+    FakeManager::instance()->reset();
+    delete resourceSet;
+    resourceSet = NULL;
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(FakeManager::instance()->registeredSets(), 0);
+}
+
+void TestFakeManager::testGrant()
+{
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QSignalSpy releasedSpy(resourceSet, SIGNAL(resourcesReleased()));
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(grantedSpy.count(), 1);
+    QVERIFY(resourceSet->resource(AudioPlaybackType)->isGranted());
+
+    QVERIFY(resourceSet->release());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(releasedSpy.count(), 1);
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestFakeManager::testDeny()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny);
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QSignalSpy deniedSpy(resourceSet, SIGNAL(resourcesDenied()));
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(deniedSpy.count(), 1);
+    QCOMPARE(grantedSpy.count(), 0);
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestFakeManager::testFail()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Fail);
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(errorCount, 1);
+    QCOMPARE(lastError, (quint32)1);
+    QCOMPARE(grantedSpy.count(), 0);
+}
+
+void TestFakeManager::testDrop()
+{
+    FakeManager *manager = FakeManager::instance();
+    manager->addRule(RESMSG_ACQUIRE, FakeManager::Drop);
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QSignalSpy deniedSpy(resourceSet, SIGNAL(resourcesDenied()));
+    quint64 handled = manager->handledMessages();
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(manager->waitForIdle());
+    QCOMPARE(manager->handledMessages(), handled + 1);
+    QCOMPARE(grantedSpy.count(), 0);
+    QCOMPARE(deniedSpy.count(), 0);
+    QCOMPARE(errorCount, 0);
+}
+
+void TestFakeManager::testDelay()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Grant, 100);
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+
+    QTime timer;
+    timer.start();
+    QVERIFY(resourceSet->acquire());
+    QCoreApplication::processEvents();
+    QCOMPARE(grantedSpy.count(), 0);
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(timer.elapsed() >= 100);
+    QCOMPARE(grantedSpy.count(), 1);
+}
+
+void TestFakeManager::testRuleRunsOut()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny, 0, 1);
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QSignalSpy deniedSpy(resourceSet, SIGNAL(resourcesDenied()));
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(deniedSpy.count(), 1);
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(deniedSpy.count(), 1);
+    QCOMPARE(grantedSpy.count(), 1);
+}
+
+void TestFakeManager::testPreempt()
+{
+    QSignalSpy lostSpy(resourceSet, SIGNAL(lostResources()));
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(resourceSet->resource(AudioPlaybackType)->isGranted());
+
+    FakeManager::instance()->preempt(resourceSet->id());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(lostSpy.count(), 1);
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestFakeManager::testReleaseSet()
+{
+    QSignalSpy releasedByManagerSpy(resourceSet, SIGNAL(resourcesReleasedByManager()));
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    FakeManager::instance()->releaseSet(resourceSet->id());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(releasedByManagerSpy.count(), 1);
+}
+
+void TestFakeManager::testAdvise()
+{
+    FakeManager::instance()->advise(resourceSet->id(), RESMSG_AUDIO_PLAYBACK);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(availableCount, 1);
+}
+
+void TestFakeManager::testRestart()
+{
+    FakeManager *manager = FakeManager::instance();
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(manager->waitForIdle());
+
+    manager->restart();
+    QVERIFY(manager->waitForIdle());
+    QCOMPARE(manager->registeredSets(), 1);
+    QVERIFY(resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestFakeManager::testTimeout()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QSignalSpy timedOutSpy(resourceSet, SIGNAL(requestTimedOut(ResourcePolicy::ResourceRequest)));
+
+    QVERIFY(resourceSet->acquire(50));
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QTest::qWait(200);
+    QCOMPARE(timedOutSpy.count(), 1);
+    QCOMPARE(timedOutSpy.at(0).at(0).value<ResourcePolicy::ResourceRequest>(), AcquireRequest);
+    QCOMPARE(grantedSpy.count(), 0);
+    QCOMPARE(resourceSet->outstandingRequests(), 0);
+
+    // The set is usable again right away.
+    QVERIFY(resourceSet->acquire(50));
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(grantedSpy.count(), 1);
+    QTest::qWait(100);
+    QCOMPARE(timedOutSpy.count(), 1);
+}
+
+void TestFakeManager::testTimeoutSendsNextRequest()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+    QSignalSpy releasedSpy(resourceSet, SIGNAL(resourcesReleased()));
+    QSignalSpy timedOutSpy(resourceSet, SIGNAL(requestTimedOut(ResourcePolicy::ResourceRequest)));
+
+    QVERIFY(resourceSet->acquire(50));
+    QVERIFY(resourceSet->release());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(releasedSpy.count(), 0);
+
+    QTest::qWait(200);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(timedOutSpy.count(), 1);
+    QCOMPARE(releasedSpy.count(), 1);
+}
+
+void TestFakeManager::testLateGrantIsReleased()
+{
+    FakeManager *manager = FakeManager::instance();
+    manager->addRule(RESMSG_ACQUIRE, FakeManager::Grant, 200, 1);
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QSignalSpy timedOutSpy(resourceSet, SIGNAL(requestTimedOut(ResourcePolicy::ResourceRequest)));
+    quint64 handled = manager->handledMessages();
+
+    QVERIFY(resourceSet->acquire(50));
+    QTest::qWait(100);
+    QCOMPARE(timedOutSpy.count(), 1);
+
+    // The grant arrives after the deadline and is handed back at once.
+    QVERIFY(manager->waitForIdle());
+    QVERIFY(manager->waitForIdle());
+    QCOMPARE(manager->handledMessages(), handled + 2);
+    QCOMPARE(grantedSpy.count(), 0);
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+    QCOMPARE(resourceSet->outstandingRequests(), 0);
+}
+
+void TestFakeManager::testLoadScript_data()
+{
+    QTest::addColumn<QString>("script");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("empty") << "" << true;
+    QTest::newRow("comments") << "# nothing here\n\n   # nor here\n" << true;
+    QTest::newRow("options") << "acquire deny delay 10 times 2\nrelease grant # trailing comment" << true;
+    QTest::newRow("all requests") << "register grant\nacquire grant\nrelease grant\n"
+                                     "update grant\naudio grant\nvideo grant" << true;
+    QTest::newRow("unknown request") << "steal grant" << false;
+    QTest::newRow("unknown action") << "acquire maybe" << false;
+    QTest::newRow("missing action") << "acquire" << false;
+    QTest::newRow("missing value") << "acquire grant delay" << false;
+    QTest::newRow("bad value") << "acquire grant delay soon" << false;
+    QTest::newRow("negative value") << "acquire grant times -1" << false;
+    QTest::newRow("unknown option") << "acquire grant after 10" << false;
+    QTest::newRow("error on a later line") << "acquire deny\nacquire grant delay" << false;
+}
+
+void TestFakeManager::testLoadScript()
+{
+    QFETCH(QString, script);
+    QFETCH(bool, valid);
+
+    QCOMPARE(FakeManager::instance()->loadScript(script), valid);
+
+    // Scripts that do not parse leave no rules behind.
+    if (!valid) {
+        QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+        QVERIFY(resourceSet->acquire());
+        QVERIFY(FakeManager::instance()->waitForIdle());
+        QCOMPARE(grantedSpy.count(), 1);
+    }
+}
+
+void TestFakeManager::testScriptedPolicy()
+{
+    QVERIFY(FakeManager::instance()->loadScript("# deny once, then grant slowly\n"
+                                                "acquire deny times 1\n"
+                                                "acquire grant delay 20\n"
+                                                "release fail\n"));
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QSignalSpy deniedSpy(resourceSet, SIGNAL(resourcesDenied()));
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(deniedSpy.count(), 1);
+
+    QVERIFY(resourceSet->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(grantedSpy.count(), 1);
+
+    QVERIFY(resourceSet->release());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(errorCount, 1);
+}
+
+// In synchronous mode every request is answered before it returns, so a
+// tight loop drives the engine at the speed of the client code alone.
+void TestFakeManager::testSynchronousThroughput()
+{
+    const int rounds = 10000;
+    FakeManager *manager = FakeManager::instance();
+    manager->setSynchronous(true);
+    QSignalSpy grantedSpy(resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QSignalSpy releasedSpy(resourceSet, SIGNAL(resourcesReleased()));
+    quint64 handled = manager->handledMessages();
+
+    for (int i = 0; i < rounds; i++) {
+        QVERIFY(resourceSet->acquire());
+        QVERIFY(resourceSet->release());
+    }
+
+    QCOMPARE(grantedSpy.count(), rounds);
+    QCOMPARE(releasedSpy.count(), rounds);
+    QCOMPARE(manager->handledMessages(), handled + 2 * rounds);
+}
+
+QTEST_MAIN(TestFakeManager)
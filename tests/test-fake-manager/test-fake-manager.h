@@ -0,0 +1,69 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef TEST_FAKE_MANAGER_H
+#define TEST_FAKE_MANAGER_H
+
+#include <QtTest/QTest>
+#include <QObject>
+#include <QList>
+#include <policy/resource-set.h>
+
+class TestFakeManager: public QObject
+{
+    Q_OBJECT
+public:
+    TestFakeManager();
+    ~TestFakeManager();
+
+    ResourcePolicy::ResourceSet *resourceSet;
+    int availableCount;
+    int errorCount;
+    quint32 lastError;
+
+public slots:
+    void resourcesBecameAvailable(const QList<ResourcePolicy::ResourceType> &resources);
+    void errorCallback(quint32 code, const char *message);
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testGrant();
+    void testDeny();
+    void testFail();
+    void testDrop();
+    void testDelay();
+    void testRuleRunsOut();
+    void testPreempt();
+    void testReleaseSet();
+    void testAdvise();
+    void testRestart();
+    void testTimeout();
+    void testTimeoutSendsNextRequest();
+    void testLateGrantIsReleased();
+    void testLoadScript_data();
+    void testLoadScript();
+    void testScriptedPolicy();
+    void testSynchronousThroughput();
+};
+
+#endif
@@ -33,6 +33,9 @@ HEADERS +=  $${POLICY}/resources.h $${POLICY}/resource-set.h test-init.h \
 SOURCES +=  $${LIBRESOURCEQT}/src/resource.cpp $${LIBRESOURCEQT}/src/resources.cpp \
             $${LIBRESOURCEQT}/src/resource-engine.cpp \
             $${LIBRESOURCEQT}/src/audio-resource.cpp \
+            $${LIBRESOURCEQT}/src/resource-latency-histogram.cpp \
+            $${LIBRESOURCEQT}/src/resource-log.cpp \
+            $${LIBRESOURCEQT}/src/resource-request-future.cpp \
             $${LIBRESOURCEQT}/src/resource-set.cpp test-init.cpp
 
 OBJECTS_DIR = build
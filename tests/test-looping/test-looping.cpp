@@ -242,4 +242,64 @@ void TestLooping::loopReleaseSendNoWait2()
     QCOMPARE(stateSpyReleased.count(), 1);
 }
 
+// Flap between acquire and release while the first acquire is in flight.
+// Every pair cancels out, so only the first acquire and the final release
+// reach the manager.
+void TestLooping::loopAcquireReleaseCoalesced()
+{
+    ResourceSet resourceSet("player");
+    QVERIFY(resourceSet.setRequestCoalescing());
+    QVERIFY(resourceSet.willCoalesceRequests());
+
+    QSignalSpy stateSpyGranted(&resourceSet,
+            SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    QVERIFY(stateSpyGranted.isValid());
+    QSignalSpy stateSpyReleased(&resourceSet, SIGNAL(resourcesReleased()));
+    QVERIFY(stateSpyReleased.isValid());
+
+    resourceSet.addResource(AudioPlaybackType);
+    resourceSet.initAndConnect();
+    waitForSignal(&resourceSet, SIGNAL(managerIsUp()));
+
+    QVERIFY(resourceSet.acquire());
+    for (int i = 0; i < 10000; i++) {
+        bool releaseOk = resourceSet.release();
+        QVERIFY(releaseOk);
+
+        bool acquireOk = resourceSet.acquire();
+        QVERIFY(acquireOk);
+    }
+    QCOMPARE(resourceSet.coalescedRequests(), (quint32)20000);
+
+    QVERIFY(resourceSet.release());
+    waitForSignal(&resourceSet, SIGNAL(resourcesGranted(const QList<ResourcePolicy::ResourceType> &)));
+    waitForSignal(&resourceSet, SIGNAL(resourcesReleased()));
+    // Wait for more possible signals..
+    QTest::qWait(1000);
+    QCOMPARE(stateSpyGranted.count(), 1);
+    QCOMPARE(stateSpyReleased.count(), 1);
+    QCOMPARE(resourceSet.coalescedRequests(), (quint32)20000);
+}
+
+// Updates queued behind one in flight merge into a single update.
+void TestLooping::loopUpdateCoalesced()
+{
+    ResourceSet resourceSet("player");
+    QVERIFY(resourceSet.setRequestCoalescing());
+
+    resourceSet.addResource(AudioPlaybackType);
+    resourceSet.initAndConnect();
+    waitForSignal(&resourceSet, SIGNAL(managerIsUp()));
+
+    for (int i = 0; i < 10000; i++) {
+        bool updateOk = resourceSet.update();
+        QVERIFY(updateOk);
+    }
+    // The first update goes out, the second waits and the rest merge into it.
+    QCOMPARE(resourceSet.coalescedRequests(), (quint32)9998);
+
+    QTest::qWait(1000);
+    QCOMPARE(resourceSet.coalescedRequests(), (quint32)9998);
+}
+
 QTEST_MAIN(TestLooping)
@@ -41,6 +41,8 @@ public:
 private slots:
 
     void loopAcquireSend();
+    void loopAcquireReleaseCoalesced();
+    void loopUpdateCoalesced();
 
 private:
     // Disabled since they fail
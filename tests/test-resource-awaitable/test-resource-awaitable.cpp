@@ -0,0 +1,256 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "test-resource-awaitable.h"
+#include "fake-manager.h"
+#include <policy/resource-awaitable.h>
+#include <QCoreApplication>
+#include <utility>
+
+using namespace ResourcePolicy;
+
+// The smallest coroutine type: runs eagerly, and keeps its frame until the
+// Task goes, so a test can check done() and destroy it while it waits.
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> coroutine) : handle(coroutine) {}
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    ~Task() { if (handle) handle.destroy(); }
+    bool done() const { return handle.done(); }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+struct Progress
+{
+    int steps = 0;
+    ResourceTypeMask granted;
+    ResourceRequestFuture::Result error = ResourceRequestFuture::Pending;
+};
+
+static Task acquireAndRelease(ResourceSet *set, Progress *progress)
+{
+    progress->granted = co_await set->acquireAsync();
+    progress->steps++;
+    co_await set->releaseAsync();
+    progress->steps++;
+}
+
+static Task acquire(ResourceSet *set, Progress *progress, int timeoutMs = 0)
+{
+    try {
+        progress->granted = co_await set->acquireAsync(timeoutMs);
+        progress->steps++;
+    }
+    catch (const ResourceRequestError &error) {
+        progress->error = error.result();
+    }
+}
+
+static Task acquireThenUpdate(ResourceSet *set, Progress *progress)
+{
+    co_await set->acquireAsync();
+    progress->steps++;
+    co_await set->updateAsync();
+    progress->steps++;
+}
+
+static Task acquireReleaseAndDelete(ResourceSet *set, Progress *progress)
+{
+    co_await set->acquireAsync();
+    progress->steps++;
+    co_await set->releaseAsync();
+    delete set;
+    progress->steps++;
+}
+
+TestResourceAwaitable::TestResourceAwaitable()
+        : resourceSet(NULL)
+{
+}
+
+TestResourceAwaitable::~TestResourceAwaitable()
+{
+}
+
+void TestResourceAwaitable::init()
+{
+    resourceSet = new ResourceSet("player", NULL, true, false);
+    resourceSet->addResource(AudioPlaybackType);
+    resourceSet->addResource(VibraType);
+    resourceSet->resource(VibraType)->setOptional();
+    QVERIFY(resourceSet->initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+}
+
+void TestResourceAwaitable::cleanup()
+{
+    FakeManager::instance()->reset();
+    delete resourceSet;
+    resourceSet = NULL;
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(FakeManager::instance()->registeredSets(), 0);
+}
+
+void TestResourceAwaitable::testAcquireAndRelease()
+{
+    Progress progress;
+    Task task = acquireAndRelease(resourceSet, &progress);
+    QCOMPARE(progress.steps, 0);
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(task.done());
+    QCOMPARE(progress.steps, 2);
+    QVERIFY(progress.granted.contains(VibraType));
+    QVERIFY(!progress.granted.contains(AudioPlaybackType));
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestResourceAwaitable::testDenied()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny);
+
+    Progress progress;
+    Task task = acquire(resourceSet, &progress);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(task.done());
+    QCOMPARE(progress.steps, 0);
+    QCOMPARE(progress.error, ResourceRequestFuture::Denied);
+}
+
+void TestResourceAwaitable::testTimedOut()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+
+    Progress progress;
+    Task task = acquire(resourceSet, &progress, 50);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(!task.done());
+    QTest::qWait(200);
+    QVERIFY(task.done());
+    QCOMPARE(progress.error, ResourceRequestFuture::TimedOut);
+}
+
+void TestResourceAwaitable::testPreempted()
+{
+    FakeManager *manager = FakeManager::instance();
+    manager->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+
+    Progress progress;
+    Task task = acquire(resourceSet, &progress);
+    QVERIFY(manager->waitForIdle());
+    QVERIFY(!task.done());
+
+    manager->preempt(resourceSet->id());
+    QVERIFY(manager->waitForIdle());
+    QVERIFY(task.done());
+    QCOMPARE(progress.error, ResourceRequestFuture::Canceled);
+}
+
+void TestResourceAwaitable::testAlreadyAnswered()
+{
+    FakeManager::instance()->setSynchronous(true);
+
+    // Every answer arrives before acquireAsync() returns, so the coroutine
+    // runs to the end without suspending.
+    Progress progress;
+    Task task = acquireAndRelease(resourceSet, &progress);
+    QVERIFY(task.done());
+    QCOMPARE(progress.steps, 2);
+}
+
+void TestResourceAwaitable::testRequestFromCoroutine()
+{
+    FakeManager *manager = FakeManager::instance();
+    quint64 handled = manager->handledMessages();
+
+    Progress progress;
+    Task task = acquireThenUpdate(resourceSet, &progress);
+    QVERIFY(manager->waitForIdle());
+    QVERIFY(task.done());
+    QCOMPARE(progress.steps, 2);
+    QCOMPARE(manager->handledMessages(), handled + 2);
+}
+
+void TestResourceAwaitable::testDestroyedWhileWaiting()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+
+    Progress progress;
+    {
+        Task task = acquire(resourceSet, &progress);
+        QVERIFY(FakeManager::instance()->waitForIdle());
+        QVERIFY(!task.done());
+    }
+
+    // Deleting the set cancels the request, which finds no coroutine to
+    // resume.
+    delete resourceSet;
+    resourceSet = NULL;
+    QCOMPARE(progress.steps, 0);
+    QCOMPARE(progress.error, ResourceRequestFuture::Pending);
+}
+
+// The coroutine deletes the set from inside its reply handling, which must
+// not go on with the deleted set.
+void TestResourceAwaitable::testDeleteSetAfterAwait()
+{
+    Progress progress;
+    Task task = acquireReleaseAndDelete(resourceSet, &progress);
+    resourceSet->updateAsync();
+    resourceSet = NULL;
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(task.done());
+    QCOMPARE(progress.steps, 2);
+}
+
+// A coroutine still waiting when the set is deleted is resumed from the
+// event loop, not from inside the destructor.
+void TestResourceAwaitable::testSetDeletedWhileWaiting()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+
+    Progress progress;
+    Task task = acquire(resourceSet, &progress);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(!task.done());
+
+    delete resourceSet;
+    resourceSet = NULL;
+    QVERIFY(!task.done());
+    QCOMPARE(progress.error, ResourceRequestFuture::Pending);
+
+    QCoreApplication::processEvents();
+    QVERIFY(task.done());
+    QCOMPARE(progress.error, ResourceRequestFuture::Canceled);
+}
+
+QTEST_MAIN(TestResourceAwaitable)
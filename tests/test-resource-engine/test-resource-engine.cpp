@@ -23,6 +23,7 @@ USA.
 #include <QString>
 #include <QByteArray>
 #include <QList>
+#include <QSignalSpy>
 #include <QtDebug>
 #include <dbus/dbus.h>
 #include <string.h>
@@ -167,9 +168,9 @@ void TestResourceEngine::testAcquire()
     QByteArray ba = errorMessage.toLatin1();
     requestErrorMessage = ba.data();
 
-    QObject::connect(resourceEngine, SIGNAL(resourcesGranted(quint32)),
+    QObject::connect(resourceEngine, SIGNAL(resourcesGranted(quint32, quint32)),
                      this, SLOT(handleAcquire(quint32)));
-    QObject::connect(resourceEngine, SIGNAL(resourcesDenied()),
+    QObject::connect(resourceEngine, SIGNAL(resourcesDenied(quint32)),
                      this, SLOT(handleDeny()));
     bool acquireRequestSucceeded = resourceEngine->acquireResources();
 
@@ -238,9 +239,9 @@ void TestResourceEngine::testRelease()
 
     resourceEngine->connectToManager();
 
-    QObject::connect(resourceEngine, SIGNAL(resourcesGranted(quint32)),
+    QObject::connect(resourceEngine, SIGNAL(resourcesGranted(quint32, quint32)),
                       this, SLOT(handleAcquire(quint32)));
-    QObject::connect(resourceEngine, SIGNAL(resourcesDenied()),
+    QObject::connect(resourceEngine, SIGNAL(resourcesDenied(quint32)),
                       this, SLOT(handleDeny()));
 
     bool releaseRequestSucceeded = resourceEngine->releaseResources();
@@ -327,6 +328,140 @@ void TestResourceEngine::testMultipleInstences()
     delete(resSet);
 }
 
+void TestResourceEngine::testRequestTracker()
+{
+    RequestTracker tracker;
+    QCOMPARE(tracker.outstanding(), 0);
+
+    tracker.insert(1, RESMSG_REGISTER);
+    tracker.insert(2, RESMSG_UPDATE, 1000, true);
+    tracker.insert(3, RESMSG_ACQUIRE, 2000);
+    QCOMPARE(tracker.outstanding(), 3);
+    QVERIFY(tracker.contains(2));
+    QVERIFY(!tracker.contains(4));
+    QCOMPARE(tracker.value(2), RESMSG_UPDATE);
+    QCOMPARE(tracker.sentNs(3), (qint64)2000);
+    QVERIFY(tracker.hadGrants(2));
+    QVERIFY(!tracker.hadGrants(3));
+
+    tracker.clearSentNs(3);
+    QCOMPARE(tracker.sentNs(3), (qint64)0);
+    QVERIFY(tracker.contains(3));
+
+    QCOMPARE(tracker.take(2), RESMSG_UPDATE);
+    QVERIFY(!tracker.contains(2));
+    tracker.remove(2);
+    QCOMPARE(tracker.outstanding(), 2);
+
+    tracker.clear();
+    QCOMPARE(tracker.outstanding(), 0);
+    QVERIFY(!tracker.contains(1));
+}
+
+void TestResourceEngine::testRequestTrackerWrapsAround()
+{
+    RequestTracker tracker;
+
+    // A million updates that are never answered keep at most Capacity
+    // entries, the youngest ones.
+    for (quint32 requestNo = 1; requestNo <= 1000000; requestNo++) {
+        tracker.insert(requestNo, RESMSG_UPDATE);
+    }
+    QCOMPARE(tracker.outstanding(), (int)RequestTracker::Capacity);
+    QVERIFY(tracker.contains(1000000));
+    QVERIFY(tracker.contains(1000000 - RequestTracker::Capacity + 1));
+    QVERIFY(!tracker.contains(1000000 - RequestTracker::Capacity));
+
+    tracker.remove(1000000);
+    QCOMPARE(tracker.outstanding(), (int)RequestTracker::Capacity - 1);
+}
+
+void TestResourceEngine::testRequestTrackerDeadlines()
+{
+    RequestTracker tracker;
+    quint32 expired[RequestTracker::Capacity];
+
+    tracker.insert(1, RESMSG_ACQUIRE);
+    tracker.insert(2, RESMSG_UPDATE);
+    tracker.insert(3, RESMSG_RELEASE);
+    tracker.setDeadline(3, 300);
+    tracker.setDeadline(2, 200);
+    QCOMPARE(tracker.nextDeadline(), (qint64)200);
+    QCOMPARE(tracker.abandonExpired(100, expired), 0);
+
+    QCOMPARE(tracker.abandonExpired(300, expired), 2);
+    QCOMPARE(expired[0], (quint32)2);
+    QCOMPARE(expired[1], (quint32)3);
+    QCOMPARE(tracker.nextDeadline(), (qint64)0);
+    QCOMPARE(tracker.outstanding(), 1);
+
+    // Abandoned requests are kept so that a late answer is recognised.
+    QVERIFY(tracker.isAbandoned(2));
+    QVERIFY(!tracker.isAbandoned(1));
+    QCOMPARE(tracker.take(3), RESMSG_RELEASE);
+    QCOMPARE(tracker.outstanding(), 1);
+
+    tracker.abandon(1);
+    QCOMPARE(tracker.outstanding(), 0);
+    tracker.insert(1 + RequestTracker::Capacity, RESMSG_ACQUIRE);
+    QVERIFY(!tracker.isAbandoned(1 + RequestTracker::Capacity));
+    QCOMPARE(tracker.outstanding(), 1);
+}
+
+void TestResourceEngine::testRequestTrackerAnswered()
+{
+    RequestTracker tracker;
+    quint32 evictedNo = 0;
+    resmsg_type_t evictedType = RESMSG_REGISTER;
+
+    // An update answered by its status no longer counts, but a grant that
+    // follows is still recognised as the update's.
+    tracker.insert(1, RESMSG_UPDATE);
+    tracker.setDeadline(1, 100);
+    tracker.answer(1);
+    QCOMPARE(tracker.outstanding(), 0);
+    QVERIFY(tracker.isAnswered(1));
+    QCOMPARE(tracker.value(1), RESMSG_UPDATE);
+    QCOMPARE(tracker.nextDeadline(), (qint64)0);
+    tracker.remove(1);
+    QCOMPARE(tracker.outstanding(), 0);
+
+    // Answered entries are taken over silently, unanswered ones reported.
+    tracker.insert(2, RESMSG_UPDATE);
+    tracker.answer(2);
+    QVERIFY(!tracker.insert(2 + RequestTracker::Capacity, RESMSG_ACQUIRE, 0, false,
+                            &evictedNo, &evictedType));
+    QVERIFY(tracker.insert(2 + 2 * RequestTracker::Capacity, RESMSG_RELEASE, 0, false,
+                           &evictedNo, &evictedType));
+    QCOMPARE(evictedNo, (quint32)(2 + RequestTracker::Capacity));
+    QCOMPARE(evictedType, RESMSG_ACQUIRE);
+    QCOMPARE(tracker.outstanding(), 1);
+}
+
+// A set that is not pipelined learns of its release from the empty grant,
+// as before, not from the status that comes first.
+void TestResourceEngine::testReleaseAnsweredByGrant()
+{
+    QVERIFY(!resourceSet->isPipelined());
+    resourceEngine->connectToManager();
+    QSignalSpy releasedSpy(resourceEngine, SIGNAL(resourcesReleased(quint32)));
+
+    resourceEngine->messageMap.insert(5, RESMSG_RELEASE);
+    resourceEngine->handleStatusMessage(5);
+    QCOMPARE(releasedSpy.count(), 0);
+
+    resmsg_notify_t grant;
+    memset(&grant, 0, sizeof(grant));
+    grant.type = RESMSG_GRANT;
+    grant.id = resourceEngine->id();
+    grant.reqno = 5;
+    grant.resrc = 0;
+    resourceEngine->receivedGrant(&grant);
+    QCOMPARE(releasedSpy.count(), 1);
+    QCOMPARE(releasedSpy.at(0).at(0).value<quint32>(), (quint32)5);
+    QVERIFY(!resourceEngine->messageMap.contains(5));
+}
+
 QTEST_MAIN(TestResourceEngine)
 
 ////////////////////////////////////////////////////////////////
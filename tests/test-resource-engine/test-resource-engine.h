@@ -78,6 +78,12 @@ private slots:
     void testRegisterAudioProperties();
 
     void testMultipleInstences();
+
+    void testRequestTracker();
+    void testRequestTrackerWrapsAround();
+    void testRequestTrackerDeadlines();
+    void testRequestTrackerAnswered();
+    void testReleaseAnsweredByGrant();
 };
 
 #endif
@@ -36,6 +36,9 @@ HEADERS +=  $${POLICY}/resource.h \
 
 SOURCES +=  $${LIBRESOURCEQT}/src/resource.cpp \
             $${LIBRESOURCEQT}/src/resources.cpp \
+            $${LIBRESOURCEQT}/src/resource-latency-histogram.cpp \
+            $${LIBRESOURCEQT}/src/resource-log.cpp \
+            $${LIBRESOURCEQT}/src/resource-request-future.cpp \
             $${LIBRESOURCEQT}/src/resource-set.cpp \
             $${LIBRESOURCEQT}/src/resource-engine.cpp \
             $${LIBRESOURCEQT}/src/audio-resource.cpp \
@@ -44,7 +47,7 @@ SOURCES +=  $${LIBRESOURCEQT}/src/resource.cpp \
 OBJECTS_DIR = build
 MOC_DIR = build/moc
 QMAKE_CXXFLAGS += -Wall
-LIBS += -L$${LIBDBUSQEVENTLOOP}/build -ldbus-qeventloop
+LIBS += -L$${LIBDBUSQEVENTLOOP}/build -ldbus-qeventloop -lrt
 
 CONFIG  += qt debug warn_on link_pkgconfig
 QT += testlib
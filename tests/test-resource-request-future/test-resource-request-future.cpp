@@ -0,0 +1,545 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "test-resource-request-future.h"
+#include "fake-manager.h"
+#include "resource-request-tracker.h"
+#include <QThread>
+#include <QSignalSpy>
+
+using namespace ResourcePolicy;
+
+// Makes one blocking request from a thread of its own, as a worker would.
+class BlockingCaller: public QThread
+{
+public:
+    BlockingCaller(ResourceSet *set, ResourceRequest request, int timeoutMs = 0)
+        : set(set), request(request), timeoutMs(timeoutMs), result(ResourceRequestFuture::Pending)
+    {
+    }
+
+    void run()
+    {
+        if (request == AcquireRequest)
+            result = set->acquireBlocking(timeoutMs);
+        else
+            result = set->releaseBlocking(timeoutMs);
+    }
+
+    ResourceSet *set;
+    ResourceRequest request;
+    int timeoutMs;
+    ResourceRequestFuture::Result result;
+};
+
+// Runs the event loop of the set until the caller is done.
+static bool waitForCaller(BlockingCaller *caller)
+{
+    for (int i = 0; i < 200 && !caller->isFinished(); i++) {
+        QTest::qWait(10);
+    }
+    return caller->wait(1000);
+}
+
+TestResourceRequestFuture::TestResourceRequestFuture()
+        : resourceSet(NULL), finishedCount(0)
+{
+}
+
+TestResourceRequestFuture::~TestResourceRequestFuture()
+{
+}
+
+void TestResourceRequestFuture::finished(ResourcePolicy::ResourceRequestFuture future)
+{
+    finishedFutures.append(future);
+}
+
+void TestResourceRequestFuture::finishedWithoutFuture()
+{
+    finishedCount++;
+}
+
+void TestResourceRequestFuture::init()
+{
+    finishedFutures.clear();
+    finishedCount = 0;
+
+    resourceSet = new ResourceSet("player", NULL, true, false);
+    resourceSet->addResource(AudioPlaybackType);
+    resourceSet->setRequestCoalescing();
+    QVERIFY(resourceSet->initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+}
+
+void TestResourceRequestFuture::cleanup()
+{
+    FakeManager::instance()->reset();
+    delete resourceSet;
+    resourceSet = NULL;
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(FakeManager::instance()->registeredSets(), 0);
+}
+
+void TestResourceRequestFuture::testNullFuture()
+{
+    ResourceRequestFuture future;
+    QVERIFY(!future.isValid());
+    QVERIFY(future.isFinished());
+    QCOMPARE(future.result(), ResourceRequestFuture::Canceled);
+    QCOMPARE(future.request(), NumberOfRequests);
+    QCOMPARE(future.requestNumber(), (quint32)0);
+    QVERIFY(future == ResourceRequestFuture());
+}
+
+void TestResourceRequestFuture::testGranted()
+{
+    ResourceRequestFuture future = resourceSet->acquireAsync();
+    QVERIFY(future.isValid());
+    QVERIFY(!future.isFinished());
+    QCOMPARE(future.request(), AcquireRequest);
+    QVERIFY(future.requestNumber() != 0);
+    future.then(this, SLOT(finished(ResourcePolicy::ResourceRequestFuture)));
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(future.result(), ResourceRequestFuture::Succeeded);
+    QVERIFY(future.succeeded());
+    QCOMPARE(finishedFutures.size(), 1);
+    QVERIFY(finishedFutures.first() == future);
+    QVERIFY(resourceSet->resource(AudioPlaybackType)->isGranted());
+
+    ResourceRequestFuture released = resourceSet->releaseAsync();
+    QCOMPARE(released.request(), ReleaseRequest);
+    QVERIFY(released.requestNumber() > future.requestNumber());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(released.result(), ResourceRequestFuture::Succeeded);
+}
+
+void TestResourceRequestFuture::testDenied()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny);
+
+    ResourceRequestFuture future = resourceSet->acquireAsync();
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(future.result(), ResourceRequestFuture::Denied);
+}
+
+void TestResourceRequestFuture::testFailed()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Fail);
+
+    ResourceRequestFuture acquired = resourceSet->acquireAsync();
+    ResourceRequestFuture updated = resourceSet->updateAsync();
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(acquired.result(), ResourceRequestFuture::Failed);
+
+    // The request behind the failed one is sent all the same.
+    QCOMPARE(updated.result(), ResourceRequestFuture::Succeeded);
+}
+
+void TestResourceRequestFuture::testTimedOut()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+
+    ResourceRequestFuture future = resourceSet->acquireAsync(50);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QTest::qWait(200);
+    QCOMPARE(future.result(), ResourceRequestFuture::TimedOut);
+}
+
+// The timeout of an acquire made before the connection is up is kept for
+// when it is sent.
+void TestResourceRequestFuture::testTimedOutBeforeConnect()
+{
+    ResourceSet set("player", NULL, true, false);
+    set.addResource(AudioPlaybackType);
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+
+    ResourceRequestFuture future = set.acquireAsync(50);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QTest::qWait(200);
+    QCOMPARE(future.result(), ResourceRequestFuture::TimedOut);
+}
+
+void TestResourceRequestFuture::testPipelinedTimeoutOutOfOrder()
+{
+    ResourceSet set("player", NULL, true, false);
+    set.addResource(AudioPlaybackType);
+    QVERIFY(set.setPipelined());
+    QVERIFY(set.initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    // The update times out while the acquire before it is still waited for.
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Grant, 300, 1);
+    FakeManager::instance()->addRule(RESMSG_UPDATE, FakeManager::Drop, 0, 1);
+    ResourceRequestFuture acquired = set.acquireAsync();
+    ResourceRequestFuture updated = set.updateAsync(50);
+    QTest::qWait(150);
+    QCOMPARE(updated.result(), ResourceRequestFuture::TimedOut);
+    QVERIFY(!acquired.isFinished());
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(acquired.result(), ResourceRequestFuture::Succeeded);
+}
+
+// Continuations never run from inside a call to the set, even when the
+// manager answers before acquireAsync() returns.
+void TestResourceRequestFuture::testContinuationIsQueued()
+{
+    FakeManager::instance()->setSynchronous(true);
+
+    ResourceRequestFuture future = resourceSet->acquireAsync();
+    QCOMPARE(future.result(), ResourceRequestFuture::Succeeded);
+
+    future.then(this, SLOT(finishedWithoutFuture()));
+    QCOMPARE(finishedCount, 0);
+    QCoreApplication::processEvents();
+    QCOMPARE(finishedCount, 1);
+}
+
+void TestResourceRequestFuture::testCoalescedRequestsShareFuture()
+{
+    ResourceRequestFuture acquired = resourceSet->acquireAsync();
+    ResourceRequestFuture updated = resourceSet->updateAsync();
+    ResourceRequestFuture updatedAgain = resourceSet->updateAsync();
+    QVERIFY(updated == updatedAgain);
+    QVERIFY(updated != acquired);
+    QCOMPARE(updated.requestNumber(), (quint32)0);
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(acquired.result(), ResourceRequestFuture::Succeeded);
+    QCOMPARE(updated.result(), ResourceRequestFuture::Succeeded);
+    QVERIFY(updated.requestNumber() > acquired.requestNumber());
+}
+
+void TestResourceRequestFuture::testCanceledByLaterRequest()
+{
+    ResourceRequestFuture acquired = resourceSet->acquireAsync();
+    ResourceRequestFuture released = resourceSet->releaseAsync();
+    ResourceRequestFuture acquiredAgain = resourceSet->acquireAsync();
+
+    // The release is dropped, and the second acquire ends with the first.
+    QCOMPARE(released.result(), ResourceRequestFuture::Canceled);
+    QVERIFY(acquiredAgain == acquired);
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(acquired.result(), ResourceRequestFuture::Succeeded);
+}
+
+void TestResourceRequestFuture::testCanceledByPreemption()
+{
+    FakeManager *manager = FakeManager::instance();
+    QVERIFY(resourceSet->acquireAsync().isValid());
+    QVERIFY(manager->waitForIdle());
+
+    manager->addRule(RESMSG_UPDATE, FakeManager::Drop);
+    ResourceRequestFuture future = resourceSet->updateAsync();
+    QVERIFY(manager->waitForIdle());
+    QVERIFY(!future.isFinished());
+
+    manager->preempt(resourceSet->id());
+    QVERIFY(manager->waitForIdle());
+    QCOMPARE(future.result(), ResourceRequestFuture::Canceled);
+}
+
+void TestResourceRequestFuture::testCanceledByDeletion()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop);
+
+    ResourceRequestFuture future = resourceSet->acquireAsync();
+    future.then(this, SLOT(finished(ResourcePolicy::ResourceRequestFuture)));
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(!future.isFinished());
+
+    delete resourceSet;
+    resourceSet = NULL;
+    QCOMPARE(future.result(), ResourceRequestFuture::Canceled);
+    QCoreApplication::processEvents();
+    QCOMPARE(finishedFutures.size(), 1);
+}
+
+void TestResourceRequestFuture::testAcquireBeforeConnect()
+{
+    ResourceSet set("player", NULL, true, false);
+    set.addResource(AudioPlaybackType);
+
+    ResourceRequestFuture future = set.acquireAsync();
+    QVERIFY(set.acquireAsync() == future);
+    QVERIFY(!future.isFinished());
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(future.result(), ResourceRequestFuture::Succeeded);
+    QVERIFY(future.requestNumber() != 0);
+}
+
+void TestResourceRequestFuture::testAcquireWhileManagerIsDown()
+{
+    FakeManager *manager = FakeManager::instance();
+    manager->restart(200);
+    QTest::qWait(50);
+    QVERIFY(!resourceSet->isConnectedToManager());
+
+    // The acquire goes out behind the registration once the manager is
+    // back, and answers the future.
+    ResourceRequestFuture future = resourceSet->acquireAsync();
+    QTest::qWait(50);
+    QVERIFY(!future.isFinished());
+
+    QVERIFY(manager->waitForIdle());
+    QVERIFY(manager->waitForIdle());
+    QCOMPARE(future.result(), ResourceRequestFuture::Succeeded);
+    QVERIFY(future.requestNumber() != 0);
+    QVERIFY(resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestResourceRequestFuture::testPipelinedAnswersOutOfOrder()
+{
+    ResourceSet set("player", NULL, true, false);
+    set.addResource(AudioPlaybackType);
+    QVERIFY(set.setPipelined());
+    QVERIFY(set.initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    // The update is answered first, and must not be taken for the acquire.
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny, 100, 1);
+    ResourceRequestFuture acquired = set.acquireAsync();
+    ResourceRequestFuture updated = set.updateAsync();
+    QTest::qWait(50);
+    QCOMPARE(updated.result(), ResourceRequestFuture::Succeeded);
+    QVERIFY(!acquired.isFinished());
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(acquired.result(), ResourceRequestFuture::Denied);
+}
+
+void TestResourceRequestFuture::testPipelinedStatusOnlyAnswers()
+{
+    ResourceSet set("player", NULL, false, false);
+    set.addResource(AudioPlaybackType);
+    QVERIFY(set.setPipelined());
+    QVERIFY(set.initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    // Without alwaysReply no signal tells of these, but each must still be
+    // taken off the queue of the set.
+    QSignalSpy deniedSpy(&set, SIGNAL(resourcesDenied()));
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny, 0, 1);
+    ResourceRequestFuture acquired = set.acquireAsync();
+    QList<ResourceRequestFuture> released;
+    for (int i = 0; i < 10; i++) {
+        released << set.releaseAsync();
+    }
+    ResourceRequestFuture updated = set.updateAsync();
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(acquired.result(), ResourceRequestFuture::Denied);
+    for (int i = 0; i < released.count(); i++) {
+        QCOMPARE(released.at(i).result(), ResourceRequestFuture::Succeeded);
+    }
+    QCOMPARE(updated.result(), ResourceRequestFuture::Succeeded);
+    QCOMPARE(deniedSpy.count(), 0);
+    QCOMPARE(set.outstandingRequests(), 0);
+}
+
+// More requests than the engine can track are held back until answers
+// make room, instead of giving up the oldest ones.
+void TestResourceRequestFuture::testPipelinedBeyondTrackerCapacity()
+{
+    ResourceSet set("player", NULL, true, false);
+    set.addResource(AudioPlaybackType);
+    QVERIFY(set.setPipelined());
+    QVERIFY(set.initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    QList<ResourceRequestFuture> acquired;
+    for (int i = 0; i < 2 * RequestTracker::Capacity + 10; i++) {
+        acquired << set.acquireAsync();
+    }
+    QCOMPARE(set.outstandingRequests(), (int)RequestTracker::Capacity);
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    for (int i = 0; i < acquired.count(); i++) {
+        QCOMPARE(acquired.at(i).result(), ResourceRequestFuture::Succeeded);
+    }
+    QCOMPARE(set.outstandingRequests(), 0);
+}
+
+void TestResourceRequestFuture::testReleaseWhenNotConnected()
+{
+    ResourceSet set("player", NULL, true, false);
+    set.addResource(AudioPlaybackType);
+
+    ResourceRequestFuture future = set.releaseAsync();
+    QCOMPARE(future.result(), ResourceRequestFuture::Succeeded);
+    QCOMPARE(future.requestNumber(), (quint32)0);
+}
+
+void TestResourceRequestFuture::testWhenAll()
+{
+    ResourceSet recorderSet("recorder", NULL, true, false);
+    recorderSet.addResource(AudioRecorderType);
+    QVERIFY(recorderSet.initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    ResourceRequestFuture player = resourceSet->acquireAsync();
+    ResourceRequestFuture recorder = recorderSet.acquireAsync();
+    ResourceRequestFuture all = ResourceRequestFuture::whenAll(
+            QList<ResourceRequestFuture>() << player << recorder);
+    all.then(this, SLOT(finished(ResourcePolicy::ResourceRequestFuture)));
+    QCOMPARE(all.request(), NumberOfRequests);
+    QVERIFY(!all.isFinished());
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(player.isFinished());
+    QVERIFY(recorder.isFinished());
+    QCOMPARE(all.result(), ResourceRequestFuture::Succeeded);
+    QCOMPARE(finishedFutures.size(), 1);
+    QVERIFY(finishedFutures.first() == all);
+}
+
+void TestResourceRequestFuture::testWhenAllFirstFailure()
+{
+    ResourceSet recorderSet("recorder", NULL, true, false);
+    recorderSet.addResource(AudioRecorderType);
+    QVERIFY(recorderSet.initAndConnect());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Grant, 0, 1);
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny, 0, 1);
+    ResourceRequestFuture player = resourceSet->acquireAsync();
+    ResourceRequestFuture recorder = recorderSet.acquireAsync();
+    ResourceRequestFuture all = ResourceRequestFuture::whenAll(
+            QList<ResourceRequestFuture>() << player << recorder << ResourceRequestFuture());
+
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(player.result(), ResourceRequestFuture::Succeeded);
+    QCOMPARE(recorder.result(), ResourceRequestFuture::Denied);
+    QCOMPARE(all.result(), ResourceRequestFuture::Denied);
+}
+
+void TestResourceRequestFuture::testWhenAllEmpty()
+{
+    ResourceRequestFuture all = ResourceRequestFuture::whenAll(QList<ResourceRequestFuture>());
+    QVERIFY(all.isValid());
+    QCOMPARE(all.result(), ResourceRequestFuture::Succeeded);
+}
+
+void TestResourceRequestFuture::testAcquireBlocking()
+{
+    BlockingCaller acquirer(resourceSet, AcquireRequest);
+    acquirer.start();
+    QVERIFY(waitForCaller(&acquirer));
+    QCOMPARE(acquirer.result, ResourceRequestFuture::Succeeded);
+    QVERIFY(resourceSet->resource(AudioPlaybackType)->isGranted());
+
+    BlockingCaller releaser(resourceSet, ReleaseRequest);
+    releaser.start();
+    QVERIFY(waitForCaller(&releaser));
+    QCOMPARE(releaser.result, ResourceRequestFuture::Succeeded);
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestResourceRequestFuture::testAcquireBlockingDenied()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny);
+
+    BlockingCaller caller(resourceSet, AcquireRequest);
+    caller.start();
+    QVERIFY(waitForCaller(&caller));
+    QCOMPARE(caller.result, ResourceRequestFuture::Denied);
+}
+
+void TestResourceRequestFuture::testAcquireBlockingTimedOut()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+
+    BlockingCaller caller(resourceSet, AcquireRequest, 50);
+    caller.start();
+    QVERIFY(waitForCaller(&caller));
+    QCOMPARE(caller.result, ResourceRequestFuture::TimedOut);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(resourceSet->outstandingRequests(), 0);
+}
+
+void TestResourceRequestFuture::testBlockingCallerGivesUp()
+{
+    FakeManager *manager = FakeManager::instance();
+    quint64 handled = manager->handledMessages();
+
+    // The thread of the set is busy here, so the request is not even sent
+    // before the caller gives up, and then it is not sent at all.
+    BlockingCaller caller(resourceSet, AcquireRequest, 50);
+    caller.start();
+    QVERIFY(caller.wait(1000));
+    QCOMPARE(caller.result, ResourceRequestFuture::TimedOut);
+
+    QVERIFY(manager->waitForIdle());
+    QCOMPARE(manager->handledMessages(), handled);
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+// The thread of the set sends the request only after a while, and the grant
+// comes after the caller has given up but before the request times out.
+void TestResourceRequestFuture::testBlockingCallerGivesUpAfterSend()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Grant, 60, 1);
+
+    BlockingCaller caller(resourceSet, AcquireRequest, 100);
+    caller.start();
+    QTest::qSleep(60);
+    QVERIFY(waitForCaller(&caller));
+    QCOMPARE(caller.result, ResourceRequestFuture::TimedOut);
+
+    // Nobody else asked for the grant, so it is released.
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QTest::qWait(100);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QVERIFY(!resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestResourceRequestFuture::testAbandonedGrantWantedByOtherAcquire()
+{
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Grant, 60, 2);
+
+    BlockingCaller caller(resourceSet, AcquireRequest, 100);
+    caller.start();
+    QTest::qSleep(60);
+    ResourceRequestFuture other = resourceSet->acquireAsync();
+    QVERIFY(waitForCaller(&caller));
+    QCOMPARE(caller.result, ResourceRequestFuture::TimedOut);
+
+    // The grant the caller gave up on is the one the other acquire holds.
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QTest::qWait(200);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(other.result(), ResourceRequestFuture::Succeeded);
+    QVERIFY(resourceSet->resource(AudioPlaybackType)->isGranted());
+}
+
+void TestResourceRequestFuture::testBlockingOnThreadOfSet()
+{
+    QTest::ignoreMessage(QtWarningMsg, "ResourceSet: blocking request on the thread of the set, which would never answer it");
+    QCOMPARE(resourceSet->acquireBlocking(50), ResourceRequestFuture::Failed);
+}
+
+QTEST_MAIN(TestResourceRequestFuture)
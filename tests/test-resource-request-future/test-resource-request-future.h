@@ -0,0 +1,80 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef TEST_RESOURCE_REQUEST_FUTURE_H
+#define TEST_RESOURCE_REQUEST_FUTURE_H
+
+#include <QtTest/QTest>
+#include <QObject>
+#include <QList>
+#include <policy/resource-set.h>
+#include <policy/resource-request-future.h>
+
+class TestResourceRequestFuture: public QObject
+{
+    Q_OBJECT
+public:
+    TestResourceRequestFuture();
+    ~TestResourceRequestFuture();
+
+    ResourcePolicy::ResourceSet *resourceSet;
+    QList<ResourcePolicy::ResourceRequestFuture> finishedFutures;
+    int finishedCount;
+
+public slots:
+    void finished(ResourcePolicy::ResourceRequestFuture future);
+    void finishedWithoutFuture();
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testNullFuture();
+    void testGranted();
+    void testDenied();
+    void testFailed();
+    void testTimedOut();
+    void testTimedOutBeforeConnect();
+    void testPipelinedTimeoutOutOfOrder();
+    void testContinuationIsQueued();
+    void testCoalescedRequestsShareFuture();
+    void testCanceledByLaterRequest();
+    void testCanceledByPreemption();
+    void testCanceledByDeletion();
+    void testAcquireBeforeConnect();
+    void testAcquireWhileManagerIsDown();
+    void testPipelinedAnswersOutOfOrder();
+    void testPipelinedStatusOnlyAnswers();
+    void testPipelinedBeyondTrackerCapacity();
+    void testReleaseWhenNotConnected();
+    void testWhenAll();
+    void testWhenAllFirstFailure();
+    void testWhenAllEmpty();
+    void testAcquireBlocking();
+    void testAcquireBlockingDenied();
+    void testAcquireBlockingTimedOut();
+    void testBlockingCallerGivesUp();
+    void testBlockingCallerGivesUpAfterSend();
+    void testAbandonedGrantWantedByOtherAcquire();
+    void testBlockingOnThreadOfSet();
+};
+
+#endif
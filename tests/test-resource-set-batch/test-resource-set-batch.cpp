@@ -0,0 +1,142 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#include "test-resource-set-batch.h"
+#include "fake-manager.h"
+#include <QSignalSpy>
+
+using namespace ResourcePolicy;
+
+TestResourceSetBatch::TestResourceSetBatch()
+        : batch(NULL)
+{
+}
+
+TestResourceSetBatch::~TestResourceSetBatch()
+{
+}
+
+ResourceSet *TestResourceSetBatch::newSet(bool alwaysReply)
+{
+    ResourceSet *resourceSet = new ResourceSet("player", NULL, alwaysReply, false);
+    resourceSet->addResource(AudioPlaybackType);
+    resourceSet->initAndConnect();
+    batch->addResourceSet(resourceSet);
+    return resourceSet;
+}
+
+void TestResourceSetBatch::init()
+{
+    batch = new ResourceSetBatch;
+}
+
+void TestResourceSetBatch::cleanup()
+{
+    FakeManager::instance()->reset();
+    QList<ResourceSet *> sets = batch->resourceSets();
+    delete batch;
+    batch = NULL;
+    qDeleteAll(sets);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCOMPARE(FakeManager::instance()->registeredSets(), 0);
+}
+
+void TestResourceSetBatch::testFinished()
+{
+    newSet(true);
+    newSet(true);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    QSignalSpy finishedSpy(batch, SIGNAL(finished()));
+    QVERIFY(batch->acquire());
+    QVERIFY(batch->isPending());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCoreApplication::processEvents();
+    QVERIFY(!batch->isPending());
+    QCOMPARE(finishedSpy.count(), 1);
+}
+
+// Without alwaysReply a denial and a release of nothing send no signal, but
+// the requests are still done with.
+void TestResourceSetBatch::testFinishedWithoutAlwaysReply()
+{
+    newSet(false);
+    newSet(false);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    QSignalSpy finishedSpy(batch, SIGNAL(finished()));
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Deny);
+    QVERIFY(batch->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCoreApplication::processEvents();
+    QCOMPARE(finishedSpy.count(), 1);
+
+    QVERIFY(batch->release());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCoreApplication::processEvents();
+    QCOMPARE(finishedSpy.count(), 2);
+}
+
+// A reply to a request the batch did not make does not answer the batch.
+void TestResourceSetBatch::testOtherRepliesDoNotCount()
+{
+    ResourceSet *dropped = newSet(true);
+    QVERIFY(dropped->setPipelined());
+    newSet(true);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    QSignalSpy finishedSpy(batch, SIGNAL(finished()));
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+    QVERIFY(batch->acquire());
+    ResourceRequestFuture updated = dropped->updateAsync();
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCoreApplication::processEvents();
+    QCOMPARE(updated.result(), ResourceRequestFuture::Succeeded);
+    QVERIFY(batch->isPending());
+    QCOMPARE(finishedSpy.count(), 0);
+
+    batch->removeResourceSet(dropped);
+    QVERIFY(!batch->isPending());
+    QCOMPARE(finishedSpy.count(), 1);
+    delete dropped;
+}
+
+void TestResourceSetBatch::testSetDestroyed()
+{
+    ResourceSet *dropped = newSet(true);
+    newSet(true);
+    QVERIFY(FakeManager::instance()->waitForIdle());
+
+    QSignalSpy finishedSpy(batch, SIGNAL(finished()));
+    FakeManager::instance()->addRule(RESMSG_ACQUIRE, FakeManager::Drop, 0, 1);
+    QVERIFY(batch->acquire());
+    QVERIFY(FakeManager::instance()->waitForIdle());
+    QCoreApplication::processEvents();
+    QCOMPARE(finishedSpy.count(), 0);
+
+    delete dropped;
+    QCoreApplication::processEvents();
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(batch->resourceSets().size(), 1);
+}
+
+QTEST_MAIN(TestResourceSetBatch)
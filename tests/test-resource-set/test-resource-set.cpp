@@ -24,6 +24,8 @@ USA.
 #include <QEventLoop>
 #include <QTimer>
 #include "test-resource-set.h"
+#include <policy/resource-log.h>
+#include "resource-engine.h"
 
 using namespace ResourcePolicy;
 
@@ -515,4 +517,88 @@ void TestResourceSet::testUninitializedRelease()
     QCOMPARE(stateSpy.count(), 0);
 }
 
+void TestResourceSet::testLatencyHistogram()
+{
+    LatencyHistogram histogram;
+    QCOMPARE(histogram.count(), (quint64)0);
+    QCOMPARE(histogram.percentile(50), (qint64)0);
+
+    // Small values get a bucket of their own, larger ones share a bucket
+    // with the values that differ only below the top four bits.
+    QCOMPARE(LatencyHistogram::bucketOf(7), 7);
+    QCOMPARE(LatencyHistogram::bucketOf(8), 8);
+    QCOMPARE(LatencyHistogram::bucketOf(16), LatencyHistogram::bucketOf(17));
+    QVERIFY(LatencyHistogram::bucketOf(17) != LatencyHistogram::bucketOf(18));
+    QCOMPARE(LatencyHistogram::bucketUpperBound(LatencyHistogram::bucketOf(1000000)), (qint64)1048575);
+    QCOMPARE(LatencyHistogram::bucketOf(Q_INT64_C(1) << 50), LatencyHistogram::BucketCount - 1);
+
+    for (qint64 i = 1; i <= 1000; i++) {
+        histogram.record(i * 1000);
+    }
+    QCOMPARE(histogram.count(), (quint64)1000);
+    QCOMPARE(histogram.minimum(), (qint64)1000);
+    QCOMPARE(histogram.maximum(), (qint64)1000000);
+    QCOMPARE(histogram.mean(), (qint64)500500);
+
+    // Percentiles are exact to within the 12.5% width of a bucket.
+    qint64 p50 = histogram.percentile(50);
+    QVERIFY(p50 >= 500000 && p50 <= 562500);
+    qint64 p99 = histogram.percentile(99);
+    QVERIFY(p99 >= 990000 && p99 <= 1000000);
+    QCOMPARE(histogram.percentile(100), (qint64)1000000);
+
+    LatencyHistogram other;
+    other.record(10);
+    other.add(histogram);
+    QCOMPARE(other.count(), (quint64)1001);
+    QCOMPARE(other.minimum(), (qint64)10);
+    QCOMPARE(other.percentile(0), (qint64)10);
+
+    other.reset();
+    QCOMPARE(other.count(), (quint64)0);
+    QCOMPARE(other.maximum(), (qint64)0);
+}
+
+void TestResourceSet::testLatencyHistogramsEmpty()
+{
+    ResourceSet resourceSet("player");
+    QCOMPARE(resourceSet.latencyHistogram(AcquireRequest, FinalReplyStage).count(), (quint64)0);
+    QCOMPARE(resourceSet.latencyHistogram(NumberOfRequests, StatusReplyStage).count(), (quint64)0);
+    resourceSet.resetLatencyHistograms();
+}
+
+void TestResourceSet::testRingLog()
+{
+    ResourceLog::Mode oldMode = ResourceLog::mode();
+    ResourceLog::setMode(ResourceLog::Ring);
+    QCOMPARE(ResourceLog::mode(), ResourceLog::Ring);
+
+    ResourceSet resourceSet("player");
+    resourceSet.addResource(AudioPlaybackType);
+    ResourceLog::setMode(oldMode);
+
+#ifndef RESOURCEQT_NO_LOGS
+    QStringList records = ResourceLog::records();
+    QVERIFY(!records.isEmpty());
+    QString expected = QString("ResourceSet::addResourceObject(%1)").arg(resourceSet.id());
+    QVERIFY(records.last().contains(expected));
+#endif
+
+    ResourceLog::clear();
+    QVERIFY(ResourceLog::records().isEmpty());
+}
+
+// %lf takes a double like %f, only %Lf takes a long double.
+void TestResourceSet::testRingLogFloatArguments()
+{
+    ResourceLog::clear();
+    ResourcePolicy::logToRing("floats %lf %Lf %d", 1.5, (long double)2.5, 7);
+
+    QStringList records = ResourceLog::records();
+    QCOMPARE(records.size(), 1);
+    QVERIFY(records.last().contains("floats 1.500000 2.500000 7"));
+
+    ResourceLog::clear();
+}
+
 QTEST_MAIN(TestResourceSet)
@@ -97,6 +97,12 @@ private slots:
     void testUpdateNoInit();
 
     void testUninitializedRelease();
+
+    void testLatencyHistogram();
+    void testLatencyHistogramsEmpty();
+
+    void testRingLog();
+    void testRingLogFloatArguments();
 };
 
 #endif
@@ -223,4 +223,42 @@ void TestResource::testOptional()
     QVERIFY(result == expected);
 }
 
+void TestResource::testTypeMask()
+{
+    ResourceTypeMask mask;
+    QVERIFY(mask.isEmpty());
+    QCOMPARE(mask.count(), 0);
+    QVERIFY(mask.begin() == mask.end());
+
+    mask.insert(HeadsetButtonsType);
+    mask.insert(AudioPlaybackType);
+    mask.insert(VibraType);
+    mask.insert(VibraType);
+    QVERIFY(!mask.isEmpty());
+    QCOMPARE(mask.count(), 3);
+    QVERIFY(mask.contains(AudioPlaybackType));
+    QVERIFY(mask.contains(VibraType));
+    QVERIFY(mask.contains(HeadsetButtonsType));
+    QVERIFY(!mask.contains(VideoPlaybackType));
+    QCOMPARE(mask.toUInt(), (quint32)((1 << AudioPlaybackType) | (1 << VibraType) | (1 << HeadsetButtonsType)));
+
+    QList<ResourceType> expected;
+    expected << AudioPlaybackType << VibraType << HeadsetButtonsType;
+    QVERIFY(mask.toList() == expected);
+    QVERIFY(ResourceTypeMask(expected) == mask);
+
+    QList<ResourceType> iterated;
+    foreach (ResourceType type, mask) {
+        iterated << type;
+    }
+    QVERIFY(iterated == expected);
+
+    mask.remove(VibraType);
+    QCOMPARE(mask.count(), 2);
+    QVERIFY(!mask.contains(VibraType));
+
+    QVariant variant = QVariant::fromValue(mask);
+    QVERIFY(variant.value<ResourceTypeMask>() == mask);
+}
+
 QTEST_MAIN(TestResource)
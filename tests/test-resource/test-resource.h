@@ -69,6 +69,8 @@ private slots:
 
     void testOptional_data();
     void testOptional();
+
+    void testTypeMask();
 };
 
 #endif
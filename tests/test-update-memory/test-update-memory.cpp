@@ -0,0 +1,87 @@
+/*************************************************************************
+This file is part of libresourceqt
+
+Copyright (C) 2011 Nokia Corporation.
+
+This library is free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#include "test-update-memory.h"
+#include "fake-manager.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace ResourcePolicy;
+
+static const int UPDATE_WARMUP = 10000;
+static const int UPDATES = 1000000;
+// Allowed growth of the resident set over all updates, for allocator noise.
+static const long MAX_UPDATE_GROWTH_KB = 1024;
+
+// The resident set size of the process in kB, or -1.
+static long residentSetKb()
+{
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/proc/%d/status", getpid());
+    FILE *status = fopen(filename, "r");
+    if (status == NULL)
+        return -1;
+
+    long kb = -1;
+    char line[256];
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            sscanf(line + 6, "%ld", &kb);
+            break;
+        }
+    }
+    fclose(status);
+    return kb;
+}
+
+// A long-lived player calls update() on every track change. The manager
+// answers each update before the next one is made, and the resident set
+// must stay flat however many there are.
+void TestUpdateMemory::testUpdatesKeepMemoryFlat()
+{
+    FakeManager *manager = FakeManager::instance();
+    ResourceSet *set = new ResourceSet("player", NULL, true, false);
+    set->addResource(AudioPlaybackType);
+    QVERIFY(set->initAndConnect());
+    QVERIFY(manager->waitForIdle());
+    manager->setSynchronous(true);
+
+    for (int i = 0; i < UPDATE_WARMUP; i++) {
+        set->update();
+    }
+    long before = residentSetKb();
+    QVERIFY(before > 0);
+    for (int i = 0; i < UPDATES; i++) {
+        set->update();
+    }
+    long after = residentSetKb();
+
+    qDebug("%d updates: VmRSS %ld kB -> %ld kB", UPDATES, before, after);
+    QVERIFY(after - before <= MAX_UPDATE_GROWTH_KB);
+    QCOMPARE(set->outstandingRequests(), 0);
+
+    manager->reset();
+    delete set;
+    QVERIFY(manager->waitForIdle());
+}
+
+QTEST_MAIN(TestUpdateMemory)
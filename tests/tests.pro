@@ -22,19 +22,41 @@
 TEMPLATE = subdirs
 
 SUBDIRS = test-dbus-qeventloop              \
+          test-dbus-qeventloop-thread       \
           test-dbus-pong                    \
           test-audio-resource               \
           test-video-resource               \
           test-resource                     \
           test-resource-set                 \
+          fake-manager                      \
+          test-fake-manager                 \
+          test-resource-request-future      \
+          test-resource-set-batch           \
           test-init-and-connect             \
           benchmark-resource-set            \
+          benchmark-resource-engine         \
+          benchmark-fake-manager            \
+          benchmark-dbus-qeventloop         \
           test-acquire                      \
           test-update                       \
           test-auto-release                 \
           test-always-reply                 \
           test-looping                      \
-          test-released-by-manager
+          test-released-by-manager          \
+          test-update-memory
+
+# fake-manager builds the static library these link.
+test-fake-manager.depends = fake-manager
+benchmark-fake-manager.depends = fake-manager
+test-update-memory.depends = fake-manager
+test-resource-request-future.depends = fake-manager
+test-resource-set-batch.depends = fake-manager
+
+# Coroutines need C++20, which only Qt 5 builds are set up for.
+equals(QT_MAJOR_VERSION, 5) {
+    SUBDIRS += test-resource-awaitable
+    test-resource-awaitable.depends = fake-manager
+}
 
 # Install options
 include(../common.pri)